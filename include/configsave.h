@@ -0,0 +1,51 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CONFIGSAVE_H
+#define CONFIGSAVE_H
+
+#include <stdint.h>
+
+/** Saves parameters and CAN maps in the background
+ *
+ * Call Start() from the main loop or terminal and Run() from a periodic task.
+ * Each Run() programs at most the given number of words, in between the
+ * parameters and CAN maps stay fully usable. The saved configuration only
+ * becomes valid when the parameter page CRC is programmed in the last step.
+ */
+class ConfigSave
+{
+   public:
+      static bool Start();
+      static void Run(int maxWords);
+      static bool IsBusy() { return state != IDLE; }
+      static int GetProgress();
+      static bool CanMapsSaved();
+      static bool HasFailed() { return failed; }
+   private:
+      enum SaveState { IDLE, ERASE, CAN1MAP, CAN2MAP, PARAMS };
+
+      static int RemainingWords();
+
+      static volatile SaveState state;
+      static int totalWords;
+      static bool saveMaps;
+      static bool failed;
+};
+
+#endif // CONFIGSAVE_H
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+/*
+ * Software version of the STM32 CRC unit: polynomial 0x04C11DB7, initial
+ * value 0xFFFFFFFF, input taken one 32-bit word at a time MSB first, no
+ * reflection and no final XOR. So crc32(p, n, CRC32_INIT) equals
+ * crc_reset(); crc_calculate_block(p, n); on the target, for example
+ *   0x00000000 -> 0xC704DD7B
+ *   0x12345678 -> 0xDF8A8A2B
+ *   0xFFFFFFFF -> 0x00000000
+ *
+ * Defining CRC32_SLICE_BY_8 for crc32.cpp selects 8 KiB of tables that
+ * process two words per iteration, meant for host tools. Otherwise a single
+ * 1 KiB table is used and each word takes four lookups.
+ */
+#define CRC32_INIT 0xFFFFFFFF
+
+/**
+ *  \brief Calculate STM32 CRC of a block of words
+ *
+ * \param[in] p pointer to the data
+ * \param[in] len length of the data in 32-bit words
+ * \param[in] crc CRC32_INIT or CRC of previous data
+ *
+ * \return Calculated CRC value
+ */
+uint32_t crc32(const uint32_t* p, uint32_t len, uint32_t crc);
+
+/**
+ * \brief Calculate STM32 CRC of a single word
+ *
+ * \param[in] input data word
+ * \param[in] crc CRC32_INIT or CRC of previous data
+ *
+ * \return Calculated CRC value
+ */
+uint32_t crc32(uint32_t input, uint32_t crc);
+
+#endif // CRC32_H
@@ -30,8 +30,9 @@ extern const uint8_t crc_table[256];
  *  \brief Calculate 8-bit CRC
  *
  *
- * Calculate an 8-bit CRC of a block of data. The algorithm used depends on
- * library configuration.
+ * Calculate an 8-bit CRC of a block of data. Defining CRC8_SLICE_BY_4 for
+ * crc8.cpp processes 4 bytes per iteration, this costs 768 bytes of flash
+ * for its tables. The other files are not affected by the define.
  *
  * \param[in] p pointer to the data to take we wish to compute the CRC of
  * \param[in] len length of the data
@@ -39,15 +40,7 @@ extern const uint8_t crc_table[256];
  *
  * \return Calculated CRC value
  */
-inline uint8_t crc8(uint8_t* p, uint8_t len, uint8_t crc)
-{
-    while (len--)
-    {
-        crc = crc_table[crc ^ *p++];
-    }
-
-    return crc;
-}
+uint8_t crc8(const uint8_t* p, uint8_t len, uint8_t crc);
 
 /**
  * \brief Calculate 8-bit CRC of a byte
@@ -67,4 +60,23 @@ inline uint8_t crc8(uint8_t input, uint8_t crc)
     return crc;
 }
 
+/**
+ * \brief Incremental 8-bit CRC of data arriving in pieces
+ *
+ * Adding pieces of any length gives the same CRC as a single crc8() call
+ * over the whole data.
+ */
+class Crc8Stream
+{
+public:
+    Crc8Stream(uint8_t init = 0) : crc(init) {}
+    void Reset(uint8_t init = 0) { crc = init; }
+    void Add(const uint8_t* p, uint8_t len) { crc = crc8(p, len, crc); }
+    void Add(uint8_t input) { crc = crc8(input, crc); }
+    uint8_t Get() const { return crc; }
+
+private:
+    uint8_t crc;
+};
+
 #endif /* __CRC8_H_ */
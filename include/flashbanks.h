@@ -0,0 +1,62 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FLASHBANKS_H
+#define FLASHBANKS_H
+
+#include <stdint.h>
+
+/** @brief Two equally sized, separately erasable flash areas
+ * Storage code only accesses flash through this interface, so it can run
+ * on any memory that behaves like flash: erased words read 0xFFFFFFFF and
+ * every word can only be programmed once after an erase.
+ */
+class IFlashBanks
+{
+public:
+   /** @return size of each bank in bytes */
+   virtual uint32_t GetBankSize() = 0;
+
+   /** @param bank 0 or 1
+    * @return memory mapped start of bank for reading
+    */
+   virtual const uint32_t* GetBank(int bank) = 0;
+
+   /** @brief Erase the entire bank to 0xFFFFFFFF
+    * @param bank 0 or 1
+    */
+   virtual void EraseBank(int bank) = 0;
+
+   /** @brief Program one word
+    * @pre word must be erased
+    * @param bank 0 or 1
+    * @param offset word offset from start of bank
+    * @param data value to be programmed
+    */
+   virtual void ProgramWord(int bank, uint32_t offset, uint32_t data) = 0;
+
+   /** @brief Start erasing a bank without waiting for completion
+    * @param bank 0 or 1
+    */
+   virtual void StartErase(int bank) { EraseBank(bank); }
+
+   /** @return true while an erase started by StartErase() is in progress */
+   virtual bool IsBusy() { return false; }
+};
+
+#endif // FLASHBANKS_H
@@ -0,0 +1,100 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAM_JOURNAL_H
+#define PARAM_JOURNAL_H
+
+#include "params.h"
+#include "flashbanks.h"
+
+/** @brief Log structured parameter storage
+ * Saving appends a record for every parameter that differs from the stored
+ * state instead of rewriting the whole page. When the active bank runs out
+ * of space the current state is compacted into the other bank, which then
+ * becomes active. Each bank starts with a header holding a magic number and
+ * a sequence number, the bank with the higher sequence number is active.
+ * A save can be split into steps that program a bounded number of words.
+ */
+#define JOURNAL_DIRTY_WORDS ((Param::PARAM_LAST + 31) / 32)
+
+class ParamJournal
+{
+public:
+   /** @param flash two banks reserved for parameter storage */
+   constexpr ParamJournal(IFlashBanks* flash)
+      : flash(flash), activeBank(NO_BANK), nextSlot(0), sequence(0), state(SAVE_IDLE), writeBank(NO_BANK),
+        writeSlot(0), nextParam(0), pendingRecords(0), records(0), recordKey(0), dirty() {}
+
+   /** @brief Load parameters from the active bank
+    * @retval 0 Parameters loaded successfully
+    * @retval -1 No valid bank found, parameters not loaded
+    */
+   int Load();
+
+   /** @brief Append changed parameters, compact into other bank if necessary
+    * Blocks until a compaction has erased the other bank.
+    * @return number of records written
+    */
+   int Save();
+
+   /** @brief Find the changed parameters for SaveStep()
+    * If they do not fit the active bank, the steps compact all parameters
+    * into the other bank. Nothing is programmed or erased here.
+    */
+   void SaveStart();
+
+   /** @brief Program at most maxWords words of the save started by SaveStart()
+    * The first step of a compaction starts erasing the other bank, the
+    * following steps only poll it until it is done. Parameters stay usable
+    * in between steps, each record holds the value at the time it is written.
+    * @return number of words still to be programmed, at least 1 while erasing, 0 when done
+    */
+   int SaveStep(int maxWords);
+
+   /** @return number of records written by the last save */
+   int GetSavedRecords() { return records; }
+
+   /** @return true while the erase of a compaction is running */
+   bool IsBusy();
+
+   /** @return number of records that can be appended before compacting */
+   int GetFreeRecords();
+
+private:
+   enum { NO_BANK = -1 };
+   enum SaveState { SAVE_IDLE, SAVE_ERASE, SAVE_ERASING, SAVE_VALUE, SAVE_KEY, SAVE_SEQUENCE, SAVE_MAGIC };
+
+   void FindActiveBank();
+   bool IsStored(int idx);
+   static uint8_t RecordCheck(uint32_t key, uint32_t value);
+
+   IFlashBanks* flash;
+   int activeBank;
+   uint32_t nextSlot;
+   uint32_t sequence;
+   SaveState state;
+   int writeBank; //bank the records go to, the other one for a compaction
+   uint32_t writeSlot;
+   int nextParam; //index of the next parameter to check for a record
+   int pendingRecords;
+   int records;
+   uint32_t recordKey; //key word of the record whose value was programmed last
+   uint32_t dirty[JOURNAL_DIRTY_WORDS]; //parameters still to be written
+};
+
+#endif // PARAM_JOURNAL_H
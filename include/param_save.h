@@ -19,16 +19,27 @@
 #ifndef PARAM_SAVE_H_INCLUDED
 #define PARAM_SAVE_H_INCLUDED
 
+#define PARAM_SAVE_ERR_FULL -1
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
 uint32_t parm_save(void);
+void parm_save_start(void);
+int parm_save_step(int maxWords);
 int parm_load(void);
+int parm_active_bank(void);
+int parm_save_bank(void);
 
 #ifdef __cplusplus
 }
+
+class IFlashBanks;
+IFlashBanks* parm_get_flash(void);
+void parm_set_flash(IFlashBanks* flash);
+void parm_set_journal_flash(IFlashBanks* flash);
 #endif
 
 #endif // PARAM_SAVE_H_INCLUDED
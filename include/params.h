@@ -61,13 +61,26 @@ namespace Param
    } Attributes;
 
    int Set(PARAM_NUM ParamNum, s32fp ParamVal);
+   void BeginBatch();
+   int AddToBatch(PARAM_NUM ParamNum, s32fp ParamVal);
+   int CommitBatch();
+   void AbortBatch();
+   void SetDeferredChange(bool deferred);
+   void ProcessChanges();
    s32fp  Get(PARAM_NUM ParamNum);
    int    GetInt(PARAM_NUM ParamNum);
    float  GetFloat(PARAM_NUM ParamNum);
+   int32_t GetScaled(PARAM_NUM ParamNum, int32_t gain, int fracBits, int32_t offset);
    bool   GetBool(PARAM_NUM ParamNum);
    void   SetInt(PARAM_NUM ParamNum, int ParamVal);
    void   SetFixed(PARAM_NUM ParamNum, s32fp ParamVal);
    void   SetFloat(PARAM_NUM ParamNum, float ParamVal);
+   int    SetScaled(PARAM_NUM ParamNum, s32fp ParamVal, int32_t gain, int fracBits);
+   uint32_t GetGeneration();
+   PARAM_NUM NextChanged(int start, uint32_t since);
+   void BeginUpdate();
+   void EndUpdate();
+   int Snapshot(const PARAM_NUM *params, s32fp *vals, int count);
    PARAM_NUM NumFromString(const char *name);
    PARAM_NUM NumFromId(uint32_t id);
    const Attributes *GetAttrib(PARAM_NUM ParamNum);
@@ -81,5 +94,7 @@ namespace Param
 
 //User defined callback
 extern void parm_Change(Param::PARAM_NUM ParamNum);
+//User defined callback for Param::CommitBatch(), default calls parm_Change() for each parameter
+extern void parm_ChangeBatch(const Param::PARAM_NUM *params, int count);
 
 #endif //PARAM_H_INCLUDED
@@ -26,6 +26,8 @@
 #define CAN_ERR_INVALID_LEN -3
 #define CAN_ERR_MAXMESSAGES -4
 #define CAN_ERR_MAXITEMS -5
+#define CAN_ERR_INVALID_TIMING -6
+#define CAN_ERR_SAVING -7
 
 class CANIDMAP;
 class SENDBUFFER;
@@ -38,14 +40,48 @@ class SENDBUFFER;
 #define MAX_MESSAGES 10
 #endif // MAX_MESSAGES
 
+#if MAX_MESSAGES > 255
+#error receive hash index holds 8 bit map indexes
+#endif
+
+//Receive hash table size, keeps the load factor at or below 50%
+#define RECV_HASH_BITS (MAX_MESSAGES <= 8 ? 4 : MAX_MESSAGES <= 16 ? 5 : MAX_MESSAGES <= 32 ? 6 : \
+                        MAX_MESSAGES <= 64 ? 7 : MAX_MESSAGES <= 128 ? 8 : 9)
+#define RECV_HASH_SIZE (1 << RECV_HASH_BITS)
+
 #ifndef SENDBUFFER_LEN
 #define SENDBUFFER_LEN 20
 #endif // SENDBUFFER_LEN
 
+//One slot stays empty to tell a full ring from an empty one
+#define SENDBUFFER_SLOTS (SENDBUFFER_LEN + 1)
+
+//NVIC priority of the CAN interrupts, the upper 4 bits are implemented
+#ifndef CAN_IRQ_PRIORITY
+#define CAN_IRQ_PRIORITY (0xf << 4) //lowest priority
+#endif // CAN_IRQ_PRIORITY
+
+//Highest priority of the interrupts that call Send(), masked while it queues.
+//Raise it if tasks at a higher priority than the CAN interrupts send frames.
+#ifndef CAN_SEND_PRIORITY
+#define CAN_SEND_PRIORITY CAN_IRQ_PRIORITY
+#endif // CAN_SEND_PRIORITY
+
+#ifndef RECVBUFFER_LEN
+#define RECVBUFFER_LEN 16
+#endif // RECVBUFFER_LEN
+
+#define RECVBUFFER_SLOTS (RECVBUFFER_LEN + 1)
+
 #ifndef MAX_USER_MESSAGES
 #define MAX_USER_MESSAGES 10
 #endif // MAX_USER_MESSAGES
 
+//SDO, user and receive ids the filters are configured for
+#define FILTER_IDS (1 + MAX_USER_MESSAGES + MAX_MESSAGES)
+//Filter match indexes per FIFO, filter banks with up to 4 ids alternate between FIFOs
+#define FMI_ENTRIES (((FILTER_IDS + 7) / 8) * 4)
+
 class Can
 {
 public:
@@ -55,22 +91,35 @@ public:
    };
 
    Can(uint32_t baseAddr, enum baudrates baudrate, bool remap=false);
-   void Clear(void);
+   int Clear(void);
    void SetBaudrate(enum baudrates baudrate);
    void Send(uint32_t canId, uint32_t data[2]) { Send(canId, data, 8); }
    void Send(uint32_t canId, uint32_t data[2], uint8_t len);
    void SendAll();
    void SDOWrite(uint8_t remoteNodeId, uint16_t index, uint8_t subIndex, uint32_t data);
    void Save();
+   void SaveStart();
+   int SaveStep(int maxWords);
+   bool IsSaved();
+   bool IsLoaded();
    void SetReceiveCallback(void (*recv)(uint32_t, uint32_t*));
    bool RegisterUserMessage(int canId);
    uint32_t GetLastRxTimestamp();
+   void SetHighPriorityIdLimit(uint32_t idLimit);
+   uint32_t GetSendDrops();
+   uint32_t GetSendHighWater();
+   void SetDeferredRx(bool deferred);
+   void ProcessRx();
+   uint32_t GetRecvDrops();
+   uint32_t GetRecvHighWater();
    int AddSend(Param::PARAM_NUM param, int canId, int offsetBits, int length, float gain);
    int AddRecv(Param::PARAM_NUM param, int canId, int offsetBits, int length, float gain);
    int AddSend(Param::PARAM_NUM param, int canId, int offsetBits, int length, float gain, int16_t offset);
    int AddRecv(Param::PARAM_NUM param, int canId, int offsetBits, int length, float gain, int16_t offset);
    int Remove(Param::PARAM_NUM param);
    bool FindMap(Param::PARAM_NUM param, int& canId, int& offset, int& length, float& gain, bool& rx);
+   int SetSendTiming(uint32_t canId, int period, int phase, int minGap);
+   bool GetSendTiming(uint32_t canId, int& period, int& phase, int& minGap);
    void IterateCanMap(void (*callback)(Param::PARAM_NUM, int, int, int, float, bool));
    void HandleRx(int fifo);
    void HandleTx();
@@ -78,15 +127,42 @@ public:
    static Can* GetInterface(int index);
 
 private:
-   static volatile bool isSaving;
-
    struct CANPOS
    {
       uint16_t mapParam;
       int16_t offset;
-      float gain;
+      union
+      {
+         float gain; //In flash
+         int32_t fixedGain; //In RAM, scaled by 2^gainDigits
+      };
       uint8_t offsetBits;
       int8_t numBits;
+      uint8_t gainDigits; //Always 0 in flash
+   };
+
+   enum rxhandlers
+   {
+      RX_NONE, RX_SDO, RX_USER, RX_MAP
+   };
+
+   struct FMIENTRY
+   {
+      uint16_t id;
+      uint16_t handler; //rxhandlers, RX_MAP + receive map index for mapped ids
+   };
+
+   enum filtertypes
+   {
+      STD_LIST, STD_MASK, EXT_LIST, EXT_MASK, FILTER_TYPES
+   };
+
+   struct CANFILTER
+   {
+      uint32_t id;
+      uint32_t mask; //all bits of the id set for a single id
+      uint16_t handler;
+      bool extended;
    };
 
    struct CANIDMAP
@@ -95,6 +171,20 @@ private:
       CANPOS items[MAX_ITEMS_PER_MESSAGE];
    };
 
+   struct CANSCHED //Transmit timing of a send map, counted in SendAll() calls
+   {
+      uint16_t period; //0: only on change, 1: on every call
+      uint16_t phase;
+      uint16_t minGap; //0: do not send on change
+      uint16_t reserved;
+   };
+
+   struct CANSENDSTATE
+   {
+      uint64_t lastFrame;
+      uint16_t callsSinceSent;
+   };
+
    struct SENDBUFFER
    {
       uint32_t id;
@@ -102,30 +192,97 @@ private:
       uint32_t data[2];
    };
 
+   struct SENDQUEUE
+   {
+      SENDBUFFER frames[SENDBUFFER_SLOTS];
+      volatile uint32_t head; //written by Send() only
+      volatile uint32_t tail; //written by HandleTx() only
+      uint32_t drops;
+      uint32_t highWater;
+   };
+
+   struct RECVBUFFER
+   {
+      uint32_t id;
+      uint32_t data[2];
+      uint8_t len;
+      uint8_t fifo;
+      uint8_t fmi;
+      uint8_t ext;
+   };
+
+   struct RECVQUEUE
+   {
+      RECVBUFFER frames[RECVBUFFER_SLOTS];
+      volatile uint32_t head; //written by HandleRx() only
+      volatile uint32_t tail; //written by ProcessRx() only
+      uint32_t drops;
+      uint32_t highWater;
+   };
+
    CANIDMAP canSendMap[MAX_MESSAGES];
    CANIDMAP canRecvMap[MAX_MESSAGES];
+   CANSCHED canSendSched[MAX_MESSAGES]; //same index as canSendMap
+   CANSENDSTATE canSendState[MAX_MESSAGES];
+   uint32_t sendAllCount;
+   uint8_t recvHash[RECV_HASH_SIZE]; //canRecvMap index + 1, 0 is empty
+   FMIENTRY fmiTable[2][FMI_ENTRIES];
+   uint8_t fmiCount[2];
+   uint8_t filterBanks;
+   CANFILTER filterList[FILTER_IDS]; //only used by ConfigureFilters()
    uint32_t lastRxTimestamp;
-   SENDBUFFER sendBuffer[SENDBUFFER_LEN];
-   int sendCnt;
+   SENDQUEUE sendQueues[2]; //high and normal priority
+   uint32_t highPriorityIdLimit;
+   RECVQUEUE recvQueue;
+   bool deferredRx;
    void (*recvCallback)(uint32_t, uint32_t*);
-   uint16_t userIds[MAX_USER_MESSAGES];
+   uint32_t userIds[MAX_USER_MESSAGES];
    int nextUserMessageIndex;
    uint32_t canDev;
    uint8_t nodeId;
+   int saveBank;
+   uint32_t saveIdx;
+   uint32_t saveWords;
+   int saveMsg;
+   uint32_t saveRecordWord;
+   bool isSaving; //between SaveStart() and the last SaveStep(), the map must not change
+   bool isLoaded; //map loaded from flash by the constructor
 
    void ProcessSDO(uint32_t data[2]);
    void ClearMap(CANIDMAP *canMap);
    int RemoveFromMap(CANIDMAP *canMap, Param::PARAM_NUM param);
+   void RemoveSched(Param::PARAM_NUM param);
+   void ResetSched(int start);
    int Add(CANIDMAP *canMap, Param::PARAM_NUM param, int canId, int offsetBits, int length, float gain, int16_t offset);
-   uint32_t SaveToFlash(uint32_t baseAddress, uint32_t* data, int len);
    int LoadFromFlash();
+   int LoadCompact(const uint32_t* data);
+   void LoadLegacyMap(const uint32_t* data, CANIDMAP *canMap);
+   static uint32_t CalcCompactCrc(const uint32_t* data);
+   uint32_t CompactWords();
+   uint32_t RecordWords(CANIDMAP *map);
+   uint32_t GetRecordWord(CANIDMAP *map, uint32_t idx);
+   uint32_t NextRecordWord();
    CANIDMAP *FindById(CANIDMAP *canMap, uint32_t canId);
+   CANIDMAP *FindRecvMap(uint32_t canId);
+   void BuildRecvHash();
+   static uint32_t HashId(uint32_t canId);
    int CopyIdMapExcept(CANIDMAP *source, CANIDMAP *dest, Param::PARAM_NUM param);
-   void ReplaceParamEnumByUid(CANIDMAP *canMap);
-   void ReplaceParamUidByEnum(CANIDMAP *canMap);
+   void ConvertLoadedMap(CANIDMAP *canMap);
+   static void SetGain(CANPOS *pos, float gain);
+   static float GetGain(const CANPOS *pos);
+   bool QueuesEmpty();
+   void DispatchRx(int fifo, uint8_t fmi, uint32_t id, bool ext, uint8_t length, uint32_t* data);
+   bool Transmit(uint32_t canId, uint32_t* data, uint8_t len, bool highPriority);
    void ConfigureFilters();
-   void SetFilterBank(int& idIndex, int& filterId, uint16_t* idList);
-   uint32_t GetFlashAddress();
+   void SetFilterBank(int& filterId, int type, const CANFILTER* filters, int count);
+   static void AddFilter(CANFILTER* filters, int& count, uint32_t canId, uint16_t handler);
+   static int GetFilterType(const CANFILTER& filter);
+   static int CountFilterBanks(const CANFILTER* filters, int count);
+   static bool MergeFilters(CANFILTER* filters, int& count);
+   static uint32_t AcceptedIds(const CANFILTER& filter);
+   int GetHandler(int fifo, uint8_t fmi, uint32_t canId);
+   uint32_t GetFlashOffset();
+   static uint32_t GetItemWord(const CANPOS *pos, uint32_t idx);
 
    static Can* interfaces[];
 };
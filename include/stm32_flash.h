@@ -0,0 +1,48 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STM32_FLASH_H
+#define STM32_FLASH_H
+
+#include "flashbanks.h"
+
+/** @brief Two STM32F4 flash sectors of equal size used as flash banks */
+class Stm32Flash: public IFlashBanks
+{
+public:
+   /** @param address0 start address of first sector
+    * @param sector0 sector number of first sector
+    * @param address1 start address of second sector
+    * @param sector1 sector number of second sector
+    * @param size size of each sector in bytes
+    */
+   Stm32Flash(uint32_t address0, uint8_t sector0, uint32_t address1, uint8_t sector1, uint32_t size);
+   uint32_t GetBankSize() { return size; }
+   const uint32_t* GetBank(int bank) { return (const uint32_t*)(uintptr_t)addresses[bank]; }
+   void EraseBank(int bank);
+   void ProgramWord(int bank, uint32_t offset, uint32_t data);
+   void StartErase(int bank);
+   bool IsBusy();
+
+private:
+   uint32_t addresses[2];
+   uint8_t sectors[2];
+   uint32_t size;
+};
+
+#endif // STM32_FLASH_H
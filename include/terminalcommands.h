@@ -28,15 +28,19 @@ class TerminalCommands
       static void ParamFlag(Terminal* term, char *arg);
       static void ParamStream(Terminal* term, char *arg);
       static void PrintParamsJson(Terminal* term, char *arg);
+      static void PrintChangedJson(Terminal* term, char *arg);
       static void MapCan(Can* can, Terminal* term, char *arg);
       static void SaveParameters(Terminal* term, char *arg);
+      static void SaveParametersBackground(Terminal* term, char *arg);
       static void LoadParameters(Terminal* term, char *arg);
       static void Reset(Terminal* term, char *arg);
 
    protected:
 
    private:
+      static void ParamSetMany(Terminal* term, char* arg);
       static void PrintCanMap(Param::PARAM_NUM param, int canid, int offset, int length, float gain, bool rx);
+      static void MapCanTiming(Can* can, Terminal* term, char *arg);
 };
 
 #endif // TERMINALCOMMANDS_H
@@ -0,0 +1,145 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "configsave.h"
+#include "param_save.h"
+#include "flashbanks.h"
+#include "stm32_can.h"
+
+volatile ConfigSave::SaveState ConfigSave::state = IDLE;
+int ConfigSave::totalWords;
+bool ConfigSave::saveMaps;
+bool ConfigSave::failed;
+
+/** \brief Start a background save
+ * \return false if a save is already in progress or the parameters do not
+ * fit the page, HasFailed() tells the latter. Nothing is erased then.
+ */
+bool ConfigSave::Start()
+{
+   if (state != IDLE) return false;
+
+   failed = false;
+
+   //Latch the save bank before erasing it, it is not looked up afterwards
+   parm_save_start();
+
+   if (parm_save_step(0) == PARAM_SAVE_ERR_FULL)
+   {
+      failed = true;
+      return false;
+   }
+
+#ifdef PARAM_SAVE_JOURNAL
+   //The parameters go to the journal, the sector only needs erasing for changed CAN maps
+   saveMaps = !CanMapsSaved();
+#else
+   saveMaps = true;
+#endif // PARAM_SAVE_JOURNAL
+
+   if (!saveMaps)
+   {
+      totalWords = RemainingWords();
+      state = PARAMS;
+      return true;
+   }
+
+   for (int i = 0; i < 2; i++)
+   {
+      if (Can::GetInterface(i) != 0)
+         Can::GetInterface(i)->SaveStart();
+   }
+
+   totalWords = RemainingWords();
+   parm_get_flash()->StartErase(parm_save_bank());
+   state = ERASE;
+
+   return true;
+}
+
+/** \return true if the save bank already holds the CAN maps of all interfaces */
+bool ConfigSave::CanMapsSaved()
+{
+   for (int i = 0; i < 2; i++)
+   {
+      if (Can::GetInterface(i) != 0 && !Can::GetInterface(i)->IsSaved())
+         return false;
+   }
+   return true;
+}
+
+/** \brief Advance the background save, call periodically e.g. from the 100ms task
+ * \param maxWords maximum number of flash words to program in this call
+ */
+void ConfigSave::Run(int maxWords)
+{
+   Can* can1 = Can::GetInterface(0);
+   Can* can2 = Can::GetInterface(1);
+   int words;
+
+   switch (state)
+   {
+   case IDLE:
+      break;
+   case ERASE:
+      if (!parm_get_flash()->IsBusy())
+         state = CAN1MAP;
+      break;
+   case CAN1MAP:
+      if (can1 == 0 || can1->SaveStep(maxWords) == 0)
+         state = CAN2MAP;
+      break;
+   case CAN2MAP:
+      if (can2 == 0 || can2->SaveStep(maxWords) == 0)
+         state = PARAMS;
+      break;
+   case PARAMS:
+      words = parm_save_step(maxWords);
+
+      //Parameters that do not fit the page end the save, HasFailed() reports it
+      if (words <= 0)
+      {
+         failed = words == PARAM_SAVE_ERR_FULL;
+         state = IDLE;
+      }
+      break;
+   }
+}
+
+/** \brief Get progress of the running save
+ * \return percentage of words programmed, 100 when no save is running
+ */
+int ConfigSave::GetProgress()
+{
+   if (state == IDLE || totalWords == 0) return 100;
+
+   return (totalWords - RemainingWords()) * 100 / totalWords;
+}
+
+int ConfigSave::RemainingWords()
+{
+   int words = parm_save_step(0);
+
+   for (int i = 0; i < 2 && saveMaps; i++)
+   {
+      if (Can::GetInterface(i) != 0)
+         words += Can::GetInterface(i)->SaveStep(0);
+   }
+
+   return words;
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "crc32.h"
+
+#define CRC32_POLY 0x04C11DB7
+
+/* Shift the CRC register by n bits with zero input */
+static constexpr uint32_t Shift(uint32_t crc, int n)
+{
+   return n == 0 ? crc : Shift(crc & 0x80000000 ? (crc << 1) ^ CRC32_POLY : crc << 1, n - 1);
+}
+
+/* Entry b of table k is the CRC of byte b followed by k zero bytes */
+#define E(b) Shift((uint32_t)(b) << 24, 8 * (TABLE + 1))
+#define B4(b) E(b), E(b + 1), E(b + 2), E(b + 3)
+#define B16(b) B4(b), B4(b + 4), B4(b + 8), B4(b + 12)
+#define B64(b) B16(b), B16(b + 16), B16(b + 32), B16(b + 48)
+#define B256 B64(0), B64(64), B64(128), B64(192)
+
+#ifdef CRC32_SLICE_BY_8
+#define NUM_TABLES 8
+#else
+#define NUM_TABLES 1
+#endif // CRC32_SLICE_BY_8
+
+static const uint32_t crc32_table[NUM_TABLES][256] =
+{
+#define TABLE 0
+   { B256 },
+#undef TABLE
+#ifdef CRC32_SLICE_BY_8
+#define TABLE 1
+   { B256 },
+#undef TABLE
+#define TABLE 2
+   { B256 },
+#undef TABLE
+#define TABLE 3
+   { B256 },
+#undef TABLE
+#define TABLE 4
+   { B256 },
+#undef TABLE
+#define TABLE 5
+   { B256 },
+#undef TABLE
+#define TABLE 6
+   { B256 },
+#undef TABLE
+#define TABLE 7
+   { B256 },
+#undef TABLE
+#endif // CRC32_SLICE_BY_8
+};
+
+uint32_t crc32(uint32_t input, uint32_t crc)
+{
+   crc ^= input;
+
+#ifdef CRC32_SLICE_BY_8
+   return crc32_table[3][crc >> 24] ^ crc32_table[2][(crc >> 16) & 0xFF] ^
+          crc32_table[1][(crc >> 8) & 0xFF] ^ crc32_table[0][crc & 0xFF];
+#else
+   for (int i = 0; i < 4; i++)
+      crc = (crc << 8) ^ crc32_table[0][crc >> 24];
+
+   return crc;
+#endif // CRC32_SLICE_BY_8
+}
+
+uint32_t crc32(const uint32_t* p, uint32_t len, uint32_t crc)
+{
+#ifdef CRC32_SLICE_BY_8
+   for (; len >= 2; len -= 2, p += 2)
+   {
+      uint32_t first = crc ^ p[0];
+      uint32_t second = p[1];
+
+      crc = crc32_table[7][first >> 24] ^ crc32_table[6][(first >> 16) & 0xFF] ^
+            crc32_table[5][(first >> 8) & 0xFF] ^ crc32_table[4][first & 0xFF] ^
+            crc32_table[3][second >> 24] ^ crc32_table[2][(second >> 16) & 0xFF] ^
+            crc32_table[1][(second >> 8) & 0xFF] ^ crc32_table[0][second & 0xFF];
+   }
+#endif // CRC32_SLICE_BY_8
+
+   while (len--)
+      crc = crc32(*p++, crc);
+
+   return crc;
+}
@@ -72,3 +72,59 @@ enum
  * the required lookup table automagically at compile time.
  */
 const uint8_t crc_table[256] = { 0, CRCTAB6() CRC(0x80), CRCTAB6(^CRC(0x80)) };
+
+#ifdef CRC8_SLICE_BY_4
+/*
+ * Slice-by-4 tables: crc_tableN[x] is the CRC of byte x followed by N zero
+ * bytes, i.e. crc_table applied N more times. As the CRC is linear these are
+ * built the same way as crc_table, from the CRC of each bit. CRC8B(b) is the
+ * CRC of a single byte b and the CRC prefix is redefined for every table.
+ */
+#define CRC8B(b) CRC1B(CRC1B(CRC1B(CRC1B(CRC1B(CRC1B(CRC1B(CRC1B(b))))))))
+#define CRCN(n, prev) \
+    CRC##n##_0x01 = CRC8B(prev##0x01), \
+    CRC##n##_0x02 = CRC8B(prev##0x02), \
+    CRC##n##_0x04 = CRC8B(prev##0x04), \
+    CRC##n##_0x08 = CRC8B(prev##0x08), \
+    CRC##n##_0x10 = CRC8B(prev##0x10), \
+    CRC##n##_0x20 = CRC8B(prev##0x20), \
+    CRC##n##_0x40 = CRC8B(prev##0x40), \
+    CRC##n##_0x80 = CRC8B(prev##0x80), \
+    CRC##n##_0x03 = CRC##n##_0x02 ^ CRC##n##_0x01
+
+enum
+{
+    CRCN(1, CRC_),
+    CRCN(2, CRC1_),
+    CRCN(3, CRC2_)
+};
+
+#undef CRC
+#define CRC(b) CRC1_##b
+static const uint8_t crc_table1[256] = { 0, CRCTAB6() CRC(0x80), CRCTAB6(^CRC(0x80)) };
+
+#undef CRC
+#define CRC(b) CRC2_##b
+static const uint8_t crc_table2[256] = { 0, CRCTAB6() CRC(0x80), CRCTAB6(^CRC(0x80)) };
+
+#undef CRC
+#define CRC(b) CRC3_##b
+static const uint8_t crc_table3[256] = { 0, CRCTAB6() CRC(0x80), CRCTAB6(^CRC(0x80)) };
+#endif // CRC8_SLICE_BY_4
+
+uint8_t crc8(const uint8_t* p, uint8_t len, uint8_t crc)
+{
+#ifdef CRC8_SLICE_BY_4
+    for (; len >= 4; len -= 4, p += 4)
+    {
+        crc = crc_table3[crc ^ p[0]] ^ crc_table2[p[1]] ^ crc_table1[p[2]] ^ crc_table[p[3]];
+    }
+#endif // CRC8_SLICE_BY_4
+
+    while (len--)
+    {
+        crc = crc_table[crc ^ *p++];
+    }
+
+    return crc;
+}
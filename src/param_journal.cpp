@@ -0,0 +1,276 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "param_journal.h"
+#include "crc8.h"
+#include "my_math.h"
+
+#define JOURNAL_MAGIC      0x4C4E524A //"JRNL"
+#define HEADER_WORDS       2
+#define RECORD_WORDS       2
+#define ERASED             0xFFFFFFFF
+#define NUM_SLOTS          ((flash->GetBankSize() / sizeof(uint32_t) - HEADER_WORDS) / RECORD_WORDS)
+#define RECORD(b, s)       (flash->GetBank(b) + HEADER_WORDS + (s) * RECORD_WORDS)
+
+/* A record consists of two words:
+ * - word 0: bits 0-15 unique parameter id, bits 16-23 flags, bits 24-31 CRC8 over id, flags and value
+ * - word 1: fixed point value
+ * The value is programmed before the key word, so a record torn by a power
+ * loss never has a valid key word and is skipped when loading.
+ */
+#define RECORD_KEY(w)      ((w) & 0xFFFF)
+#define RECORD_FLAGS(w)    (((w) >> 16) & 0xFF)
+#define RECORD_CHECK(w)    ((w) >> 24)
+#define RECORD_KEYFLAGS(w) ((w) & 0xFFFFFF)
+
+int ParamJournal::Load()
+{
+   FindActiveBank();
+
+   if (activeBank == NO_BANK)
+      return -1;
+
+   //Later records of the same parameter simply overwrite earlier ones
+   for (uint32_t slot = 0; slot < nextSlot; slot++)
+   {
+      const uint32_t* record = RECORD(activeBank, slot);
+
+      if (RECORD_CHECK(record[0]) == RecordCheck(RECORD_KEYFLAGS(record[0]), record[1]))
+      {
+         Param::PARAM_NUM idx = Param::NumFromId(RECORD_KEY(record[0]));
+
+         if (idx != Param::PARAM_INVALID && RECORD_KEY(record[0]) > 0)
+         {
+            Param::SetFixed(idx, record[1]);
+            Param::SetFlagsRaw(idx, RECORD_FLAGS(record[0]));
+         }
+      }
+   }
+
+   return 0;
+}
+
+int ParamJournal::Save()
+{
+   SaveStart();
+   while (SaveStep(NUM_SLOTS * RECORD_WORDS + HEADER_WORDS) > 0);
+
+   return records;
+}
+
+void ParamJournal::SaveStart()
+{
+   int numDirty = 0;
+
+   records = 0;
+   nextParam = 0;
+
+   for (int word = 0; word < JOURNAL_DIRTY_WORDS; word++)
+      dirty[word] = 0;
+
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      if (IsStored(idx))
+         dirty[idx / 32] |= 1u << (idx % 32);
+   }
+
+   FindActiveBank();
+
+   if (activeBank != NO_BANK)
+   {
+      //Replay the journal, a parameter is clean if its latest record matches its current state
+      for (uint32_t slot = 0; slot < nextSlot; slot++)
+      {
+         const uint32_t* record = RECORD(activeBank, slot);
+
+         if (RECORD_CHECK(record[0]) == RecordCheck(RECORD_KEYFLAGS(record[0]), record[1]))
+         {
+            Param::PARAM_NUM idx = Param::NumFromId(RECORD_KEY(record[0]));
+
+            if (idx == Param::PARAM_INVALID || !Param::IsParam(idx)) continue;
+
+            if ((s32fp)record[1] == Param::Get(idx) && RECORD_FLAGS(record[0]) == Param::GetFlag(idx))
+               dirty[idx / 32] &= ~(1u << (idx % 32));
+            else
+               dirty[idx / 32] |= 1u << (idx % 32);
+         }
+      }
+
+      for (int word = 0; word < JOURNAL_DIRTY_WORDS; word++)
+         numDirty += __builtin_popcount(dirty[word]);
+
+      if ((nextSlot + numDirty) <= NUM_SLOTS)
+      {
+         writeBank = activeBank;
+         writeSlot = nextSlot;
+         pendingRecords = numDirty;
+         state = numDirty > 0 ? SAVE_VALUE : SAVE_IDLE;
+         return;
+      }
+   }
+
+   //Compact the current state of all parameters into the other bank
+   numDirty = 0;
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      if (IsStored(idx))
+      {
+         dirty[idx / 32] |= 1u << (idx % 32);
+         numDirty++;
+      }
+   }
+
+   writeBank = activeBank == 0 ? 1 : 0;
+   writeSlot = 0;
+   pendingRecords = MIN(numDirty, (int)NUM_SLOTS);
+   state = SAVE_ERASE;
+}
+
+int ParamJournal::SaveStep(int maxWords)
+{
+   //A compaction writes to the other bank, an append to the active one
+   bool compacting = writeBank != activeBank;
+
+   if (state == SAVE_ERASE && maxWords > 0)
+   {
+      flash->StartErase(writeBank);
+      state = SAVE_ERASING;
+   }
+
+   if (state == SAVE_ERASING && maxWords > 0 && !flash->IsBusy())
+      state = pendingRecords > 0 ? SAVE_VALUE : SAVE_SEQUENCE;
+
+   for (; maxWords > 0 && state >= SAVE_VALUE; maxWords--)
+   {
+      switch (state)
+      {
+      case SAVE_VALUE:
+      {
+         //The value is programmed before the key word, see the record layout above
+         while ((dirty[nextParam / 32] & (1u << (nextParam % 32))) == 0)
+            nextParam++;
+
+         Param::PARAM_NUM param = (Param::PARAM_NUM)nextParam++;
+         uint32_t keyFlags = Param::GetAttrib(param)->id | ((uint32_t)Param::GetFlag(param) << 16);
+         uint32_t value = Param::Get(param);
+
+         recordKey = keyFlags | ((uint32_t)RecordCheck(keyFlags, value) << 24);
+         flash->ProgramWord(writeBank, HEADER_WORDS + writeSlot * RECORD_WORDS + 1, value);
+         state = SAVE_KEY;
+         break;
+      }
+      case SAVE_KEY:
+         flash->ProgramWord(writeBank, HEADER_WORDS + writeSlot * RECORD_WORDS, recordKey);
+         writeSlot++;
+         records++;
+         pendingRecords--;
+
+         if (!compacting)
+            nextSlot = writeSlot;
+
+         state = pendingRecords > 0 ? SAVE_VALUE : compacting ? SAVE_SEQUENCE : SAVE_IDLE;
+         break;
+      case SAVE_SEQUENCE:
+         //Header goes last, the bank only becomes valid once all records are in place
+         flash->ProgramWord(writeBank, 1, sequence + 1);
+         state = SAVE_MAGIC;
+         break;
+      case SAVE_MAGIC:
+         flash->ProgramWord(writeBank, 0, JOURNAL_MAGIC);
+         activeBank = writeBank;
+         sequence++;
+         nextSlot = writeSlot;
+         state = SAVE_IDLE;
+         break;
+      default:
+         break;
+      }
+   }
+
+   if (state == SAVE_IDLE)
+      return 0;
+
+   int words = pendingRecords * RECORD_WORDS - (state == SAVE_KEY);
+
+   if (compacting)
+      words += state == SAVE_MAGIC ? 1 : HEADER_WORDS;
+
+   return words;
+}
+
+bool ParamJournal::IsBusy()
+{
+   return state == SAVE_ERASING && flash->IsBusy();
+}
+
+int ParamJournal::GetFreeRecords()
+{
+   FindActiveBank();
+
+   if (activeBank == NO_BANK)
+      return 0;
+
+   return NUM_SLOTS - nextSlot;
+}
+
+/** Select valid bank with highest sequence number and find its first free slot */
+void ParamJournal::FindActiveBank()
+{
+   activeBank = NO_BANK;
+   sequence = 0;
+   nextSlot = 0;
+
+   for (int bank = 0; bank < 2; bank++)
+   {
+      const uint32_t* header = flash->GetBank(bank);
+
+      if (header[0] == JOURNAL_MAGIC && header[1] != ERASED && (activeBank == NO_BANK || header[1] > sequence))
+      {
+         activeBank = bank;
+         sequence = header[1];
+      }
+   }
+
+   if (activeBank == NO_BANK) return;
+
+   //A slot is only free if both words are erased, torn records stay skipped
+   for (; nextSlot < NUM_SLOTS; nextSlot++)
+   {
+      const uint32_t* record = RECORD(activeBank, nextSlot);
+
+      if (record[0] == ERASED && record[1] == ERASED)
+         break;
+   }
+}
+
+/** @return true if the parameter is saved, values and id 0 are not */
+bool ParamJournal::IsStored(int idx)
+{
+   return Param::IsParam((Param::PARAM_NUM)idx) && Param::GetAttrib((Param::PARAM_NUM)idx)->id > 0;
+}
+
+uint8_t ParamJournal::RecordCheck(uint32_t keyFlags, uint32_t value)
+{
+   uint8_t data[7] =
+   {
+      (uint8_t)keyFlags, (uint8_t)(keyFlags >> 8), (uint8_t)(keyFlags >> 16),
+      (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)
+   };
+
+   return crc8(data, sizeof(data), 0);
+}
@@ -17,16 +17,61 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <libopencm3/stm32/flash.h>
-#include <libopencm3/stm32/desig.h>
 #include <libopencm3/stm32/crc.h>
 #include "params.h"
 #include "param_save.h"
 #include "hwdefs.h"
-#include "my_string.h"
+#include "stm32_flash.h"
+#ifdef PARAM_SAVE_JOURNAL
+#include "param_journal.h"
+#endif // PARAM_SAVE_JOURNAL
 
 #define NUM_PARAMS ((PARAM_BLKSIZE - 8) / sizeof(PARAM_ENTRY))
 #define PARAM_WORDS (PARAM_BLKSIZE / 4)
+#define PAGE_OFFSET (PARAM_BLKOFFSET / 4)
+#define CRC_WORD (2 * NUM_PARAMS)
+#define SEQUENCE_WORD (CRC_WORD + 1)
+#define SEQUENCE_UNSET 0xFFFFFFFF
+#define ERASED 0xFFFFFFFF
+#define COMPACT_MAGIC 0x31504D43 //"CMP1", can not be a legacy entry as its dummy byte is 0xFF
+#define COMPACT_HEADER_WORDS 4
+#define COMPACT_DATA_BYTES (PARAM_BLKSIZE - 4 * COMPACT_HEADER_WORDS)
+#define MAX_RECORD_BYTES 9 //3 byte key, flags, 5 byte value
+
+#ifndef FLASH_CONF_SECTOR
+#define FLASH_CONF_SECTOR 1
+#endif // FLASH_CONF_SECTOR
+
+#ifndef FLASH_CONF_SIZE
+#define FLASH_CONF_SIZE 16384
+#endif // FLASH_CONF_SIZE
+
+/* Defining PARAM_SAVE_JOURNAL stores the parameters with ParamJournal in two
+ * sectors of their own, FLASH_JOURNAL_BASE/SECTOR and FLASH_JOURNAL_BASE2/SECTOR2
+ * in hwdefs.h. A save then only appends the parameters that changed. The
+ * configuration sector is left to the CAN maps, which have no sequence number
+ * to pick between two banks, so A/B saving is not available. A parameter page
+ * found there is still loaded as long as the journal is empty. */
+#ifdef PARAM_SAVE_JOURNAL
+#if defined(FLASH_CONF_BASE2) || defined(PARAM_SAVE_COMPACT)
+#error PARAM_SAVE_JOURNAL replaces A/B and compact parameter pages
+#endif
+
+#ifndef FLASH_JOURNAL_SIZE
+#define FLASH_JOURNAL_SIZE 16384
+#endif // FLASH_JOURNAL_SIZE
+#endif // PARAM_SAVE_JOURNAL
+
+/* Defining a second configuration sector in hwdefs.h enables A/B saving:
+ * each save goes to the bank that was not loaded from and only becomes
+ * active once its parameter page CRC has been programmed. */
+#ifdef FLASH_CONF_BASE2
+#define NUM_BANKS 2
+#else
+#define NUM_BANKS 1
+#define FLASH_CONF_BASE2 FLASH_CONF_BASE
+#define FLASH_CONF_SECTOR2 FLASH_CONF_SECTOR
+#endif // FLASH_CONF_BASE2
 
 typedef struct
 {
@@ -36,50 +81,470 @@ typedef struct
    uint32_t value;
 } PARAM_ENTRY;
 
+/* Defining PARAM_SAVE_COMPACT saves only parameters that differ from their
+ * default or have flags set. Each record is a varint of id << 1 | hasFlags,
+ * the flags byte if present and a zig-zag varint of the difference to the
+ * previous record's value. Deltas are not taken against the default, so
+ * a firmware with changed defaults still loads the saved values unchanged.
+ * Both formats are always loaded, so enabling it migrates on the next save. */
+typedef struct
+{
+   uint32_t magic;
+   uint32_t sequence;
+   uint32_t length; //of data in bytes
+   uint32_t crc;
+   uint8_t data[COMPACT_DATA_BYTES];
+} COMPACT_PAGE;
+
 typedef struct
 {
    PARAM_ENTRY data[NUM_PARAMS];
    uint32_t crc;
-   uint32_t padding;
+   uint32_t sequence; //Erased on pages written before A/B saving, read as 0
 } PARAM_PAGE;
 
-static uint32_t GetFlashAddress()
+static Stm32Flash stm32Flash(FLASH_CONF_BASE, FLASH_CONF_SECTOR, FLASH_CONF_BASE2, FLASH_CONF_SECTOR2, FLASH_CONF_SIZE);
+static IFlashBanks* flash = &stm32Flash;
+#ifdef PARAM_SAVE_JOURNAL
+static Stm32Flash journalFlash(FLASH_JOURNAL_BASE, FLASH_JOURNAL_SECTOR, FLASH_JOURNAL_BASE2, FLASH_JOURNAL_SECTOR2, FLASH_JOURNAL_SIZE);
+static ParamJournal journal(&journalFlash);
+#endif // PARAM_SAVE_JOURNAL
+static int saveBank;
+static uint32_t saveSequence;
+static uint32_t saveIdx;
+static uint32_t numStored;
+static uint32_t saveBytes;
+static uint32_t saveWord;
+static s32fp lastValue;
+static bool saveFull;
+#ifdef PARAM_SAVE_COMPACT
+static bool sizing;
+//Completed words not yet programmed, at most those of a record
+static struct { uint32_t offset, value; } pending[(MAX_RECORD_BYTES + 3) / 4];
+static int numPending;
+#endif // PARAM_SAVE_COMPACT
+
+static const PARAM_PAGE* GetPage(int bank)
 {
-   return FLASH_CONF_BASE + PARAM_BLKOFFSET;
+   return (const PARAM_PAGE*)(flash->GetBank(bank) + PAGE_OFFSET);
 }
 
-/**
-* Save parameters to flash
-* @pre the flash page/sector needs to be erased prior to calling this function
-* @return CRC of parameter flash page
-*/
-uint32_t parm_save()
+#if !defined(PARAM_SAVE_COMPACT) && !defined(PARAM_SAVE_JOURNAL)
+/** @return word idx of the page being saved, the CRC word is left erased */
+static uint32_t GetPageWord(uint32_t idx)
 {
-   PARAM_PAGE parmPage;
-   uint32_t idx;
-   uint32_t paramAddress = GetFlashAddress();
+   Param::PARAM_NUM param = (Param::PARAM_NUM)(idx / 2);
+
+   if (idx == SEQUENCE_WORD)
+      return saveSequence;
+   if (idx >= CRC_WORD || (uint32_t)param >= numStored)
+      return ERASED;
+   if (idx & 1)
+      return Param::Get(param);
 
+   //key, dummy and flags, the dummy byte stays erased
+   return Param::GetAttrib(param)->id | 0xFF << 16 | (uint32_t)Param::GetFlag(param) << 24;
+}
+#endif
+
+static const COMPACT_PAGE* GetCompact(const PARAM_PAGE* page)
+{
+   const COMPACT_PAGE* compact = (const COMPACT_PAGE*)page;
+   return compact->magic == COMPACT_MAGIC ? compact : 0;
+}
+
+static uint32_t CalcCompactCrc(const COMPACT_PAGE* compact)
+{
    crc_reset();
-   memset32((int*)&parmPage, 0xFFFFFFFF, PARAM_WORDS);
+   crc_calculate_block((uint32_t*)compact, COMPACT_HEADER_WORDS - 1);
+   return crc_calculate_block((uint32_t*)compact->data, (compact->length + 3) / 4);
+}
+
+static bool IsValid(const PARAM_PAGE* page)
+{
+   const COMPACT_PAGE* compact = GetCompact(page);
+
+   if (compact != 0)
+      return compact->length <= COMPACT_DATA_BYTES && CalcCompactCrc(compact) == compact->crc;
+
+   crc_reset();
+   return crc_calculate_block((uint32_t*)page, CRC_WORD) == page->crc;
+}
+
+static uint32_t GetSequence(const PARAM_PAGE* page)
+{
+   if (GetCompact(page) != 0)
+      return GetCompact(page)->sequence;
+   return page->sequence == SEQUENCE_UNSET ? 0 : page->sequence;
+}
+
+#ifndef PARAM_SAVE_JOURNAL
+static uint32_t GetCrc(const PARAM_PAGE* page)
+{
+   return GetCompact(page) != 0 ? GetCompact(page)->crc : page->crc;
+}
+#endif // PARAM_SAVE_JOURNAL
+
+static uint32_t GetVarint(const uint8_t* data, uint32_t& pos, uint32_t end)
+{
+   uint32_t value = 0;
+
+   for (int shift = 0; pos < end && shift < 32; shift += 7)
+   {
+      uint8_t b = data[pos++];
+      value |= (uint32_t)(b & 0x7F) << shift;
+      if ((b & 0x80) == 0) break;
+   }
+
+   return value;
+}
+
+#ifdef PARAM_SAVE_COMPACT
+static int PutVarint(uint8_t* data, uint32_t value)
+{
+   int len = 0;
+
+   for (; value >= 0x80; value >>= 7)
+      data[len++] = (value & 0x7F) | 0x80;
+   data[len++] = value;
+
+   return len;
+}
+
+/** Queue a word of the compact page, CompactSaveStep() programs it */
+static void QueueWord(uint32_t offset, uint32_t value)
+{
+   pending[numPending].offset = offset;
+   pending[numPending].value = value;
+   numPending++;
+}
+
+/** Append a byte to the compact page, queues every completed word unless sizing
+ * @return number of words completed
+ */
+static int PutByte(uint8_t b)
+{
+   int shift = 8 * (saveBytes & 3);
+
+   saveWord = (saveWord & ~(0xFFu << shift)) | (uint32_t)b << shift;
+   saveBytes++;
+
+   if ((saveBytes & 3) == 0)
+   {
+      if (!sizing)
+         QueueWord(PAGE_OFFSET + COMPACT_HEADER_WORDS + saveBytes / 4 - 1, saveWord);
+      saveWord = ERASED;
+      return 1;
+   }
+   return 0;
+}
+
+/** Append the record of one parameter if it needs saving
+ * @return number of words completed, -1 if the record does not fit the page
+ */
+static int PutRecord(Param::PARAM_NUM param)
+{
+   const Param::Attributes* attr = Param::GetAttrib(param);
+   s32fp value = Param::Get(param);
+   uint8_t flags = (uint8_t)Param::GetFlag(param);
+   uint8_t record[MAX_RECORD_BYTES];
+   int len, words = 0;
+
+   if (!Param::IsParam(param) || attr->id == 0 || (value == attr->def && flags == 0))
+      return 0;
+
+   uint32_t delta = (uint32_t)value - (uint32_t)lastValue;
+
+   len = PutVarint(record, attr->id << 1 | (flags != 0));
+   if (flags != 0) record[len++] = flags;
+   len += PutVarint(record + len, (delta << 1) ^ (uint32_t)((int32_t)delta >> 31));
+
+   if (saveBytes + len > COMPACT_DATA_BYTES)
+      return -1;
+
+   for (int i = 0; i < len; i++)
+      words += PutByte(record[i]);
+
+   lastValue = value;
+   return words;
+}
+
+/** Encode all records without programming them
+ * @return true if they fit the page
+ */
+static bool CompactFits()
+{
+   bool fits = true;
+
+   sizing = true;
+   for (int idx = 0; idx < Param::PARAM_LAST && fits; idx++)
+      fits = PutRecord((Param::PARAM_NUM)idx) >= 0;
+   sizing = false;
+
+   saveBytes = 0;
+   saveWord = ERASED;
+   lastValue = 0;
+
+   return fits;
+}
+
+/** saveIdx 0 is the header, then one step per parameter, one for the length
+ * and one for the CRC. Words are queued and programmed as the budget allows,
+ * so a step never programs more than maxWords. When a record does not fit
+ * the save stops, the CRC is never programmed and the page does not become
+ * valid. */
+static int CompactSaveStep(int maxWords)
+{
+   const COMPACT_PAGE* compact = (const COMPACT_PAGE*)GetPage(saveBank);
+
+   if (saveFull)
+      return PARAM_SAVE_ERR_FULL;
+
+   while (maxWords > 0 && saveIdx <= Param::PARAM_LAST + 2)
+   {
+      if (numPending > 0)
+      {
+         flash->ProgramWord(saveBank, pending[0].offset, pending[0].value);
+         numPending--;
+         maxWords--;
+
+         for (int i = 0; i < numPending; i++)
+            pending[i] = pending[i + 1];
+      }
+      else if (saveIdx == 0)
+      {
+         QueueWord(PAGE_OFFSET, COMPACT_MAGIC);
+         QueueWord(PAGE_OFFSET + 1, saveSequence);
+         saveIdx++;
+      }
+      else if (saveIdx <= Param::PARAM_LAST)
+      {
+         int words = PutRecord((Param::PARAM_NUM)(saveIdx - 1));
+
+         if (words < 0)
+         {
+            saveFull = true;
+            return PARAM_SAVE_ERR_FULL;
+         }
 
-   //Copy parameter values and keys to block structure
-   for (idx = 0; Param::IsParam((Param::PARAM_NUM)idx) && idx < NUM_PARAMS; idx++)
+         //Every parameter takes at least one unit so the time per call is bounded
+         if (words == 0)
+            maxWords--;
+         saveIdx++;
+      }
+      else if (saveIdx == Param::PARAM_LAST + 1)
+      {
+         if ((saveBytes & 3) != 0)
+            QueueWord(PAGE_OFFSET + COMPACT_HEADER_WORDS + saveBytes / 4, saveWord);
+
+         QueueWord(PAGE_OFFSET + 2, saveBytes);
+         saveIdx++;
+      }
+      else
+      {
+         //All other words are programmed, the CRC covers them
+         flash->ProgramWord(saveBank, PAGE_OFFSET + 3, CalcCompactCrc(compact));
+         saveIdx++;
+         maxWords--;
+      }
+   }
+
+   return Param::PARAM_LAST + 3 - saveIdx + numPending;
+}
+
+#endif // PARAM_SAVE_COMPACT
+
+static void LoadCompact(const COMPACT_PAGE* compact)
+{
+   uint32_t pos = 0;
+   s32fp value = 0;
+
+   //Parameters without a record are at their default
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
    {
-      const Param::Attributes *pAtr = Param::GetAttrib((Param::PARAM_NUM)idx);
-      parmPage.data[idx].flags = (uint8_t)Param::GetFlag((Param::PARAM_NUM)idx);
-      parmPage.data[idx].key = pAtr->id;
-      parmPage.data[idx].value = Param::Get((Param::PARAM_NUM)idx);
+      if (Param::IsParam((Param::PARAM_NUM)idx))
+      {
+         Param::SetFixed((Param::PARAM_NUM)idx, Param::GetAttrib((Param::PARAM_NUM)idx)->def);
+         Param::SetFlagsRaw((Param::PARAM_NUM)idx, 0);
+      }
    }
 
-   parmPage.crc = crc_calculate_block(((uint32_t*)&parmPage), (2 * NUM_PARAMS));
+   while (pos < compact->length)
+   {
+      uint32_t key = GetVarint(compact->data, pos, compact->length);
+      uint8_t flags = (key & 1) && pos < compact->length ? compact->data[pos++] : 0;
+      uint32_t delta = GetVarint(compact->data, pos, compact->length);
+      Param::PARAM_NUM idx = Param::NumFromId(key >> 1);
+
+      value = (uint32_t)value + ((delta >> 1) ^ (0 - (delta & 1)));
 
-   for (idx = 0; idx < PARAM_WORDS; idx++)
+      if (idx != Param::PARAM_INVALID && (key >> 1) > 0)
+      {
+         Param::SetFixed(idx, value);
+         Param::SetFlagsRaw(idx, flags);
+      }
+   }
+}
+
+/**
+* Find the bank holding the most recently saved configuration
+*
+* @return bank number, -1 if no bank holds a valid parameter page
+*/
+int parm_active_bank()
+{
+   int active = -1;
+   uint32_t sequence = 0;
+
+   for (int bank = 0; bank < NUM_BANKS; bank++)
    {
-      uint32_t* pData = ((uint32_t*)&parmPage) + idx;
-      flash_program_word(paramAddress + idx * sizeof(uint32_t), *pData);
+      const PARAM_PAGE* page = GetPage(bank);
+
+      if (IsValid(page) && (active < 0 || GetSequence(page) > sequence))
+      {
+         active = bank;
+         sequence = GetSequence(page);
+      }
    }
 
-   return parmPage.crc;
+   return active;
+}
+
+/**
+* Find the bank the next save must go to, the CAN map is saved there as well
+*
+* @return bank number, always 0 without A/B saving
+*/
+int parm_save_bank()
+{
+   return NUM_BANKS > 1 && parm_active_bank() == 0 ? 1 : 0;
+}
+
+/** @return flash banks holding configuration data */
+IFlashBanks* parm_get_flash()
+{
+   return flash;
+}
+
+/**
+* Replace the STM32 flash driver, e.g. by a RAM backed one on a host
+*
+* @param newFlash flash banks that hold the CAN map and parameter pages
+*/
+void parm_set_flash(IFlashBanks* newFlash)
+{
+   flash = newFlash;
+}
+
+#ifdef PARAM_SAVE_JOURNAL
+/**
+* Replace the STM32 flash driver of the parameter journal
+*
+* @param newFlash flash banks reserved for the journal
+*/
+void parm_set_journal_flash(IFlashBanks* newFlash)
+{
+   journal = ParamJournal(newFlash);
+}
+#endif // PARAM_SAVE_JOURNAL
+
+/**
+* Prepare an incremental save to parm_save_bank()
+*
+* The bank and sequence number are latched here, so the active bank must not
+* be looked up again while saving, i.e. while the save bank is being erased.
+* The compact page is sized here as well. If it does not fit, parm_save_step()
+* returns PARAM_SAVE_ERR_FULL right away and the save bank must not be erased.
+*/
+void parm_save_start()
+{
+   int active = parm_active_bank();
+
+   saveBank = NUM_BANKS > 1 && active == 0 ? 1 : 0;
+   saveSequence = active < 0 ? 1 : GetSequence(GetPage(active)) + 1;
+   saveIdx = 0;
+   saveBytes = 0;
+   saveWord = ERASED;
+   lastValue = 0;
+   saveFull = false;
+
+#ifdef PARAM_SAVE_COMPACT
+   numPending = 0;
+   //Find out before anything is erased, parm_save_step(0) reports it
+   saveFull = !CompactFits();
+#endif // PARAM_SAVE_COMPACT
+
+#ifdef PARAM_SAVE_JOURNAL
+   journal.SaveStart();
+#endif // PARAM_SAVE_JOURNAL
+
+   //Only the leading run of parameters is stored, values follow after it
+   for (numStored = 0; numStored < NUM_PARAMS && numStored < Param::PARAM_LAST &&
+        Param::IsParam((Param::PARAM_NUM)numStored); numStored++);
+}
+
+/**
+* Program the next words of the parameter page
+*
+* The page is generated on the fly from the live values, so parameters stay
+* usable in between steps. The CRC is calculated from the programmed page in
+* the final step and programming it commits the page and the whole bank.
+*
+* @pre parm_save_start() was called and the save bank is erased
+* @param maxWords maximum number of words to program in this call
+* @return number of words still to be programmed, 0 when done. For the
+* compact format this is an estimate as the record sizes are not known yet.
+* It returns PARAM_SAVE_ERR_FULL when the parameters do not fit the page, then
+* and in all further calls until parm_save_start(). That is known right after
+* parm_save_start(), unless values grow while saving. Then the page is never
+* committed, so with A/B saving the previous configuration stays active.
+* The journal appends the changed parameters word by word as well. When it
+* compacts, the first step starts erasing the other journal sector and the
+* steps return at least 1 until the erase is done.
+*/
+int parm_save_step(int maxWords)
+{
+#if defined(PARAM_SAVE_JOURNAL)
+   return journal.SaveStep(maxWords);
+#elif defined(PARAM_SAVE_COMPACT)
+   return CompactSaveStep(maxWords);
+#else
+   for (; saveIdx < PARAM_WORDS && maxWords > 0; saveIdx++, maxWords--)
+   {
+      uint32_t word = GetPageWord(saveIdx);
+
+      if (word != ERASED)
+         flash->ProgramWord(saveBank, PAGE_OFFSET + saveIdx, word);
+   }
+
+   if (saveIdx == PARAM_WORDS && maxWords > 0)
+   {
+      crc_reset();
+      uint32_t crc = crc_calculate_block((uint32_t*)GetPage(saveBank), CRC_WORD);
+      flash->ProgramWord(saveBank, PAGE_OFFSET + CRC_WORD, crc);
+      saveIdx++;
+   }
+
+   return PARAM_WORDS + 1 - saveIdx;
+#endif // PARAM_SAVE_COMPACT
+}
+
+/**
+* Save parameters to flash
+* @pre the flash page/sector of parm_save_bank() needs to be erased prior to calling this function
+* @return CRC of parameter flash page, number of appended records with PARAM_SAVE_JOURNAL.
+* Whether the parameters did fit the page can be checked with parm_save_step(0).
+*/
+uint32_t parm_save()
+{
+   parm_save_start();
+   while (parm_save_step(PARAM_WORDS) > 0);
+
+#ifdef PARAM_SAVE_JOURNAL
+   return journal.GetSavedRecords();
+#else
+   return GetCrc(GetPage(saveBank));
+#endif // PARAM_SAVE_JOURNAL
 }
 
 /**
@@ -90,14 +555,24 @@ uint32_t parm_save()
 */
 int parm_load()
 {
-   uint32_t paramAddress = GetFlashAddress();
-   PARAM_PAGE *parmPage = (PARAM_PAGE *)paramAddress;
+#ifdef PARAM_SAVE_JOURNAL
+   //Without a journal yet fall back to the page of a firmware without journal
+   if (journal.Load() == 0)
+      return 0;
+#endif // PARAM_SAVE_JOURNAL
 
-   crc_reset();
-   uint32_t crc = crc_calculate_block(((uint32_t*)parmPage), (2 * NUM_PARAMS));
+   int bank = parm_active_bank();
 
-   if (crc == parmPage->crc)
+   if (bank >= 0)
    {
+      const PARAM_PAGE *parmPage = GetPage(bank);
+
+      if (GetCompact(parmPage) != 0)
+      {
+         LoadCompact(GetCompact(parmPage));
+         return 0;
+      }
+
       for (unsigned int idxPage = 0; idxPage < NUM_PARAMS; idxPage++)
       {
          Param::PARAM_NUM idx = Param::NumFromId(parmPage->data[idxPage].key);
@@ -23,15 +23,119 @@
 namespace Param
 {
 
+/** FNV-1a hash of a parameter name, evaluated at compile time for the name table */
+static constexpr uint32_t HashName(const char *name, uint32_t hash = 2166136261u)
+{
+   return *name ? HashName(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+/** Smallest power of two that is >= n */
+static constexpr uint32_t PowerOfTwo(uint32_t n, uint32_t size = 1)
+{
+   return size >= n ? size : PowerOfTwo(n, size * 2);
+}
+
+#define CHANGE_WORDS ((PARAM_LAST + 31) / 32)
+#define SNAPSHOT_RETRIES 8
+//Scaled gains with more fractional bits are rounded decimals, see GetScaled()
+#define EXACT_GAIN_DIGITS 16
+
+#ifndef PARAM_BATCH_SIZE
+#define PARAM_BATCH_SIZE 32
+#endif // PARAM_BATCH_SIZE
+
+//Keep the name table at most half full so probe sequences stay short
+#define NAME_TABLE_SIZE PowerOfTwo(2 * PARAM_LAST)
+#define NAME_TABLE_MASK (NAME_TABLE_SIZE - 1)
+
+#define PARAM_ENTRY(category, name, unit, min, max, def, id) id,
+#define VALUE_ENTRY(name, unit, id) id,
+static constexpr uint32_t paramIds[] =
+{
+    PARAM_LIST
+};
+#undef PARAM_ENTRY
+#undef VALUE_ENTRY
+
+static constexpr uint32_t Larger(uint32_t a, uint32_t b)
+{
+   return a > b ? a : b;
+}
+
+/* The following compile time checks split their range in halves, so the
+ * recursion depth is log2(PARAM_LAST) and stays within constexpr limits.
+ */
+
+/** Largest unique id in paramIds[first..last-1] */
+static constexpr uint32_t MaxId(uint32_t first, uint32_t last)
+{
+   return last - first == 1 ? paramIds[first] :
+          Larger(MaxId(first, (first + last) / 2), MaxId((first + last) / 2, last));
+}
+
+/** true if id does not occur in paramIds[first..last-1] */
+static constexpr bool IdNotIn(uint32_t id, uint32_t first, uint32_t last)
+{
+   return first >= last ? true :
+          last - first == 1 ? paramIds[first] != id :
+          IdNotIn(id, first, (first + last) / 2) && IdNotIn(id, (first + last) / 2, last);
+}
+
+/** true if no id in paramIds[first..last-1] occurs again later in the list, id 0 is exempt */
+static constexpr bool IdsUnique(uint32_t first, uint32_t last)
+{
+   return last - first == 1 ? paramIds[first] == 0 || IdNotIn(paramIds[first], first + 1, PARAM_LAST) :
+          IdsUnique(first, (first + last) / 2) && IdsUnique((first + last) / 2, last);
+}
+
+static_assert(MaxId(0, PARAM_LAST) <= 0xFFFF, "PARAM_LIST: ids must fit in 16 bits for CAN map and flash storage");
+static_assert(IdsUnique(0, PARAM_LAST), "PARAM_LIST: duplicate id");
+
+//Dense ids are looked up directly, sparse ids by binary search on a sorted table
+#define ID_TABLE_DIRECT (MaxId(0, PARAM_LAST) < 4 * PARAM_LAST)
+#define ID_TABLE_SIZE (ID_TABLE_DIRECT ? MaxId(0, PARAM_LAST) + 1 : (uint32_t)PARAM_LAST)
+
 #define PARAM_ENTRY(category, name, unit, min, max, def, id) { category, #name, unit, FP_FROMFLT(min), FP_FROMFLT(max), FP_FROMFLT(def), id },
 #define VALUE_ENTRY(name, unit, id) { 0, #name, unit, 0, 0, 0, id },
-static const Attributes attribs[] =
+static constexpr Attributes attribs[] =
+{
+    PARAM_LIST
+};
+#undef PARAM_ENTRY
+#undef VALUE_ENTRY
+
+/** true if min <= def <= max for all entries in attribs[first..last-1] */
+static constexpr bool RangesValid(uint32_t first, uint32_t last)
+{
+   return last - first == 1 ? attribs[first].min <= attribs[first].def && attribs[first].def <= attribs[first].max :
+          RangesValid(first, (first + last) / 2) && RangesValid((first + last) / 2, last);
+}
+
+static_assert(RangesValid(0, PARAM_LAST), "PARAM_LIST: parameter with min > max or default outside of min..max");
+
+#ifdef PARAM_HOT_COLD_SPLIT
+/* Keep the range Set() checks against in RAM right beside the value,
+ * names and units stay in the flash resident attribs[] */
+struct HotEntry
+{
+   s32fp value;
+   s32fp min;
+   s32fp max;
+};
+
+#define PARAM_ENTRY(category, name, unit, min, max, def, id) { FP_FROMFLT(def), FP_FROMFLT(min), FP_FROMFLT(max) },
+#define VALUE_ENTRY(name, unit, id) { 0, 0, 0 },
+static HotEntry hot[] =
 {
     PARAM_LIST
 };
 #undef PARAM_ENTRY
 #undef VALUE_ENTRY
 
+#define VALUE(p)   hot[p].value
+#define MINIMUM(p) hot[p].min
+#define MAXIMUM(p) hot[p].max
+#else
 #define PARAM_ENTRY(category, name, unit, min, max, def, id) FP_FROMFLT(def),
 #define VALUE_ENTRY(name, unit, id) 0,
 static s32fp values[] =
@@ -41,6 +145,11 @@ static s32fp values[] =
 #undef PARAM_ENTRY
 #undef VALUE_ENTRY
 
+#define VALUE(p)   values[p]
+#define MINIMUM(p) attribs[p].min
+#define MAXIMUM(p) attribs[p].max
+#endif // PARAM_HOT_COLD_SPLIT
+
 #define PARAM_ENTRY(category, name, unit, min, max, def, id) 0,
 #define VALUE_ENTRY(name, unit, id) 0,
 static uint8_t flags[] =
@@ -50,26 +159,288 @@ static uint8_t flags[] =
 #undef PARAM_ENTRY
 #undef VALUE_ENTRY
 
+#define PARAM_ENTRY(category, name, unit, min, max, def, id) HashName(#name),
+#define VALUE_ENTRY(name, unit, id) HashName(#name),
+static const uint32_t nameHashes[] =
+{
+    PARAM_LIST
+};
+#undef PARAM_ENTRY
+#undef VALUE_ENTRY
+
+//Open addressing table of parameter index + 1, 0 marks an empty slot
+static uint16_t nameTable[NAME_TABLE_SIZE];
+//Direct mode: parameter index + 1 by id, 0 marks an unused id
+//Sorted mode: parameter indexes sorted by ascending id
+static uint16_t idTable[ID_TABLE_SIZE];
+static volatile bool indexBuilt = false;
+//One bit per parameter that was changed by Set() while in deferred mode
+static uint32_t changed[CHANGE_WORDS];
+static volatile bool deferChange = false;
+//Generation counter value just before the last change of each parameter
+static uint32_t changeGen[PARAM_LAST];
+//One bit per parameter whose changeGen is valid, i.e. that was changed at least once
+static uint32_t everChanged[CHANGE_WORDS];
+//Starts at 1 and skips 0 on wrap around, since 0 means all parameters to NextChanged()
+static uint32_t generation = 1;
+//Seqlock of Snapshot(), a write is in progress while the counts differ
+static uint32_t writesBegun = 0;
+static uint32_t writesEnded = 0;
+//Parameters staged by AddToBatch() until CommitBatch()
+static PARAM_NUM batchParams[PARAM_BATCH_SIZE];
+static s32fp batchValues[PARAM_BATCH_SIZE];
+static int batchCount = 0;
+
+/** Fill the name and id lookup tables from the compile time hashes and ids.
+ * The sorted id table is built by insertion, so filling must not be
+ * interrupted by a lookup. It runs from a static constructor, i.e. before
+ * main() and before any interrupt is enabled. Lookups still build the tables
+ * themselves when called from another static constructor that runs first.
+ */
+static void BuildIndex()
+{
+   for (uint32_t idx = 0; idx < PARAM_LAST; idx++)
+   {
+      uint32_t slot = nameHashes[idx] & NAME_TABLE_MASK;
+
+      while (nameTable[slot] != 0 && nameTable[slot] != idx + 1)
+         slot = (slot + 1) & NAME_TABLE_MASK;
+
+      nameTable[slot] = idx + 1;
+
+      if (ID_TABLE_DIRECT)
+      {
+         //keep the first parameter with a given id like the linear search did
+         if (idTable[paramIds[idx]] == 0 || idTable[paramIds[idx]] > idx + 1)
+            idTable[paramIds[idx]] = idx + 1;
+      }
+      else
+      {
+         //Stable insertion sort, equal ids stay in PARAM_LIST order
+         uint32_t pos = idx;
+
+         for (; pos > 0 && paramIds[idTable[pos - 1]] > paramIds[idx]; pos--)
+            idTable[pos] = idTable[pos - 1];
+
+         idTable[pos] = idx;
+      }
+   }
+   indexBuilt = true;
+}
+
+static struct IndexBuilder
+{
+   IndexBuilder()
+   {
+      if (!indexBuilt)
+         BuildIndex();
+   }
+} indexBuilder;
+
+/** Advance the generation, skipping 0
+ * @return generation before the change
+ */
+static uint32_t NextGeneration()
+{
+   uint32_t gen = __atomic_load_n(&generation, __ATOMIC_RELAXED);
+
+   while (!__atomic_compare_exchange_n(&generation, &gen, gen + 1 == 0 ? 1 : gen + 1, true,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+   return gen;
+}
+
+/** Store a value and record the generation if it actually changed
+ * @return true if the value changed
+ */
+static bool Store(PARAM_NUM ParamNum, s32fp ParamVal)
+{
+   if (VALUE(ParamNum) != ParamVal)
+   {
+      BeginUpdate();
+      __atomic_store_n(&VALUE(ParamNum), ParamVal, __ATOMIC_RELAXED);
+      changeGen[ParamNum] = NextGeneration();
+
+      if ((everChanged[ParamNum / 32] & (1u << (ParamNum % 32))) == 0)
+         __atomic_fetch_or(&everChanged[ParamNum / 32], 1u << (ParamNum % 32), __ATOMIC_RELEASE);
+      EndUpdate();
+      return true;
+   }
+   return false;
+}
+
+/** Round to 24 significant bits like a float product */
+static int64_t RoundLikeFloat(int64_t value)
+{
+   uint64_t magnitude = value < 0 ? -(uint64_t)value : value;
+
+   if (magnitude >= (1 << 24))
+   {
+      int drop = 40 - __builtin_clzll(magnitude);
+      magnitude = (magnitude + (1ULL << (drop - 1))) >> drop << drop;
+   }
+   return value < 0 ? -(int64_t)magnitude : (int64_t)magnitude;
+}
+
+/** Limit a scaled result to the 32 bit range */
+static int32_t Saturate(int64_t value)
+{
+   if (value > INT32_MAX) return INT32_MAX;
+   if (value < INT32_MIN) return INT32_MIN;
+   return value;
+}
+
+/** Mark parameter for ProcessChanges() */
+static void MarkChanged(PARAM_NUM ParamNum)
+{
+   __atomic_fetch_or(&changed[ParamNum / 32], 1u << (ParamNum % 32), __ATOMIC_RELAXED);
+}
+
 /**
 * Set a parameter
 *
 * @param[in] ParamNum Parameter index
 * @param[in] ParamVal New value of parameter
 * @return 0 if set ok, -1 if ParamVal outside of allowed range
+* @post parm_Change() has been called, or is pending for ProcessChanges() in deferred mode
 */
 int Set(PARAM_NUM ParamNum, s32fp ParamVal)
 {
     char res = -1;
 
-    if (ParamVal >= attribs[ParamNum].min && ParamVal <= attribs[ParamNum].max)
+    if (ParamVal >= MINIMUM(ParamNum) && ParamVal <= MAXIMUM(ParamNum))
     {
-        values[ParamNum] = ParamVal;
-        parm_Change(ParamNum);
+        Store(ParamNum, ParamVal);
+
+        if (deferChange)
+           MarkChanged(ParamNum);
+        else
+           parm_Change(ParamNum);
+
         res = 0;
     }
     return res;
 }
 
+/**
+* Start collecting parameters for CommitBatch()
+*
+* Only one batch can be open at a time.
+*/
+void BeginBatch()
+{
+   batchCount = 0;
+}
+
+/**
+* Range check a parameter value and stage it for CommitBatch()
+*
+* Adding the same parameter again replaces its staged value.
+*
+* @param[in] ParamNum Parameter index
+* @param[in] ParamVal New value of parameter
+* @return 0 if staged, -1 if ParamVal outside of allowed range, -2 if batch is full
+*/
+int AddToBatch(PARAM_NUM ParamNum, s32fp ParamVal)
+{
+   int idx = 0;
+
+   if (ParamVal < MINIMUM(ParamNum) || ParamVal > MAXIMUM(ParamNum))
+      return -1;
+
+   for (; idx < batchCount && batchParams[idx] != ParamNum; idx++);
+
+   if (idx == PARAM_BATCH_SIZE)
+      return -2;
+
+   batchParams[idx] = ParamNum;
+   batchValues[idx] = ParamVal;
+
+   if (idx == batchCount)
+      batchCount++;
+
+   return 0;
+}
+
+/**
+* Apply all staged parameters and notify the application once
+*
+* parm_ChangeBatch() is called with the parameters whose value actually
+* changed. In deferred mode they are marked for ProcessChanges() instead.
+*
+* @return Number of changed parameters
+*/
+int CommitBatch()
+{
+   int numChanged = 0;
+
+   //Snapshot() sees all or none of the batch
+   BeginUpdate();
+
+   for (int idx = 0; idx < batchCount; idx++)
+   {
+      //Compact the changed ones to the front, they are the callback argument
+      if (Store(batchParams[idx], batchValues[idx]))
+         batchParams[numChanged++] = batchParams[idx];
+   }
+
+   EndUpdate();
+
+   batchCount = 0;
+
+   if (deferChange)
+   {
+      for (int idx = 0; idx < numChanged; idx++)
+         MarkChanged(batchParams[idx]);
+   }
+   else if (numChanged > 0)
+   {
+      parm_ChangeBatch(batchParams, numChanged);
+   }
+
+   return numChanged;
+}
+
+/** Discard all staged parameters */
+void AbortBatch()
+{
+   batchCount = 0;
+}
+
+/**
+* Select whether Set() calls parm_Change() immediately or defers it
+*
+* In deferred mode Set() only marks the parameter as changed, which keeps
+* the callback out of interrupts like the CAN receive handler.
+* ProcessChanges() must then be called periodically, e.g. from a slow task.
+*
+* @param[in] deferred true: defer parm_Change() to ProcessChanges(), false: call it from Set()
+*/
+void SetDeferredChange(bool deferred)
+{
+   deferChange = deferred;
+}
+
+/**
+* Call parm_Change() for every parameter changed by Set() since the last call
+*
+* Multiple changes of the same parameter are coalesced into one callback.
+* Callbacks are delivered in ascending parameter index, i.e. PARAM_LIST order.
+*/
+void ProcessChanges()
+{
+   for (uint32_t word = 0; word < CHANGE_WORDS; word++)
+   {
+      uint32_t bits = __atomic_exchange_n(&changed[word], 0, __ATOMIC_RELAXED);
+
+      while (bits != 0)
+      {
+         uint32_t bit = __builtin_ctz(bits);
+         bits &= bits - 1; //clear lowest set bit
+         parm_Change((PARAM_NUM)(word * 32 + bit));
+      }
+   }
+}
+
 /**
 * Get a parameters fixed point value
 *
@@ -78,7 +449,7 @@ int Set(PARAM_NUM ParamNum, s32fp ParamVal)
 */
 s32fp Get(PARAM_NUM ParamNum)
 {
-    return values[ParamNum];
+    return VALUE(ParamNum);
 }
 
 /**
@@ -89,7 +460,7 @@ s32fp Get(PARAM_NUM ParamNum)
 */
 int GetInt(PARAM_NUM ParamNum)
 {
-    return FP_TOINT(values[ParamNum]);
+    return FP_TOINT(VALUE(ParamNum));
 }
 
 /**
@@ -100,7 +471,39 @@ int GetInt(PARAM_NUM ParamNum)
 */
 float GetFloat(PARAM_NUM ParamNum)
 {
-    return ((float)values[ParamNum]) / FRAC_FAC;
+    return ((float)VALUE(ParamNum)) / FRAC_FAC;
+}
+
+/**
+* Get a parameters value times an integer gain plus offset, without float
+*
+* For packing values into CAN messages or telemetry. Truncates towards zero
+* like converting value * gain + offset from float, the result saturates.
+* Gains with more than EXACT_GAIN_DIGITS fractional bits stand for decimal
+* fractions like 0.7 that are not exact in binary. Their product is rounded
+* to 24 significant bits like a float product, so 10 * 0.7 gives 7.
+*
+* @param[in] ParamNum Parameter index
+* @param[in] gain Gain scaled by 2^fracBits
+* @param[in] fracBits Number of fractional bits of gain, 0 to 62 - CST_DIGITS
+* @param[in] offset Added before truncation
+* @return Scaled value
+*/
+int32_t GetScaled(PARAM_NUM ParamNum, int32_t gain, int fracBits, int32_t offset)
+{
+   const int shift = fracBits + CST_DIGITS;
+   int64_t scaled = (int64_t)VALUE(ParamNum) * gain;
+
+   if (fracBits > EXACT_GAIN_DIGITS)
+      scaled = RoundLikeFloat(scaled);
+
+   //Floor and remainder, the offset is added in between so it can not overflow
+   int64_t result = (scaled >> shift) + offset;
+
+   if (result < 0 && (scaled & ((1LL << shift) - 1)) != 0)
+      result++;
+
+   return Saturate(result);
 }
 
 /**
@@ -111,7 +514,7 @@ float GetFloat(PARAM_NUM ParamNum)
 */
 bool GetBool(PARAM_NUM ParamNum)
 {
-    return FP_TOINT(values[ParamNum]) == 1;
+    return FP_TOINT(VALUE(ParamNum)) == 1;
 }
 
 /**
@@ -122,7 +525,7 @@ bool GetBool(PARAM_NUM ParamNum)
 */
 void SetInt(PARAM_NUM ParamNum, int ParamVal)
 {
-   values[ParamNum] = FP_FROMINT(ParamVal);
+   Store(ParamNum, FP_FROMINT(ParamVal));
 }
 
 /**
@@ -133,7 +536,7 @@ void SetInt(PARAM_NUM ParamNum, int ParamVal)
 */
 void SetFixed(PARAM_NUM ParamNum, s32fp ParamVal)
 {
-   values[ParamNum] = ParamVal;
+   Store(ParamNum, ParamVal);
 }
 
 /**
@@ -144,7 +547,135 @@ void SetFixed(PARAM_NUM ParamNum, s32fp ParamVal)
 */
 void SetFloat(PARAM_NUM ParamNum, float ParamVal)
 {
-   values[ParamNum] = (s32fp)(ParamVal * FRAC_FAC);
+   Store(ParamNum, (s32fp)(ParamVal * FRAC_FAC));
+}
+
+/**
+* Set a parameter to a value times an integer gain, without float
+*
+* For unpacking CAN messages. Truncates towards zero like multiplying by
+* a float gain, the result saturates. Gains are rounded like GetScaled()
+* does. Parameters are range checked and
+* parm_Change() is called like Set() does, values are stored directly.
+*
+* @param[in] ParamNum Parameter index
+* @param[in] ParamVal Unscaled value
+* @param[in] gain Gain scaled by 2^fracBits
+* @param[in] fracBits Number of fractional bits of gain, 0 to 62 - CST_DIGITS
+* @return 0 if set, -1 if a parameter is out of range
+*/
+int SetScaled(PARAM_NUM ParamNum, s32fp ParamVal, int32_t gain, int fracBits)
+{
+   int64_t scaled = (int64_t)ParamVal * gain;
+
+   if (fracBits > EXACT_GAIN_DIGITS)
+      scaled = RoundLikeFloat(scaled);
+
+   s32fp val = Saturate(scaled / (1LL << fracBits));
+
+   if (IsParam(ParamNum))
+      return Set(ParamNum, val);
+
+   Store(ParamNum, val);
+   return 0;
+}
+
+/**
+* Get the current change generation
+*
+* Every change of any parameter or value increments the generation. It
+* starts at 1 and skips 0 when it wraps around, so it never asks NextChanged()
+* for all parameters by accident.
+*
+* @return Current generation, never 0, pass it to NextChanged() to find later changes
+*/
+uint32_t GetGeneration()
+{
+   return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+* Find the next parameter that changed after a given generation
+*
+* Iterate all changes with
+* for (idx = NextChanged(0, gen); idx < PARAM_LAST; idx = NextChanged(idx + 1, gen))
+*
+* A parameter counts as changed if its last change lies between since and
+* the current generation. The distances are taken modulo 2^32, so this keeps
+* working when the generation wraps around. Parameters that never changed
+* are only found with since 0.
+*
+* @param[in] start Parameter index to start searching at
+* @param[in] since Generation as returned by GetGeneration(), 0 finds all parameters
+* @return Index of changed parameter, PARAM_LAST if there are no more changes
+*/
+PARAM_NUM NextChanged(int start, uint32_t since)
+{
+   uint32_t window = GetGeneration() - since;
+
+   for (int idx = start; idx < PARAM_LAST; idx++)
+   {
+      bool changed = (__atomic_load_n(&everChanged[idx / 32], __ATOMIC_ACQUIRE) & (1u << (idx % 32))) != 0;
+
+      if (since == 0 || (changed && changeGen[idx] - since < window))
+         return (PARAM_NUM)idx;
+   }
+   return PARAM_LAST;
+}
+
+/**
+* Start writing a set of values that Snapshot() must only see complete
+*
+* Every Set(), SetFixed() etc. is a write on its own. Bracket several of them
+* with BeginUpdate() and EndUpdate() to make them one write, e.g. all values
+* of a received CAN frame. Brackets may nest and may be opened by several
+* writers at once, e.g. an interrupt preempting the main loop.
+*/
+void BeginUpdate()
+{
+   __atomic_fetch_add(&writesBegun, 1, __ATOMIC_RELAXED);
+   //Order the count before the values it protects
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/** End a write started with BeginUpdate() */
+void EndUpdate()
+{
+   __atomic_fetch_add(&writesEnded, 1, __ATOMIC_RELEASE);
+}
+
+/**
+* Read several values as one consistent set
+*
+* This is a seqlock reader that never blocks writers. The number of ended
+* writes is read before copying and the number of begun writes after it. If
+* they differ, a write was in progress or began while copying, and the copy
+* is retried. This is the odd/even sequence of a seqlock, split into two
+* counts so writers may nest and run at the same time.
+*
+* A reader on a single core that interrupted a writer can never succeed,
+* as the writer only continues after the reader returns. It then gets -1.
+*
+* @param[in] params Indexes of the values to read
+* @param[out] vals Fixed point values, same order as params
+* @param[in] count Number of values
+* @return 0 if vals is consistent, -1 if writers kept interfering
+*/
+int Snapshot(const PARAM_NUM *params, s32fp *vals, int count)
+{
+   for (int retry = 0; retry < SNAPSHOT_RETRIES; retry++)
+   {
+      uint32_t ended = __atomic_load_n(&writesEnded, __ATOMIC_ACQUIRE);
+
+      for (int i = 0; i < count; i++)
+         vals[i] = __atomic_load_n(&VALUE(params[i]), __ATOMIC_RELAXED);
+
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+      if (__atomic_load_n(&writesBegun, __ATOMIC_RELAXED) == ended)
+         return 0;
+   }
+   return -1;
 }
 
 /**
@@ -155,18 +686,21 @@ void SetFloat(PARAM_NUM ParamNum, float ParamVal)
 */
 PARAM_NUM NumFromString(const char *name)
 {
-    PARAM_NUM paramNum = PARAM_INVALID;
-    const Attributes *pCurAtr = attribs;
+    uint32_t hash = HashName(name);
 
-    for (int i = 0; i < PARAM_LAST; i++, pCurAtr++)
+    if (!indexBuilt)
+       BuildIndex();
+
+    for (uint32_t slot = hash & NAME_TABLE_MASK; nameTable[slot] != 0; slot = (slot + 1) & NAME_TABLE_MASK)
     {
-         if (0 == my_strcmp(pCurAtr->name, name))
+         int idx = nameTable[slot] - 1;
+
+         if (nameHashes[idx] == hash && 0 == my_strcmp(attribs[idx].name, name))
          {
-             paramNum = (PARAM_NUM)i;
-             break;
+             return (PARAM_NUM)idx;
          }
     }
-    return paramNum;
+    return PARAM_INVALID;
 }
 
 /**
@@ -177,18 +711,33 @@ PARAM_NUM NumFromString(const char *name)
 */
 PARAM_NUM NumFromId(uint32_t id)
 {
-    PARAM_NUM paramNum = PARAM_INVALID;
-    const Attributes *pCurAtr = attribs;
+    if (!indexBuilt)
+       BuildIndex();
 
-    for (int i = 0; i < PARAM_LAST; i++, pCurAtr++)
+    if (ID_TABLE_DIRECT)
     {
-         if (pCurAtr->id == id)
-         {
-             paramNum = (PARAM_NUM)i;
-             break;
-         }
+       if (id < ID_TABLE_SIZE && idTable[id] != 0)
+          return (PARAM_NUM)(idTable[id] - 1);
+    }
+    else
+    {
+       uint32_t first = 0, last = PARAM_LAST;
+
+       //lower bound, finds the first parameter with the given id
+       while (first < last)
+       {
+          uint32_t mid = (first + last) / 2;
+
+          if (paramIds[idTable[mid]] < id)
+             first = mid + 1;
+          else
+             last = mid;
+       }
+
+       if (first < PARAM_LAST && paramIds[idTable[first]] == id)
+          return (PARAM_NUM)idTable[first];
     }
-    return paramNum;
+    return PARAM_INVALID;
 }
 
 /**
@@ -208,7 +757,7 @@ const Attributes *GetAttrib(PARAM_NUM ParamNum)
  */
 int IsParam(PARAM_NUM ParamNum)
 {
-   return attribs[ParamNum].min != attribs[ParamNum].max;
+   return MINIMUM(ParamNum) != MAXIMUM(ParamNum);
 }
 
 /** Load default values for all parameters */
@@ -244,3 +793,10 @@ PARAM_FLAG GetFlag(PARAM_NUM param)
 }
 
 }
+
+/** Default batch callback for applications that don't provide one */
+__attribute__((weak)) void parm_ChangeBatch(const Param::PARAM_NUM *params, int count)
+{
+   for (int i = 0; i < count; i++)
+      parm_Change(params[i]);
+}
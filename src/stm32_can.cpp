@@ -22,19 +22,25 @@
 #include "my_string.h"
 #include "my_math.h"
 #include "printf.h"
+#include "param_save.h"
+#include "flashbanks.h"
 #include <libopencm3/stm32/can.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
-#include <libopencm3/stm32/flash.h>
 #include <libopencm3/stm32/crc.h>
 #include <libopencm3/stm32/rtc.h>
 #include <libopencm3/stm32/desig.h>
 #include <libopencm3/cm3/common.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/cortex.h>
 #include "stm32_can.h"
 
 #define MAX_INTERFACES        2
 #define IDS_PER_BANK          4
+#define FILTER_BANKS          28
+#define MERGE_WINDOW          4 //filters compared by MergeFilters(), counted from each filter
+#define STD_ID_MASK           0x7FF
+#define EXT_ID_MASK           0x1FFFFFFF
 #define SDO_WRITE             0x40
 #define SDO_READ              0x22
 #define SDO_ABORT             0x80
@@ -42,18 +48,36 @@
 #define SDO_READ_REPLY        0x43
 #define SDO_ERR_INVIDX        0x06020000
 #define SDO_ERR_RANGE         0x06090030
-#define SENDMAP_ADDRESS(b)    b
-#define RECVMAP_ADDRESS(b)    (b + sizeof(canSendMap))
-#define CRC_ADDRESS(b)        (b + sizeof(canSendMap) + sizeof(canRecvMap))
-#define SENDMAP_WORDS         (sizeof(canSendMap) / (sizeof(uint32_t)))
-#define RECVMAP_WORDS         (sizeof(canRecvMap) / (sizeof(uint32_t)))
+//Fixed size layout saved before the compact format, only loaded to migrate it.
+//It was written with the default limits, so these must not follow MAX_MESSAGES and MAX_ITEMS_PER_MESSAGE.
+#define LEGACY_MESSAGES       10
+#define LEGACY_ITEMS          10
+#define LEGACY_ITEM_WORDS     3
+#define LEGACY_MAP_WORDS      (LEGACY_MESSAGES * (1 + LEGACY_ITEMS * LEGACY_ITEM_WORDS)) //one map, 310 words
+#define LEGACY_CRC_OFFSET     (2 * LEGACY_MAP_WORDS)
+//Compact layout
+#define CANMAP_MAGIC          0x314E4143 //"CAN1", can not be the first CAN id of a legacy map
+#define CANMAP_HEADER_WORDS   3
+#define CANMAP_DATA_WORDS     (CAN_BLKSIZE / sizeof(uint32_t) - CANMAP_HEADER_WORDS)
+#define RECORD_RX_FLAG        0x80000000
+#define RECORD_HEADER_WORDS(rx) ((rx) ? 2 : 2 + sizeof(CANSCHED) / sizeof(uint32_t))
+#define ITEM_WORDS            (sizeof(CANPOS) / sizeof(uint32_t))
 #define CANID_UNSET           0xffffffff
-#define NUMBITS_LASTMARKER    -1
+#define FIELD_MASK(n)         ((1ULL << (n)) - 1) //also valid for 32 bit fields
+#define GAIN_MAX_DIGITS       (62 - CST_DIGITS) //limit of Param::GetScaled()
 #define forEachCanMap(c,m) for (CANIDMAP *c = m; (c - m) < MAX_MESSAGES && c->canId < CANID_UNSET; c++)
 #define forEachPosMap(c,m) for (CANPOS *c = m->items; (c - m->items) < MAX_ITEMS_PER_MESSAGE && c->numBits > 0; c++)
 
-#if (2 *((MAX_ITEMS_PER_MESSAGE * 10 + 4) * MAX_MESSAGES + 2) + 4) > CAN_BLKSIZE
-#error CANMAP will not fit in one flash page
+/* The compact layout only stores used messages and items, Add() refuses
+ * items that would not fit. It starts with CANMAP_MAGIC, the number of data
+ * words and the CRC of header and data. Each message is one record:
+ * - CAN id, ORed with RECORD_RX_FLAG for receive messages
+ * - number of items
+ * - CANSCHED of send messages
+ * - the items as CANPOS with parameter id and float gain
+ */
+#if (4 * (CANMAP_HEADER_WORDS + 4 + 3 * MAX_ITEMS_PER_MESSAGE)) > CAN_BLKSIZE
+#error CANMAP block can not even hold one full message
 #endif
 
 struct CAN_SDO
@@ -72,9 +96,28 @@ struct CANSPEED
 };
 
 Can* Can::interfaces[MAX_INTERFACES];
-volatile bool Can::isSaving = false;
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+/** Mask interrupts of the given priority and lower, higher priority ones stay
+ * enabled. BASEPRI_MAX never lowers the mask of an enclosing section.
+ * \return previous mask for cm_restore_basepri() */
+static inline uint32_t cm_raise_basepri(uint32_t priority)
+{
+   uint32_t basepri;
+   __asm__ volatile("mrs %0, basepri" : "=r" (basepri));
+   __asm__ volatile("msr basepri_max, %0" : : "r" (priority) : "memory");
+   return basepri;
+}
+
+static inline void cm_restore_basepri(uint32_t basepri)
+{
+   __asm__ volatile("msr basepri, %0" : : "r" (basepri) : "memory");
+}
+#endif
 
 static void DummyCallback(uint32_t i, uint32_t* d) { i=i; d=d; }
+//Standard list, standard mask, extended list, extended mask
+static const uint8_t filtersPerBank[] = { 4, 2, 2, 1 };
 static const CANSPEED canSpeed[Can::BaudLast] =
 {
    { CAN_BTR_TS1_13TQ, CAN_BTR_TS2_2TQ, 21 }, //125kbps
@@ -93,10 +136,11 @@ static const CANSPEED canSpeed[Can::BaudLast] =
  * \return success: number of active messages
  * Fault:
  * - CAN_ERR_INVALID_ID ID was > 0x1fffffff
- * - CAN_ERR_INVALID_OFS Offset > 63
- * - CAN_ERR_INVALID_LEN Length > 32
+ * - CAN_ERR_INVALID_OFS Offset not within 0..63
+ * - CAN_ERR_INVALID_LEN Length not within 1..32 or item exceeds the 64 message bits
  * - CAN_ERR_MAXMESSAGES Already 10 send messages defined
- * - CAN_ERR_MAXITEMS Already 8 items in message
+ * - CAN_ERR_MAXITEMS Already 8 items in message or no room left in the flash block
+ * - CAN_ERR_SAVING The map is being saved
  */
 int Can::AddSend(Param::PARAM_NUM param, int canId, int offsetBits, int length, float gain, int16_t offset)
 {
@@ -118,10 +162,11 @@ int Can::AddSend(Param::PARAM_NUM param, int canId, int offsetBits, int length,
  * \return success: number of active messages
  * Fault:
  * - CAN_ERR_INVALID_ID ID was > 0x1fffffff
- * - CAN_ERR_INVALID_OFS Offset > 63
- * - CAN_ERR_INVALID_LEN Length > 32
+ * - CAN_ERR_INVALID_OFS Offset not within 0..63
+ * - CAN_ERR_INVALID_LEN Length not within 1..32 or item exceeds the 64 message bits
  * - CAN_ERR_MAXMESSAGES Already 10 receive messages defined
- * - CAN_ERR_MAXITEMS Already 8 items in message
+ * - CAN_ERR_MAXITEMS Already 8 items in message or no room left in the flash block
+ * - CAN_ERR_SAVING The map is being saved
  */
 int Can::AddRecv(Param::PARAM_NUM param, int canId, int offsetBits, int length, float gain, int16_t offset)
 {
@@ -188,7 +233,7 @@ bool Can::FindMap(Param::PARAM_NUM param, int& canId, int& offset, int& length,
                canId = curMap->canId;
                offset = curPos->offsetBits;
                length = curPos->numBits;
-               gain = curPos->gain;
+               gain = GetGain(curPos);
                return true;
             }
          }
@@ -199,84 +244,207 @@ bool Can::FindMap(Param::PARAM_NUM param, int& canId, int& offset, int& length,
    return false;
 }
 
+/** \brief Set when a send message goes out
+ *
+ * The timing is counted in calls of SendAll(). With period 1 the message
+ * is sent on every call like without timing. With minGap > 0 it is also
+ * sent when its contents changed, but not more often than every minGap calls.
+ *
+ * \param canId CAN identifier of a message in the send map
+ * \param period send every period calls, 0 to only send on change
+ * \param phase send when the call count modulo period equals phase
+ * \param minGap minimum calls between two sends on change, 0 to disable
+ * \return 0 on success, CAN_ERR_INVALID_ID, CAN_ERR_INVALID_TIMING or CAN_ERR_SAVING
+ */
+int Can::SetSendTiming(uint32_t canId, int period, int phase, int minGap)
+{
+   CANIDMAP *map = canId < CANID_UNSET ? FindById(canSendMap, canId) : 0;
+
+   if (isSaving) return CAN_ERR_SAVING;
+   if (0 == map) return CAN_ERR_INVALID_ID;
+   if (period < 0 || period > 0xFFFF || minGap < 0 || minGap > 0xFFFF) return CAN_ERR_INVALID_TIMING;
+   if (phase < 0 || (period > 0 && phase >= period) || (period == 0 && (phase != 0 || minGap == 0))) return CAN_ERR_INVALID_TIMING;
+
+   CANSCHED *sched = &canSendSched[map - canSendMap];
+   sched->period = period;
+   sched->phase = phase;
+   sched->minGap = minGap;
+   canSendState[map - canSendMap].lastFrame = ~0ULL;
+
+   return 0;
+}
+
+/** \brief Get timing of a send message as set by SetSendTiming()
+ * \return true: message found, false: canId is not in the send map
+ */
+bool Can::GetSendTiming(uint32_t canId, int& period, int& phase, int& minGap)
+{
+   CANIDMAP *map = canId < CANID_UNSET ? FindById(canSendMap, canId) : 0;
+
+   if (0 == map) return false;
+
+   CANSCHED *sched = &canSendSched[map - canSendMap];
+   period = sched->period;
+   phase = sched->phase;
+   minGap = sched->minGap;
+
+   return true;
+}
+
+/** \brief Prepare an incremental save of the CAN mapping to parm_save_bank()
+ */
+void Can::SaveStart()
+{
+   saveBank = parm_save_bank();
+   saveIdx = 0;
+   saveWords = CompactWords();
+   saveMsg = 0;
+   saveRecordWord = 0;
+   isSaving = true;
+}
+
+/** \brief Program the next words of the CAN mapping in the compact layout
+ *
+ * Parameter numbers are replaced by their ids on the fly, so the mapping
+ * stays in use in between steps. Changes to it are rejected with
+ * CAN_ERR_SAVING until the final step, which calculates the CRC from the
+ * programmed words.
+ *
+ * \pre SaveStart() was called and the save bank is erased
+ * \param maxWords maximum number of words to program in this call
+ * \return number of words still to be programmed, 0 when done
+ */
+int Can::SaveStep(int maxWords)
+{
+   IFlashBanks* flash = parm_get_flash();
+   uint32_t baseOffset = GetFlashOffset();
+   uint32_t totalWords = CANMAP_HEADER_WORDS + saveWords;
+
+   for (; saveIdx < totalWords && maxWords > 0; saveIdx++, maxWords--)
+   {
+      if (saveIdx == 0)
+         flash->ProgramWord(saveBank, baseOffset, CANMAP_MAGIC);
+      else if (saveIdx == 1)
+         flash->ProgramWord(saveBank, baseOffset + 1, saveWords);
+      else if (saveIdx < totalWords - 1)
+         flash->ProgramWord(saveBank, baseOffset + saveIdx + 1, NextRecordWord());
+      else
+         flash->ProgramWord(saveBank, baseOffset + 2, CalcCompactCrc(flash->GetBank(saveBank) + baseOffset));
+   }
+
+   if (saveIdx == totalWords)
+      isSaving = false;
+
+   return totalWords - saveIdx;
+}
+
 /** \brief Save CAN mapping to flash
- *  \pre the flash page/sector needs to be erased prior to calling this function
+ *  \pre the flash page/sector of parm_save_bank() needs to be erased prior to calling this function
  */
 void Can::Save()
 {
-   uint32_t crc;
-   uint32_t baseAddress = GetFlashAddress();
+   SaveStart();
+   while (SaveStep(CANMAP_HEADER_WORDS + saveWords) > 0);
+}
 
-   isSaving = true;
+/** \return true if the constructor loaded a CAN mapping from flash, false if none was saved or its CRC failed */
+bool Can::IsLoaded()
+{
+   return isLoaded;
+}
 
-   crc_reset();
+/** \brief Check whether the save bank already holds the current CAN mapping
+ * \return true if saving would program the same words, false while a save is running
+ */
+bool Can::IsSaved()
+{
+   const uint32_t* data = parm_get_flash()->GetBank(parm_save_bank()) + GetFlashOffset();
 
-   ReplaceParamEnumByUid(canSendMap);
-   ReplaceParamEnumByUid(canRecvMap);
+   if (isSaving || data[0] != CANMAP_MAGIC || data[1] != CompactWords())
+      return false;
 
-   SaveToFlash(baseAddress, (uint32_t *)canSendMap, SENDMAP_WORDS);
-   crc = SaveToFlash(RECVMAP_ADDRESS(baseAddress), (uint32_t *)canRecvMap, RECVMAP_WORDS);
-   SaveToFlash(CRC_ADDRESS(baseAddress), &crc, 1);
+   saveMsg = 0;
+   saveRecordWord = 0;
 
-   ReplaceParamUidByEnum(canSendMap);
-   ReplaceParamUidByEnum(canRecvMap);
+   for (uint32_t i = 0; i < data[1]; i++)
+   {
+      if (NextRecordWord() != data[CANMAP_HEADER_WORDS + i])
+         return false;
+   }
 
-   isSaving = false;
+   return CalcCompactCrc(data) == data[2];
 }
 
-/** \brief Send all defined messages
+/** \brief Send all defined messages that are due
+ * \see SetSendTiming()
  */
 void Can::SendAll()
 {
+   sendAllCount++;
+
    forEachCanMap(curMap, canSendMap)
    {
-      uint32_t data[2] = { 0 }; //Had an issue with uint64_t, otherwise would have used that
+      CANSCHED *sched = &canSendSched[curMap - canSendMap];
+      CANSENDSTATE *state = &canSendState[curMap - canSendMap];
+      bool due = sched->period == 1 || (sched->period > 0 && (sendAllCount % sched->period) == sched->phase);
+
+      if (state->callsSinceSent < 0xFFFF) state->callsSinceSent++;
+
+      //Only pack the message when it may be sent
+      if (!due && (sched->minGap == 0 || state->callsSinceSent < sched->minGap)) continue;
+
+      uint64_t frame = 0;
 
       forEachPosMap(curPos, curMap)
       {
-         if (isSaving) return; //Only send mapped messages when not currently saving to flash
-
-         float fval = Param::GetFloat((Param::PARAM_NUM)curPos->mapParam);
-         fval *= curPos->gain;
-         fval += curPos->offset;
-         uint32_t val = fval;
-         val &= ((1 << curPos->numBits) - 1);
+         uint32_t val = Param::GetScaled((Param::PARAM_NUM)curPos->mapParam, curPos->fixedGain,
+                                         curPos->gainDigits, curPos->offset);
 
-         if (curPos->offsetBits > 31)
-         {
-            data[1] |= val << (curPos->offsetBits - 32);
-         }
-         else
-         {
-            data[0] |= val << curPos->offsetBits;
-         }
+         frame |= (val & FIELD_MASK(curPos->numBits)) << curPos->offsetBits;
       }
 
+      if (!due && frame == state->lastFrame) continue;
+
+      uint32_t data[2] = { (uint32_t)frame, (uint32_t)(frame >> 32) };
+      state->lastFrame = frame;
+      state->callsSinceSent = 0;
       Send(curMap->canId, data);
    }
 }
 
 /** \brief Clear all defined messages
+ * \return 0 on success, CAN_ERR_SAVING while the map is being saved
  */
-void Can::Clear()
+int Can::Clear()
 {
+   if (isSaving) return CAN_ERR_SAVING;
+
    ClearMap(canSendMap);
    ClearMap(canRecvMap);
+   ResetSched(0);
    ConfigureFilters();
+
+   return 0;
 }
 
 /** \brief Remove all occurences of given parameter from CAN map
  *
  * \param param Parameter index to be removed
- * \return int number of removed items
+ * \return int number of removed items, CAN_ERR_SAVING while the map is being saved
  *
  */
 int Can::Remove(Param::PARAM_NUM param)
 {
+   if (isSaving) return CAN_ERR_SAVING;
+
    int removed = RemoveFromMap(canSendMap, param);
-   removed += RemoveFromMap(canRecvMap, param);
+   int removedRecv = RemoveFromMap(canRecvMap, param);
 
-   return removed;
+   //Messages behind a removed one moved down, the hash and filters still point to the old indexes
+   if (removedRecv > 0)
+      ConfigureFilters();
+
+   return removed + removedRecv;
 }
 
 /** \brief Init can hardware with given baud rate
@@ -292,10 +460,10 @@ int Can::Remove(Param::PARAM_NUM param)
  *
  */
 Can::Can(uint32_t baseAddr, enum baudrates baudrate, bool remap)
-   : lastRxTimestamp(0), sendCnt(0), recvCallback(DummyCallback), nextUserMessageIndex(0), canDev(baseAddr)
+   : sendAllCount(0), filterBanks(0), lastRxTimestamp(0), sendQueues(), highPriorityIdLimit(0), recvQueue(), deferredRx(false), recvCallback(DummyCallback), nextUserMessageIndex(0), canDev(baseAddr), saveBank(0), saveIdx(0), saveWords(0), saveMsg(0), saveRecordWord(0), isSaving(false)
 {
    Clear();
-   LoadFromFlash();
+   isLoaded = LoadFromFlash() != 0;
 
    switch (baseAddr)
    {
@@ -306,11 +474,11 @@ Can::Can(uint32_t baseAddr, enum baudrates baudrate, bool remap)
 
          //CAN1 RX and TX IRQs
          nvic_enable_irq(NVIC_CAN1_RX0_IRQ); //CAN RX
-         nvic_set_priority(NVIC_CAN1_RX0_IRQ, 0xf << 4); //lowest priority
+         nvic_set_priority(NVIC_CAN1_RX0_IRQ, CAN_IRQ_PRIORITY);
          nvic_enable_irq(NVIC_CAN1_RX1_IRQ); //CAN RX
-         nvic_set_priority(NVIC_CAN1_RX1_IRQ, 0xf << 4); //lowest priority
+         nvic_set_priority(NVIC_CAN1_RX1_IRQ, CAN_IRQ_PRIORITY);
          nvic_enable_irq(NVIC_CAN1_TX_IRQ); //CAN TX
-         nvic_set_priority(NVIC_CAN1_TX_IRQ, 0xf << 4); //lowest priority
+         nvic_set_priority(NVIC_CAN1_TX_IRQ, CAN_IRQ_PRIORITY);
          interfaces[0] = this;
          break;
       case CAN2:
@@ -320,11 +488,11 @@ Can::Can(uint32_t baseAddr, enum baudrates baudrate, bool remap)
 
          //CAN2 RX and TX IRQs
          nvic_enable_irq(NVIC_CAN2_RX0_IRQ); //CAN RX
-         nvic_set_priority(NVIC_CAN2_RX0_IRQ, 0xf << 4); //lowest priority
+         nvic_set_priority(NVIC_CAN2_RX0_IRQ, CAN_IRQ_PRIORITY);
          nvic_enable_irq(NVIC_CAN2_RX1_IRQ); //CAN RX
-         nvic_set_priority(NVIC_CAN2_RX1_IRQ, 0xf << 4); //lowest priority
+         nvic_set_priority(NVIC_CAN2_RX1_IRQ, CAN_IRQ_PRIORITY);
          nvic_enable_irq(NVIC_CAN2_TX_IRQ); //CAN RX
-         nvic_set_priority(NVIC_CAN2_TX_IRQ, 0xf << 4); //lowest priority
+         nvic_set_priority(NVIC_CAN2_TX_IRQ, CAN_IRQ_PRIORITY);
          interfaces[1] = this;
          break;
    }
@@ -380,6 +548,14 @@ uint32_t Can::GetLastRxTimestamp()
 }
 
 /** \brief Send a user defined CAN message
+ *
+ * If no suitable TX mailbox is free the frame is queued. Frames with an id
+ * below the limit set by SetHighPriorityIdLimit() go to a separate queue
+ * that HandleTx() serves first. Each queue has HandleTx() as its only
+ * consumer. Send() is called from tasks and from the RX interrupt for SDO
+ * replies, so while it adds to a queue it masks interrupts up to
+ * CAN_SEND_PRIORITY. Interrupts of a higher priority, like PWM, are never
+ * held back and must not send.
  *
  * \param canId uint32_t
  * \param data[2] uint32_t
@@ -389,22 +565,68 @@ uint32_t Can::GetLastRxTimestamp()
  */
 void Can::Send(uint32_t canId, uint32_t data[2], uint8_t len)
 {
-   can_disable_irq(canDev, CAN_IER_TMEIE);
-
-   if (can_transmit(canDev, canId, canId > 0x7FF, false, len, (uint8_t*)data) < 0 && sendCnt < SENDBUFFER_LEN)
+   bool highPriority = canId < highPriorityIdLimit;
+   SENDQUEUE* queue = &sendQueues[highPriority ? 0 : 1];
+   uint32_t basepri = cm_raise_basepri(CAN_SEND_PRIORITY);
+   uint32_t head = queue->head;
+   uint32_t next = head + 1 < SENDBUFFER_SLOTS ? head + 1 : 0;
+   uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+   //Only transmit directly when nothing of the same or higher priority is queued, otherwise
+   //the frame would overtake. A high priority frame may overtake queued normal ones.
+   //HandleTx() can not access the mailboxes meanwhile, BASEPRI masks the CAN interrupts
+   bool idle = highPriority ? head == tail : QueuesEmpty();
+
+   if (idle && Transmit(canId, data, len, highPriority))
    {
-      // enqueue in send buffer if all TX mailboxes are full
-      sendBuffer[sendCnt].id = canId;
-      sendBuffer[sendCnt].len = len;
-      sendBuffer[sendCnt].data[0] = data[0];
-      sendBuffer[sendCnt].data[1] = data[1];
-      sendCnt++;
+      cm_restore_basepri(basepri);
+      return;
    }
 
-   if (sendCnt > 0)
+   if (next == tail)
    {
-      can_enable_irq(canDev, CAN_IER_TMEIE);
+      queue->drops++;
+   }
+   else
+   {
+      uint32_t queued = (next + SENDBUFFER_SLOTS - tail) % SENDBUFFER_SLOTS;
+
+      queue->frames[head].id = canId;
+      queue->frames[head].len = len;
+      queue->frames[head].data[0] = data[0];
+      queue->frames[head].data[1] = data[1];
+      __atomic_store_n(&queue->head, next, __ATOMIC_RELEASE);
+
+      if (queued > queue->highWater)
+         queue->highWater = queued;
    }
+
+   can_enable_irq(canDev, CAN_IER_TMEIE);
+   cm_restore_basepri(basepri);
+}
+
+/** \brief Define which frames are sent with high priority
+ *
+ * High priority frames are queued separately and sent first, one TX mailbox
+ * is kept free for them. A limit of 0 (default) treats all frames equally.
+ *
+ * \param idLimit frames with a lower CAN id have high priority
+ */
+void Can::SetHighPriorityIdLimit(uint32_t idLimit)
+{
+   highPriorityIdLimit = idLimit;
+}
+
+/** \return Number of frames dropped because a send queue was full */
+uint32_t Can::GetSendDrops()
+{
+   return sendQueues[0].drops + sendQueues[1].drops;
+}
+
+/** \return Highest number of frames that were waiting in one send queue */
+uint32_t Can::GetSendHighWater()
+{
+   return MAX(sendQueues[0].highWater, sendQueues[1].highWater);
 }
 
 void Can::IterateCanMap(void (*callback)(Param::PARAM_NUM, int, int, int, float, bool))
@@ -417,7 +639,7 @@ void Can::IterateCanMap(void (*callback)(Param::PARAM_NUM, int, int, int, float,
       {
          forEachPosMap(curPos, curMap)
          {
-            callback((Param::PARAM_NUM)curPos->mapParam, curMap->canId, curPos->offsetBits, curPos->numBits, curPos->gain, rx);
+            callback((Param::PARAM_NUM)curPos->mapParam, curMap->canId, curPos->offsetBits, curPos->numBits, GetGain(curPos), rx);
          }
       }
       done = rx;
@@ -434,6 +656,13 @@ Can* Can::GetInterface(int index)
    return 0;
 }
 
+/** \brief Read all frames from an RX FIFO, called by the CAN RX interrupts
+ *
+ * Frames are dispatched right away unless deferred processing was enabled
+ * with SetDeferredRx(). Then they are only copied to the receive queue.
+ * Both RX interrupts must run at the same priority as the queue has only
+ * one producer.
+ */
 void Can::HandleRx(int fifo)
 {
    uint32_t id;
@@ -444,59 +673,181 @@ void Can::HandleRx(int fifo)
    while (can_receive(canDev, fifo, true, &id, &ext, &rtr, &fmi, &length, (uint8_t*)data, NULL) > 0)
    {
       //printf("fifo: %d, id: %x, len: %d, data[0]: %x, data[1]: %x\r\n", fifo, id, length, data[0], data[1]);
-      if (id == (0x600U + nodeId) && length == 8) //SDO request, nodeid=1
+      if (deferredRx)
       {
-         ProcessSDO(data);
+         uint32_t head = recvQueue.head;
+         uint32_t next = head + 1 < RECVBUFFER_SLOTS ? head + 1 : 0;
+         uint32_t tail = __atomic_load_n(&recvQueue.tail, __ATOMIC_ACQUIRE);
+
+         if (next == tail)
+         {
+            recvQueue.drops++;
+         }
+         else
+         {
+            uint32_t queued = (next + RECVBUFFER_SLOTS - tail) % RECVBUFFER_SLOTS;
+            RECVBUFFER* frame = &recvQueue.frames[head];
+
+            frame->id = id;
+            frame->data[0] = data[0];
+            frame->data[1] = data[1];
+            frame->len = length;
+            frame->fifo = fifo;
+            frame->fmi = fmi;
+            frame->ext = ext;
+            __atomic_store_n(&recvQueue.head, next, __ATOMIC_RELEASE);
+
+            if (queued > recvQueue.highWater)
+               recvQueue.highWater = queued;
+         }
       }
       else
       {
-         if (isSaving) continue; //Only handle mapped messages when not currently saving to flash
+         DispatchRx(fifo, fmi, id, ext, length, data);
+      }
+   }
+}
 
-         CANIDMAP *recvMap = FindById(canRecvMap, id);
+/** \brief Dispatch all frames queued since the last call
+ *
+ * Only needed with SetDeferredRx(true). Call it periodically from a single
+ * task, it processes SDO requests, updates mapped parameters and calls the
+ * receive callback from there instead of from the interrupt.
+ */
+void Can::ProcessRx()
+{
+   uint32_t tail = recvQueue.tail;
 
-         if (0 != recvMap)
-         {
-            forEachPosMap(curPos, recvMap)
-            {
-               s32fp val;
-
-               if (curPos->offsetBits > 31)
-               {
-                  val = FP_FROMINT((data[1] >> (curPos->offsetBits - 32)) & ((1 << curPos->numBits) - 1));
-               }
-               else
-               {
-                  val = FP_FROMINT((data[0] >> curPos->offsetBits) & ((1 << curPos->numBits) - 1));
-               }
-               val+= curPos->offset;
-               val*= curPos->gain;
-
-               if (Param::IsParam((Param::PARAM_NUM)curPos->mapParam))
-                  Param::Set((Param::PARAM_NUM)curPos->mapParam, val);
-               else
-                  Param::SetFixed((Param::PARAM_NUM)curPos->mapParam, val);
-            }
-            //lastRxTimestamp = rtc_get_counter_val();
-         }
-         else //Now it must be a user message, as filters block everything else
+   while (tail != __atomic_load_n(&recvQueue.head, __ATOMIC_ACQUIRE))
+   {
+      RECVBUFFER frame = recvQueue.frames[tail];
+
+      //Free the slot before dispatching so the interrupt can reuse it
+      tail = tail + 1 < RECVBUFFER_SLOTS ? tail + 1 : 0;
+      __atomic_store_n(&recvQueue.tail, tail, __ATOMIC_RELEASE);
+
+      DispatchRx(frame.fifo, frame.fmi, frame.id, frame.ext, frame.len, frame.data);
+   }
+}
+
+/** \brief Select where received frames are processed
+ *
+ * \param deferred true: HandleRx() only queues frames and ProcessRx() must be
+ * called to dispatch them, false: frames are dispatched in the interrupt (default)
+ */
+void Can::SetDeferredRx(bool deferred)
+{
+   deferredRx = deferred;
+}
+
+/** \return Number of received frames dropped because the receive queue was full */
+uint32_t Can::GetRecvDrops()
+{
+   return recvQueue.drops;
+}
+
+/** \return Highest number of frames that were waiting in the receive queue */
+uint32_t Can::GetRecvHighWater()
+{
+   return recvQueue.highWater;
+}
+
+void Can::DispatchRx(int fifo, uint8_t fmi, uint32_t id, bool ext, uint8_t length, uint32_t* data)
+{
+   //Extended frames with an id below 0x800 can pass a mask but are not ours
+   int handler = ext && id <= STD_ID_MASK ? (int)RX_NONE : GetHandler(fifo, fmi, id);
+
+   if (handler == RX_SDO && length == 8) //SDO request, nodeid=1
+   {
+      ProcessSDO(data);
+   }
+   else
+   {
+      CANIDMAP *recvMap = handler >= RX_MAP ? &canRecvMap[handler - RX_MAP] : 0;
+
+      if (0 != recvMap)
+      {
+         uint64_t frame = data[0] | ((uint64_t)data[1] << 32);
+
+         //All values of a frame are one write for Param::Snapshot()
+         Param::BeginUpdate();
+
+         forEachPosMap(curPos, recvMap)
          {
-            recvCallback(id, data);
+            s32fp val = FP_FROMINT((uint32_t)((frame >> curPos->offsetBits) & FIELD_MASK(curPos->numBits)));
+
+            val+= curPos->offset;
+
+            Param::SetScaled((Param::PARAM_NUM)curPos->mapParam, val, curPos->fixedGain, curPos->gainDigits);
          }
+
+         Param::EndUpdate();
+         //lastRxTimestamp = rtc_get_counter_val();
+      }
+      else if (handler != RX_NONE) //Now it must be a user message
+      {
+         recvCallback(id, data);
       }
    }
 }
 
 void Can::HandleTx()
 {
-   SENDBUFFER* b = sendBuffer; //alias
+   //Acknowledge completed requests, the interrupt would fire again otherwise
+   CAN_TSR(canDev) = CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2;
+
+   for (int i = 0; i < 2; i++)
+   {
+      SENDQUEUE* queue = &sendQueues[i];
+      uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+      uint32_t tail = queue->tail;
+
+      while (tail != head)
+      {
+         SENDBUFFER* b = &queue->frames[tail];
 
-   while (sendCnt > 0 && can_transmit(canDev, b[sendCnt - 1].id, b[sendCnt - 1].id > 0x7FF, false, b[sendCnt - 1].len, (uint8_t*)b[sendCnt - 1].data) >= 0)
-      sendCnt--;
+         if (!Transmit(b->id, b->data, b->len, i == 0))
+            break;
+
+         //Only release the slot after transmitting so Send() can not use the mailboxes meanwhile
+         tail = tail + 1 < SENDBUFFER_SLOTS ? tail + 1 : 0;
+         __atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+      }
+
+      //Lower priority frames must wait while higher priority ones do
+      if (tail != head) return;
+   }
+
+   can_disable_irq(canDev, CAN_IER_TMEIE);
 
-   if (sendCnt == 0)
+   //A frame queued by an interrupt before the line above would wait for the next Send() otherwise
+   if (!QueuesEmpty())
+      can_enable_irq(canDev, CAN_IER_TMEIE);
+}
+
+bool Can::QueuesEmpty()
+{
+   return __atomic_load_n(&sendQueues[0].head, __ATOMIC_ACQUIRE) == sendQueues[0].tail &&
+          __atomic_load_n(&sendQueues[1].head, __ATOMIC_ACQUIRE) == sendQueues[1].tail;
+}
+
+/** \brief Put frame in a TX mailbox
+ * Normal frames leave one mailbox free when there are high priority frames,
+ * so those never wait behind more than two frames.
+ * \return true if a mailbox accepted the frame
+ */
+bool Can::Transmit(uint32_t canId, uint32_t* data, uint8_t len, bool highPriority)
+{
+   if (!highPriority && highPriorityIdLimit > 0)
    {
-      can_disable_irq(canDev, CAN_IER_TMEIE);
+      uint32_t empty = CAN_TSR(canDev) & CAN_TSR_TME_MASK;
+
+      //At least two mailboxes must be empty
+      if ((empty & (empty - 1)) == 0)
+         return false;
    }
+
+   return can_transmit(canDev, canId, canId > 0x7FF, false, len, (uint8_t*)data) >= 0;
 }
 
 void Can::SDOWrite(uint8_t remoteNodeId, uint16_t index, uint8_t subIndex, uint32_t data)
@@ -581,81 +932,470 @@ void Can::ProcessSDO(uint32_t data[2])
    Can::Send(0x580 + nodeId, data);
 }
 
-void Can::SetFilterBank(int& idIndex, int& filterId, uint16_t* idList)
+void Can::SetFilterBank(int& filterId, int type, const CANFILTER* filters, int count)
 {
-   can_filter_id_list_16bit_init(
-         filterId,
-         idList[0] << 5, //left align
-         idList[1] << 5,
-         idList[2] << 5,
-         idList[3] << 5,
-         filterId & 1,
-         true);
-   idIndex = 0;
+   int fifo = filterId & 1;
+   uint32_t reg[IDS_PER_BANK];
+
+   //Fill unused slots with the first filter so they don't accept anything else
+   for (int i = 0; i < filtersPerBank[type]; i++)
+   {
+      const CANFILTER& f = filters[i < count ? i : 0];
+
+      if (type == STD_LIST || type == STD_MASK)
+         reg[i] = f.id << 5; //left align, RTR and IDE 0
+      else
+         reg[i] = (f.id << 3) | 0x4; //IDE set
+   }
+
+   switch (type)
+   {
+   case STD_LIST:
+      can_filter_id_list_16bit_init(filterId, reg[0], reg[1], reg[2], reg[3], fifo, true);
+      break;
+   case STD_MASK:
+      //Also compare RTR and IDE
+      can_filter_id_mask_16bit_init(filterId,
+            reg[0], (filters[0].mask << 5) | 0x18,
+            reg[1], (filters[count > 1 ? 1 : 0].mask << 5) | 0x18,
+            fifo, true);
+      break;
+   case EXT_LIST:
+      can_filter_id_list_32bit_init(filterId, reg[0], reg[1], fifo, true);
+      break;
+   case EXT_MASK:
+      can_filter_id_mask_32bit_init(filterId, reg[0], (filters[0].mask << 3) | 0x6, fifo, true);
+      break;
+   }
+
+   //Each FIFO numbers the filters of its banks consecutively. Only single
+   //standard ids are recorded, everything else is looked up by GetHandler()
+   for (int i = 0; i < filtersPerBank[type]; i++)
+   {
+      if (fmiCount[fifo] < FMI_ENTRIES)
+      {
+         bool single = type == STD_LIST && i < count;
+         fmiTable[fifo][fmiCount[fifo]].id = single ? filters[i].id : 0;
+         fmiTable[fifo][fmiCount[fifo]].handler = single ? filters[i].handler : (uint16_t)RX_NONE;
+      }
+      fmiCount[fifo]++;
+   }
+
    filterId++;
-   idList[0] = idList[1] = idList[2] = idList[3] = 0;
 }
 
+/** \brief Receive map and filters are derived from canRecvMap, call after changing it
+ *
+ * Every id gets its own filter as long as the filter banks of this interface
+ * suffice. Otherwise ids are merged into mask filters, each time picking the
+ * pair that lets the fewest additional ids through. Frames let through by a
+ * mask are sorted out by GetHandler().
+ *
+ * An SDO that maps a received id runs this in the RX interrupt, so the
+ * filter list is kept in the object and merging is bounded by MergeFilters().
+ */
 void Can::ConfigureFilters()
 {
-   uint16_t idList[IDS_PER_BANK] = { 0, 0, 0, 0 };
-   int idIndex = 1;
-   int filterId = canDev == CAN1 ? 0 : ((CAN_FMR(CAN2) >> 8) & 0x3F);
+   CANFILTER* filters = filterList;
+   int count = 0;
+   //CAN_FMR only exists in CAN1, it also holds the first bank of CAN2
+   int can2Start = (CAN_FMR(CAN1) >> 8) & 0x3F;
+   int firstBank = canDev == CAN1 ? 0 : can2Start;
+   int maxBanks = canDev == CAN1 ? can2Start : FILTER_BANKS - can2Start;
+   int filterId = firstBank;
 
-   idList[0] = 0x600 + nodeId;
+   AddFilter(filters, count, 0x600 + nodeId, RX_SDO);
 
    for (int i = 0; i < nextUserMessageIndex; i++)
+      AddFilter(filters, count, userIds[i], RX_USER);
+
+   forEachCanMap(curMap, canRecvMap)
+      AddFilter(filters, count, curMap->canId, RX_MAP + (curMap - canRecvMap));
+
+   while (CountFilterBanks(filters, count) > maxBanks && MergeFilters(filters, count));
+
+   fmiCount[0] = fmiCount[1] = 0;
+
+   for (int type = 0; type < FILTER_TYPES; type++)
    {
-      idList[idIndex] = userIds[i];
-      idIndex++;
+      CANFILTER bank[IDS_PER_BANK];
+      int idx = 0;
+
+      for (int i = 0; i <= count; i++)
+      {
+         if (i < count && GetFilterType(filters[i]) != type) continue;
+
+         if (i < count)
+            bank[idx++] = filters[i];
+
+         //Full bank or last partially filled one, never spill into the banks of the other interface
+         if ((idx == filtersPerBank[type] || (i == count && idx > 0)) && filterId < firstBank + maxBanks)
+         {
+            SetFilterBank(filterId, type, bank, idx);
+            idx = 0;
+         }
+      }
+   }
+
+   //Switch off banks that were used by a previous configuration
+   for (int i = filterId; i < firstBank + filterBanks; i++)
+      can_filter_init(i, false, false, 0, 0, 0, false);
+
+   filterBanks = filterId - firstBank;
+
+   BuildRecvHash();
+}
+
+/** \brief Insert a filter for a single id, keeping the list sorted by id type and id */
+void Can::AddFilter(CANFILTER* filters, int& count, uint32_t canId, uint16_t handler)
+{
+   bool extended = canId > STD_ID_MASK;
+   int pos = count;
+
+   for (; pos > 0 && (filters[pos - 1].extended > extended ||
+                      (filters[pos - 1].extended == extended && filters[pos - 1].id > canId)); pos--)
+      filters[pos] = filters[pos - 1];
+
+   filters[pos].extended = extended;
+   filters[pos].id = canId;
+   filters[pos].mask = extended ? EXT_ID_MASK : STD_ID_MASK;
+   filters[pos].handler = handler;
+   count++;
+}
+
+int Can::GetFilterType(const CANFILTER& filter)
+{
+   if (filter.extended)
+      return filter.mask == EXT_ID_MASK ? EXT_LIST : EXT_MASK;
+   return filter.mask == STD_ID_MASK ? STD_LIST : STD_MASK;
+}
+
+int Can::CountFilterBanks(const CANFILTER* filters, int count)
+{
+   int perType[FILTER_TYPES] = { 0 };
+   int banks = 0;
+
+   for (int i = 0; i < count; i++)
+      perType[GetFilterType(filters[i])]++;
+
+   for (int type = 0; type < FILTER_TYPES; type++)
+      banks += (perType[type] + filtersPerBank[type] - 1) / filtersPerBank[type];
 
-      if (idIndex == IDS_PER_BANK)
+   return banks;
+}
+
+/** \brief Number of ids a filter lets through */
+uint32_t Can::AcceptedIds(const CANFILTER& filter)
+{
+   int bits = filter.extended ? 29 : 11;
+   return 1UL << (bits - __builtin_popcount(filter.mask));
+}
+
+/** \brief Replace two nearby filters of the same id type by the one that lets the fewest additional ids through
+ *
+ * The list is sorted by id, so ids sharing most upper bits are close to each
+ * other. Each filter is only compared to the next MERGE_WINDOW ones, which
+ * keeps a merge linear in the number of filters instead of quadratic.
+ *
+ * \return false if there were no two filters to merge
+ */
+bool Can::MergeFilters(CANFILTER* filters, int& count)
+{
+   uint32_t bestCost = 0xFFFFFFFF;
+   int bestA = -1, bestB = -1;
+
+   for (int a = 0; a < count; a++)
+   {
+      for (int b = a + 1; b < count && b <= a + MERGE_WINDOW; b++)
       {
-         SetFilterBank(idIndex, filterId, idList);
+         if (filters[a].extended != filters[b].extended) break;
+
+         CANFILTER merged = filters[a];
+         merged.mask = filters[a].mask & filters[b].mask & ~(filters[a].id ^ filters[b].id);
+         uint32_t cost = AcceptedIds(merged) - AcceptedIds(filters[a]) - AcceptedIds(filters[b]);
+
+         //Wraps around when merging overlapping filters, they cost nothing
+         if (cost > AcceptedIds(merged)) cost = 0;
+
+         if (cost < bestCost)
+         {
+            bestCost = cost;
+            bestA = a;
+            bestB = b;
+         }
       }
    }
 
+   if (bestA < 0) return false;
+
+   filters[bestA].mask &= filters[bestB].mask & ~(filters[bestA].id ^ filters[bestB].id);
+   filters[bestA].id &= filters[bestA].mask;
+   filters[bestA].handler = RX_NONE;
+   count--;
+
+   for (int i = bestB; i < count; i++)
+      filters[i] = filters[i + 1];
+
+   return true;
+}
+
+/** \brief Build the hash index of canRecvMap, open addressing with linear probing */
+void Can::BuildRecvHash()
+{
+   for (int i = 0; i < RECV_HASH_SIZE; i++)
+      recvHash[i] = 0;
+
    forEachCanMap(curMap, canRecvMap)
    {
-      idList[idIndex] = curMap->canId;
-      idIndex++;
+      uint32_t slot = HashId(curMap->canId);
 
-      if (idIndex == IDS_PER_BANK)
-      {
-         SetFilterBank(idIndex, filterId, idList);
-      }
+      while (recvHash[slot] != 0)
+         slot = (slot + 1) & (RECV_HASH_SIZE - 1);
+
+      recvHash[slot] = curMap - canRecvMap + 1;
    }
-   //loop terminates before adding last set of filters
-   if (idIndex > 0)
+}
+
+/** \brief Find receive map entry of a CAN id in constant time
+ * \return map entry or 0 if the id is not mapped
+ */
+Can::CANIDMAP* Can::FindRecvMap(uint32_t canId)
+{
+   for (uint32_t slot = HashId(canId); recvHash[slot] != 0; slot = (slot + 1) & (RECV_HASH_SIZE - 1))
    {
-      SetFilterBank(idIndex, filterId, idList);
+      CANIDMAP *curMap = &canRecvMap[recvHash[slot] - 1];
+
+      //Verify as the map may be changing while the hash is rebuilt
+      if (curMap->canId == canId)
+         return curMap;
    }
+   return 0;
+}
+
+/** \brief Find out how to handle a received frame
+ *
+ * The filter match index leads directly to the handler recorded by
+ * SetFilterBank(). If it was a mask filter or its id does not match, e.g.
+ * because the filters are just being reconfigured, the id is looked up instead.
+ *
+ * \return RX_SDO, RX_USER, RX_MAP + receive map index or RX_NONE for ids only let through by a mask
+ */
+int Can::GetHandler(int fifo, uint8_t fmi, uint32_t canId)
+{
+   if (fmi < FMI_ENTRIES && fmiTable[fifo][fmi].handler != RX_NONE && fmiTable[fifo][fmi].id == canId)
+   {
+      int handler = fmiTable[fifo][fmi].handler;
+
+      if (handler < RX_MAP || canRecvMap[handler - RX_MAP].canId == canId)
+         return handler;
+   }
+
+   if (canId == (0x600U + nodeId))
+      return RX_SDO;
+
+#ifdef CAN_RX_LINEAR_SEARCH
+   //Search as done before the hash, only built to benchmark against it
+   CANIDMAP *recvMap = FindById(canRecvMap, canId);
+#else
+   CANIDMAP *recvMap = FindRecvMap(canId);
+#endif // CAN_RX_LINEAR_SEARCH
+
+   if (recvMap != 0)
+      return RX_MAP + (recvMap - canRecvMap);
+
+   for (int i = 0; i < nextUserMessageIndex; i++)
+   {
+      if (userIds[i] == canId)
+         return RX_USER;
+   }
+
+   return RX_NONE;
+}
+
+uint32_t Can::HashId(uint32_t canId)
+{
+   //Fibonacci hashing, the upper bits are the best mixed
+   return (canId * 0x9E3779B1) >> (32 - RECV_HASH_BITS);
 }
 
 int Can::LoadFromFlash()
 {
-   uint32_t data = GetFlashAddress();
-   uint32_t storedCrc = *(uint32_t*)CRC_ADDRESS(data);
-   uint32_t crc;
+   int bank = parm_active_bank();
+
+   //Without a valid parameter page fall back to the first bank like before A/B saving
+   if (bank < 0) bank = 0;
+
+   uint32_t* data = (uint32_t*)parm_get_flash()->GetBank(bank) + GetFlashOffset();
+
+   if (data[0] == CANMAP_MAGIC)
+      return LoadCompact(data);
+
+   //Load the fixed size layout, it is converted to the compact one on the next save
+   if (4 * (LEGACY_CRC_OFFSET + 1) > CAN_BLKSIZE)
+      return 0;
 
    crc_reset();
-   crc = crc_calculate_block((uint32_t*)data, SENDMAP_WORDS + RECVMAP_WORDS);
+   if (crc_calculate_block(data, LEGACY_CRC_OFFSET) != data[LEGACY_CRC_OFFSET])
+      return 0;
+
+   //The layout has no timing, the messages keep their default of sending on every call
+   LoadLegacyMap(data, canSendMap);
+   LoadLegacyMap(data + LEGACY_MAP_WORDS, canRecvMap);
+   ConvertLoadedMap(canSendMap);
+   ConvertLoadedMap(canRecvMap);
+   return 1;
+}
+
+/** \brief Copy one map of the fixed size layout
+ * Messages and items beyond MAX_MESSAGES and MAX_ITEMS_PER_MESSAGE are dropped.
+ */
+void Can::LoadLegacyMap(const uint32_t* data, CANIDMAP *canMap)
+{
+   static_assert(sizeof(CANPOS) == 4 * LEGACY_ITEM_WORDS, "CANPOS must keep the size of the fixed size layout");
 
-   if (storedCrc == crc)
+   for (int i = 0; i < LEGACY_MESSAGES && i < MAX_MESSAGES; i++)
    {
-      memcpy32((int*)canSendMap, (int*)SENDMAP_ADDRESS(data), SENDMAP_WORDS);
-      memcpy32((int*)canRecvMap, (int*)RECVMAP_ADDRESS(data), RECVMAP_WORDS);
-      ReplaceParamUidByEnum(canSendMap);
-      ReplaceParamUidByEnum(canRecvMap);
-      return 1;
+      const uint32_t* record = data + i * (1 + LEGACY_ITEMS * LEGACY_ITEM_WORDS);
+
+      if (record[0] == CANID_UNSET) break;
+
+      canMap[i].canId = record[0];
+
+      for (int j = 0; j < LEGACY_ITEMS && j < MAX_ITEMS_PER_MESSAGE; j++)
+         memcpy32((int*)&canMap[i].items[j], (int*)(record + 1 + j * LEGACY_ITEM_WORDS), LEGACY_ITEM_WORDS);
    }
-   return 0;
+}
+
+/** \brief Load a CAN map in the compact layout
+ * Messages and items beyond MAX_MESSAGES and MAX_ITEMS_PER_MESSAGE are dropped.
+ * \return 1 if the CRC matched, 0 otherwise
+ */
+int Can::LoadCompact(const uint32_t* data)
+{
+   if (data[1] > CANMAP_DATA_WORDS || CalcCompactCrc(data) != data[2])
+      return 0;
+
+   const uint32_t* record = data + CANMAP_HEADER_WORDS;
+   const uint32_t* end = record + data[1];
+   int numSend = 0, numRecv = 0;
+
+   while (end - record >= 2)
+   {
+      bool rx = (record[0] & RECORD_RX_FLAG) != 0;
+      uint32_t headerWords = RECORD_HEADER_WORDS(rx);
+      uint32_t numItems = record[1];
+
+      if ((uint32_t)(end - record) < headerWords || numItems > (end - record - headerWords) / ITEM_WORDS)
+         break;
+
+      CANIDMAP *map = 0;
+
+      if (rx && numRecv < MAX_MESSAGES)
+      {
+         map = &canRecvMap[numRecv++];
+      }
+      else if (!rx && numSend < MAX_MESSAGES)
+      {
+         memcpy32((int*)&canSendSched[numSend], (int*)(record + 2), headerWords - 2);
+         map = &canSendMap[numSend++];
+      }
+
+      if (0 != map)
+      {
+         map->canId = record[0] & ~RECORD_RX_FLAG;
+
+         for (uint32_t i = 0; i < numItems && i < MAX_ITEMS_PER_MESSAGE; i++)
+            memcpy32((int*)&map->items[i], (int*)(record + headerWords + i * ITEM_WORDS), ITEM_WORDS);
+      }
+
+      record += headerWords + numItems * ITEM_WORDS;
+   }
+
+   ConvertLoadedMap(canSendMap);
+   ConvertLoadedMap(canRecvMap);
+   return 1;
+}
+
+uint32_t Can::CalcCompactCrc(const uint32_t* data)
+{
+   crc_reset();
+   crc_calculate_block((uint32_t*)data, 2); //magic and length
+   return crc_calculate_block((uint32_t*)data + CANMAP_HEADER_WORDS, data[1]);
+}
+
+/** \brief Number of words all used messages take in the compact layout */
+uint32_t Can::CompactWords()
+{
+   uint32_t words = 0;
+
+   forEachCanMap(curMap, canSendMap)
+      words += RecordWords(curMap);
+   forEachCanMap(curMap, canRecvMap)
+      words += RecordWords(curMap);
+
+   return words;
+}
+
+uint32_t Can::RecordWords(CANIDMAP *map)
+{
+   uint32_t words = RECORD_HEADER_WORDS(map >= canRecvMap);
+
+   forEachPosMap(curPos, map)
+      words += ITEM_WORDS;
+
+   return words;
+}
+
+/** \brief Get word of the compact record of map */
+uint32_t Can::GetRecordWord(CANIDMAP *map, uint32_t idx)
+{
+   bool rx = map >= canRecvMap;
+   uint32_t headerWords = RECORD_HEADER_WORDS(rx);
+
+   if (idx == 0)
+      return map->canId | (rx ? RECORD_RX_FLAG : 0);
+   if (idx == 1)
+      return (RecordWords(map) - headerWords) / ITEM_WORDS;
+   if (idx < headerWords)
+      return ((uint32_t*)&canSendSched[map - canSendMap])[idx - 2];
+
+   idx -= headerWords;
+   return GetItemWord(&map->items[idx / ITEM_WORDS], idx % ITEM_WORDS);
+}
+
+/** \brief Get the next word of the records SaveStep() programs */
+uint32_t Can::NextRecordWord()
+{
+   //The receive messages follow the last send message
+   if (saveMsg < MAX_MESSAGES && canSendMap[saveMsg].canId == CANID_UNSET)
+      saveMsg = MAX_MESSAGES;
+
+   CANIDMAP *map = saveMsg < MAX_MESSAGES ? &canSendMap[saveMsg] : &canRecvMap[saveMsg - MAX_MESSAGES];
+
+   //Mapping shrunk since SaveStart(), the CRC still matches what is programmed
+   if (saveMsg >= 2 * MAX_MESSAGES || map->canId == CANID_UNSET)
+      return CANID_UNSET;
+
+   uint32_t word = GetRecordWord(map, saveRecordWord);
+
+   saveRecordWord++;
+
+   if (saveRecordWord >= RecordWords(map))
+   {
+      saveMsg++;
+      saveRecordWord = 0;
+   }
+
+   return word;
 }
 
 int Can::RemoveFromMap(CANIDMAP *canMap, Param::PARAM_NUM param)
 {
    CANIDMAP copyMap[MAX_MESSAGES];
 
+   if (canMap == canSendMap)
+      RemoveSched(param);
+
    ClearMap(copyMap);
    int removed = CopyIdMapExcept(canMap, copyMap, param);
    ClearMap(canMap);
@@ -664,13 +1404,56 @@ int Can::RemoveFromMap(CANIDMAP *canMap, Param::PARAM_NUM param)
    return removed;
 }
 
+/** \brief Move send timings along with their messages when RemoveFromMap() drops messages */
+void Can::RemoveSched(Param::PARAM_NUM param)
+{
+   int i = 0;
+
+   forEachCanMap(curMap, canSendMap)
+   {
+      bool keep = false;
+
+      forEachPosMap(curPos, curMap)
+         keep |= curPos->mapParam != param;
+
+      if (keep)
+      {
+         canSendSched[i] = canSendSched[curMap - canSendMap];
+         canSendState[i] = canSendState[curMap - canSendMap];
+         i++;
+      }
+   }
+
+   ResetSched(i);
+}
+
+/** \brief Let all send messages from index start on go out on every SendAll() call */
+void Can::ResetSched(int start)
+{
+   for (int i = start; i < MAX_MESSAGES; i++)
+   {
+      canSendSched[i].period = 1;
+      canSendSched[i].phase = 0;
+      canSendSched[i].minGap = 0;
+      canSendSched[i].reserved = 0;
+      canSendState[i].lastFrame = ~0ULL; //makes the first frame count as changed
+      canSendState[i].callsSinceSent = 0;
+   }
+}
+
 int Can::Add(CANIDMAP *canMap, Param::PARAM_NUM param, int canId, int offsetBits, int length, float gain, int16_t offset)
 {
+   if (isSaving) return CAN_ERR_SAVING;
    if (canId > 0x1fffffff) return CAN_ERR_INVALID_ID;
-   if (offset > 63) return CAN_ERR_INVALID_OFS;
-   if (length > 32) return CAN_ERR_INVALID_LEN;
+   if (offsetBits < 0 || offsetBits > 63) return CAN_ERR_INVALID_OFS;
+   if (length < 1 || length > 32 || offsetBits + length > 64) return CAN_ERR_INVALID_LEN;
 
    CANIDMAP *existingMap = FindById(canMap, canId);
+   uint32_t addedWords = ITEM_WORDS + (0 == existingMap ? RECORD_HEADER_WORDS(canMap == canRecvMap) : 0);
+
+   //Make sure the mapping can still be saved
+   if (CompactWords() + addedWords > CANMAP_DATA_WORDS)
+      return CAN_ERR_MAXITEMS;
 
    if (0 == existingMap)
    {
@@ -683,13 +1466,13 @@ int Can::Add(CANIDMAP *canMap, Param::PARAM_NUM param, int canId, int offsetBits
 
    CANPOS* freeItem = existingMap->items;
 
-   for (; freeItem->numBits > 0; freeItem++);
+   for (; (freeItem - existingMap->items) < MAX_ITEMS_PER_MESSAGE && freeItem->numBits > 0; freeItem++);
 
-   if (freeItem->numBits == NUMBITS_LASTMARKER)
+   if ((freeItem - existingMap->items) == MAX_ITEMS_PER_MESSAGE)
       return CAN_ERR_MAXITEMS;
 
    freeItem->mapParam = param;
-   freeItem->gain = gain;
+   SetGain(freeItem, gain);
    freeItem->offset = offset;
    freeItem->offsetBits = offsetBits;
    freeItem->numBits = length;
@@ -725,20 +1508,6 @@ Can::CANIDMAP* Can::FindById(CANIDMAP *canMap, uint32_t canId)
    return 0;
 }
 
-uint32_t Can::SaveToFlash(uint32_t baseAddress, uint32_t* data, int len)
-{
-   uint32_t crc = 0;
-
-   for (int idx = 0; idx < len; idx++)
-   {
-      crc = crc_calculate(*data);
-      flash_program_word(baseAddress + idx * sizeof(uint32_t), *data);
-      data++;
-   }
-
-   return crc;
-}
-
 int Can::CopyIdMapExcept(CANIDMAP *source, CANIDMAP *dest, Param::PARAM_NUM param)
 {
    int i = 0, removed = 0;
@@ -772,19 +1541,20 @@ int Can::CopyIdMapExcept(CANIDMAP *source, CANIDMAP *dest, Param::PARAM_NUM para
    return removed;
 }
 
-void Can::ReplaceParamEnumByUid(CANIDMAP *canMap)
+/** \brief Get word idx of an item as stored in flash, i.e. with parameter id and float gain */
+uint32_t Can::GetItemWord(const CANPOS *pos, uint32_t idx)
 {
-   forEachCanMap(curMap, canMap)
-   {
-      forEachPosMap(curPos, curMap)
-      {
-         const Param::Attributes* attr = Param::GetAttrib((Param::PARAM_NUM)curPos->mapParam);
-         curPos->mapParam = (uint16_t)attr->id;
-      }
-   }
+   union { CANPOS pos; uint32_t words[ITEM_WORDS]; } flash = { *pos };
+
+   flash.pos.mapParam = Param::GetAttrib((Param::PARAM_NUM)pos->mapParam)->id;
+   flash.pos.gain = GetGain(pos);
+   flash.pos.gainDigits = 0;
+
+   return flash.words[idx];
 }
 
-void Can::ReplaceParamUidByEnum(CANIDMAP *canMap)
+/** \brief Replace parameter ids by enums and pick the gain representation of a map loaded from flash */
+void Can::ConvertLoadedMap(CANIDMAP *canMap)
 {
    forEachCanMap(curMap, canMap)
    {
@@ -792,18 +1562,49 @@ void Can::ReplaceParamUidByEnum(CANIDMAP *canMap)
       {
          Param::PARAM_NUM param = Param::NumFromId(curPos->mapParam);
          curPos->mapParam = param;
+         SetGain(curPos, curPos->gain);
       }
    }
 }
 
-uint32_t Can::GetFlashAddress()
+/** \brief Store gain as an integer scaled by a power of two, exact for any float
+ * gain up to GAIN_MAX_DIGITS fractional bits. Decimal gains like 0.7 need
+ * many fractional bits, Param::GetScaled() and SetScaled() round for them
+ * like float arithmetic. Gains of 2^31 and more saturate. */
+void Can::SetGain(CANPOS *pos, float gain)
+{
+   int digits = 0;
+
+   //Doubling is exact, floats of 2^24 and more are integers
+   while (digits < GAIN_MAX_DIGITS && gain > -16777216.0f && gain < 16777216.0f && gain != (float)(int32_t)gain)
+   {
+      gain *= 2;
+      digits++;
+   }
+
+   if (gain >= 2147483648.0f)
+      pos->fixedGain = INT32_MAX;
+   else if (!(gain >= -2147483648.0f))
+      pos->fixedGain = INT32_MIN;
+   else
+      pos->fixedGain = (int32_t)gain;
+   pos->gainDigits = digits;
+}
+
+float Can::GetGain(const CANPOS *pos)
+{
+   return pos->fixedGain / (float)(1ULL << pos->gainDigits);
+}
+
+/** \brief Get word offset of this interfaces CAN map within a configuration bank */
+uint32_t Can::GetFlashOffset()
 {
    switch (this->canDev)
    {
       case CAN1:
-         return FLASH_CONF_BASE + CAN1_BLKOFFSET;
+         return CAN1_BLKOFFSET / sizeof(uint32_t);
       case CAN2:
-         return FLASH_CONF_BASE + CAN2_BLKOFFSET;
+         return CAN2_BLKOFFSET / sizeof(uint32_t);
    }
    return 0;
 }
@@ -0,0 +1,74 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <libopencm3/stm32/flash.h>
+#include "stm32_flash.h"
+
+Stm32Flash::Stm32Flash(uint32_t address0, uint8_t sector0, uint32_t address1, uint8_t sector1, uint32_t size)
+   : size(size)
+{
+   addresses[0] = address0;
+   addresses[1] = address1;
+   sectors[0] = sector0;
+   sectors[1] = sector1;
+}
+
+void Stm32Flash::EraseBank(int bank)
+{
+   flash_unlock();
+   flash_erase_sector(sectors[bank], FLASH_CR_PROGRAM_X32);
+   flash_lock();
+}
+
+void Stm32Flash::ProgramWord(int bank, uint32_t offset, uint32_t data)
+{
+   flash_unlock();
+   flash_program_word(addresses[bank] + offset * sizeof(uint32_t), data);
+   flash_lock();
+}
+
+/** Same as flash_erase_sector() but returns right after starting the erase.
+ * Note that on single bank devices any flash read, including instruction
+ * fetches, still stalls until the erase has finished. Only code running from
+ * RAM or the ART cache continues.
+ */
+void Stm32Flash::StartErase(int bank)
+{
+   flash_unlock();
+   flash_wait_for_last_operation();
+   flash_set_program_size(FLASH_CR_PROGRAM_X32);
+   FLASH_CR &= ~(FLASH_CR_SNB_MASK << FLASH_CR_SNB_SHIFT);
+   FLASH_CR |= (sectors[bank] & FLASH_CR_SNB_MASK) << FLASH_CR_SNB_SHIFT;
+   FLASH_CR |= FLASH_CR_SER;
+   FLASH_CR |= FLASH_CR_STRT;
+}
+
+bool Stm32Flash::IsBusy()
+{
+   if (FLASH_SR & FLASH_SR_BSY)
+      return true;
+
+   //Finish a completed erase
+   if (FLASH_CR & FLASH_CR_SER)
+   {
+      FLASH_CR &= ~FLASH_CR_SER;
+      FLASH_CR &= ~(FLASH_CR_SNB_MASK << FLASH_CR_SNB_SHIFT);
+      flash_lock();
+   }
+   return false;
+}
@@ -17,7 +17,6 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <libopencm3/cm3/scb.h>
-#include <libopencm3/stm32/flash.h>
 #include "hwdefs.h"
 #include "terminal.h"
 #include "params.h"
@@ -25,6 +24,8 @@
 #include "my_fp.h"
 #include "printf.h"
 #include "param_save.h"
+#include "configsave.h"
+#include "flashbanks.h"
 #include "stm32_can.h"
 #include "terminalcommands.h"
 
@@ -37,6 +38,13 @@ void TerminalCommands::ParamSet(Terminal* term, char* arg)
    Param::PARAM_NUM idx;
 
    arg = my_trim(arg);
+
+   if (',' == *my_strchr(arg, ','))
+   {
+      ParamSetMany(term, arg);
+      return;
+   }
+
    pParamVal = (char *)my_strchr(arg, ' ');
 
    if (*pParamVal == 0)
@@ -263,6 +271,28 @@ void TerminalCommands::PrintParamsJson(Terminal* term, char *arg)
    fprintf(term, "\r\n}\r\n");
 }
 
+//Prints values changed after the given generation, start with 0 for all values
+void TerminalCommands::PrintChangedJson(Terminal* term, char *arg)
+{
+   arg = my_trim(arg);
+
+   uint32_t since = my_atoi(arg);
+   //Take generation first, changes made while printing show up again next time
+   uint32_t generation = Param::GetGeneration();
+
+   fprintf(term, "{\r\n   \"generation\": %u", generation);
+
+   for (int idx = Param::NextChanged(0, since); idx < Param::PARAM_LAST; idx = Param::NextChanged(idx + 1, since))
+   {
+      if ((Param::GetFlag((Param::PARAM_NUM)idx) & Param::FLAG_HIDDEN) == 0)
+      {
+         const Param::Attributes *pAtr = Param::GetAttrib((Param::PARAM_NUM)idx);
+         fprintf(term, ",\r\n   \"%s\": {\"value\":%f}", pAtr->name, Param::Get((Param::PARAM_NUM)idx));
+      }
+   }
+   fprintf(term, "\r\n}\r\n");
+}
+
 //cantx param id offset len gain
 void TerminalCommands::MapCan(Can* can, Terminal* term, char *arg)
 {
@@ -287,8 +317,16 @@ void TerminalCommands::MapCan(Can* can, Terminal* term, char *arg)
 
    if (arg[0] == 'c')
    {
-      can->Clear();
-      fprintf(term, "All message definitions cleared\r\n");
+      if (can->Clear() == CAN_ERR_SAVING)
+         fprintf(term, "Saving, try again later\r\n");
+      else
+         fprintf(term, "All message definitions cleared\r\n");
+      return;
+   }
+
+   if (arg[0] == 'i')
+   {
+      MapCanTiming(can, term, arg + 1);
       return;
    }
 
@@ -323,7 +361,10 @@ void TerminalCommands::MapCan(Can* can, Terminal* term, char *arg)
    if (op == 'd')
    {
       result = can->Remove(paramIdx);
-      fprintf(term, "%d entries removed\r\n", result);
+      if (result == CAN_ERR_SAVING)
+         fprintf(term, "Saving, try again later\r\n");
+      else
+         fprintf(term, "%d entries removed\r\n", result);
       return;
    }
 
@@ -380,23 +421,137 @@ void TerminalCommands::MapCan(Can* can, Terminal* term, char *arg)
       case CAN_ERR_MAXMESSAGES:
          fprintf(term, "Max message count reached\r\n");
          break;
+      case CAN_ERR_SAVING:
+         fprintf(term, "Saving, try again later\r\n");
+         break;
       default:
          fprintf(term, "CAN map successful, %d message%s active\r\n", result, result > 1 ? "s" : "");
    }
 }
 
+//can i id [period phase mingap]
+void TerminalCommands::MapCanTiming(Can* can, Terminal* term, char *arg)
+{
+   const int numArgs = 4;
+   int values[numArgs];
+   int numValues = 0;
+
+   for (arg = my_trim(arg); *arg != 0 && numValues < numArgs; numValues++)
+   {
+      char *ending = (char *)my_strchr(arg, ' ');
+      bool last = 0 == *ending;
+
+      *ending = 0;
+      values[numValues] = my_atoi(arg);
+      arg = last ? ending : my_trim(ending + 1);
+   }
+
+   if (numValues == 1)
+   {
+      int period, phase, minGap;
+
+      if (can->GetSendTiming(values[0], period, phase, minGap))
+         fprintf(term, "period %d phase %d mingap %d\r\n", period, phase, minGap);
+      else
+         fprintf(term, "Unknown CAN Id %d\r\n", values[0]);
+   }
+   else if (numValues == numArgs)
+   {
+      switch (can->SetSendTiming(values[0], values[1], values[2], values[3]))
+      {
+         case CAN_ERR_INVALID_ID:
+            fprintf(term, "Unknown CAN Id %d\r\n", values[0]);
+            break;
+         case CAN_ERR_INVALID_TIMING:
+            fprintf(term, "Invalid timing\r\n");
+            break;
+         case CAN_ERR_SAVING:
+            fprintf(term, "Saving, try again later\r\n");
+            break;
+         default:
+            fprintf(term, "CAN timing set\r\n");
+      }
+   }
+   else
+   {
+      fprintf(term, "Missing argument\r\n");
+   }
+}
+
 void TerminalCommands::SaveParameters(Terminal* term, char *arg)
 {
    arg = arg;
-   //We use the second 16k sector for saving configuration data
-   flash_unlock();
-   flash_erase_sector(1, 2);
-   Can::GetInterface(0)->Save();
-   Can::GetInterface(1)->Save();
-   fprintf(term, "CANMAP stored\r\n");
+
+   if (ConfigSave::IsBusy())
+   {
+      fprintf(term, "Background save in progress\r\n");
+      return;
+   }
+
+#ifdef PARAM_SAVE_JOURNAL
+   //The parameters go to the journal, the sector only needs erasing for changed CAN maps
+   bool saveMaps = !ConfigSave::CanMapsSaved();
+#else
+   bool saveMaps = true;
+#endif // PARAM_SAVE_JOURNAL
+
+   //Size the page before erasing anything
+   parm_save_start();
+
+   if (parm_save_step(0) == PARAM_SAVE_ERR_FULL)
+   {
+      fprintf(term, "Parameters do not fit the flash page, not stored\r\n");
+      return;
+   }
+
+   if (saveMaps)
+   {
+      //Save to the configuration bank that is currently not in use, if there is a second one
+      parm_get_flash()->EraseBank(parm_save_bank());
+
+      for (int i = 0; i < 2; i++)
+      {
+         if (Can::GetInterface(i) != 0)
+            Can::GetInterface(i)->Save();
+      }
+      fprintf(term, "CANMAP stored\r\n");
+   }
+
+#ifdef PARAM_SAVE_JOURNAL
+   int records = parm_save();
+   fprintf(term, "Parameters stored, %d records\r\n", records);
+#else
    uint32_t crc = parm_save();
-   fprintf(term, "Parameters stored, CRC=%x\r\n", crc);
-   flash_lock();
+
+   if (parm_save_step(0) == PARAM_SAVE_ERR_FULL)
+      fprintf(term, "Parameters do not fit the flash page, not stored\r\n");
+   else
+      fprintf(term, "Parameters stored, CRC=%x\r\n", crc);
+#endif // PARAM_SAVE_JOURNAL
+}
+
+/** \brief Start saving parameters and CAN maps in the background
+ * Calling it again while the save is running prints its progress, once
+ * done it reports a failed save before starting the next one.
+ * Requires ConfigSave::Run() to be called periodically.
+ */
+void TerminalCommands::SaveParametersBackground(Terminal* term, char *arg)
+{
+   arg = arg;
+
+   if (ConfigSave::IsBusy())
+   {
+      fprintf(term, "Saving, %d%% done\r\n", ConfigSave::GetProgress());
+      return;
+   }
+
+   if (ConfigSave::HasFailed())
+      fprintf(term, "Last save failed, parameters do not fit the flash page\r\n");
+
+   if (ConfigSave::Start())
+      fprintf(term, "Saving in background\r\n");
+   else
+      fprintf(term, "Parameters do not fit the flash page, not stored\r\n");
 }
 
 void TerminalCommands::LoadParameters(Terminal* term, char *arg)
@@ -420,6 +575,64 @@ void TerminalCommands::Reset(Terminal* term, char *arg)
    scb_reset_system();
 }
 
+//set name1 val1,name2 val2,... all values are checked first, then applied at once
+void TerminalCommands::ParamSetMany(Terminal* term, char* arg)
+{
+   char* comma;
+   char orig;
+
+   Param::BeginBatch();
+
+   do
+   {
+      comma = (char*)my_strchr(arg, ',');
+      orig = *comma;
+      *comma = 0;
+
+      char* name = my_trim(arg);
+      char* pParamVal = (char *)my_strchr(name, ' ');
+
+      if (*pParamVal == 0)
+      {
+         fprintf(term, "No parameter value given for %s\r\n", name);
+         Param::AbortBatch();
+         return;
+      }
+
+      *pParamVal = 0;
+      pParamVal++;
+
+      Param::PARAM_NUM idx = Param::NumFromString(name);
+
+      if (Param::PARAM_INVALID == idx)
+      {
+         fprintf(term, "Unknown parameter %s\r\n", name);
+         Param::AbortBatch();
+         return;
+      }
+
+      int result = Param::AddToBatch(idx, fp_atoi(my_trim(pParamVal), FRAC_DIGITS));
+
+      if (result == -1)
+      {
+         fprintf(term, "Value out of range for %s\r\n", name);
+         Param::AbortBatch();
+         return;
+      }
+      else if (result == -2)
+      {
+         fprintf(term, "Too many parameters\r\n");
+         Param::AbortBatch();
+         return;
+      }
+
+      arg = comma + 1;
+   } while (',' == orig);
+
+   Param::CommitBatch();
+   fprintf(term, "Set OK\r\n");
+}
+
 void TerminalCommands::PrintCanMap(Param::PARAM_NUM param, int canid, int offset, int length, float gain, bool rx)
 {
    const char* name = Param::GetAttrib(param)->name;
@@ -0,0 +1,48 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAM_PRJ_H_INCLUDED
+#define PARAM_PRJ_H_INCLUDED
+
+/* Parameter list of the benchmarks, generated by nesting. Names share long
+ * prefixes like in the projects, e.g. boostaab, boostaac. Parameter ids
+ * start at 1, ids of values at 2049, so the sorted id table is used.
+ * BENCH_SIZE 1: 64 parameters and 16 values
+ * BENCH_SIZE 2: 256 parameters and 64 values
+ */
+#define BENCH_PARAM(name, id) PARAM_ENTRY("Bench", name, "", 0, 1000, 1, id)
+#define BENCH_VALUE(name, id) VALUE_ENTRY(name, "", id)
+
+#define BENCH_4(e, n, id)  e(n##a, 4 * (id) + 1) e(n##b, 4 * (id) + 2) e(n##c, 4 * (id) + 3) e(n##d, 4 * (id) + 4)
+#define BENCH_16(e, n, id) BENCH_4(e, n##a, 4 * (id)) BENCH_4(e, n##b, 4 * (id) + 1) BENCH_4(e, n##c, 4 * (id) + 2) BENCH_4(e, n##d, 4 * (id) + 3)
+#define BENCH_64(e, n, id) BENCH_16(e, n##a, 4 * (id)) BENCH_16(e, n##b, 4 * (id) + 1) BENCH_16(e, n##c, 4 * (id) + 2) BENCH_16(e, n##d, 4 * (id) + 3)
+
+#if BENCH_SIZE == 1
+#define PARAM_LIST \
+    BENCH_64(BENCH_PARAM, boost, 0) \
+    BENCH_16(BENCH_VALUE, udc, 128)
+#else
+#define PARAM_LIST \
+    BENCH_64(BENCH_PARAM, boost, 0) \
+    BENCH_64(BENCH_PARAM, fweak, 1) \
+    BENCH_64(BENCH_PARAM, ocurlim, 2) \
+    BENCH_64(BENCH_PARAM, throtmax, 3) \
+    BENCH_64(BENCH_VALUE, udc, 32)
+#endif
+
+#endif // PARAM_PRJ_H_INCLUDED
@@ -0,0 +1,144 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Benchmark of the item packing of SendAll() and unpacking of DispatchRx(),
+ * through one 64 bit frame word like now and through two 32 bit words with
+ * a branch per item like before. The items don't cross bit 32 and are
+ * shorter than 32 bits, which the old code could not handle. */
+#include "hosttest.h"
+
+#define ROUNDS 1000000
+#define NUM_ITEMS 8
+#define FIELD_MASK(n) ((1ULL << (n)) - 1)
+
+struct Item
+{
+   uint8_t offsetBits;
+   uint8_t numBits;
+};
+
+static const Item items[NUM_ITEMS] =
+{
+   { 0, 16 }, { 16, 12 }, { 28, 4 }, { 32, 8 }, { 40, 8 }, { 48, 1 }, { 49, 7 }, { 56, 8 }
+};
+
+static uint64_t __attribute__((noinline)) Pack64(const uint32_t* values)
+{
+   uint64_t frame = 0;
+
+   for (int i = 0; i < NUM_ITEMS; i++)
+      frame |= (values[i] & FIELD_MASK(items[i].numBits)) << items[i].offsetBits;
+
+   return frame;
+}
+
+static uint64_t __attribute__((noinline)) PackTwoWords(const uint32_t* values)
+{
+   uint32_t data[2] = { 0, 0 };
+
+   for (int i = 0; i < NUM_ITEMS; i++)
+   {
+      uint32_t val = values[i] & ((1 << items[i].numBits) - 1);
+
+      if (items[i].offsetBits > 31)
+         data[1] |= val << (items[i].offsetBits - 32);
+      else
+         data[0] |= val << items[i].offsetBits;
+   }
+   return data[0] | ((uint64_t)data[1] << 32);
+}
+
+static uint32_t __attribute__((noinline)) Unpack64(const uint32_t* data)
+{
+   uint64_t frame = data[0] | ((uint64_t)data[1] << 32);
+   uint32_t sum = 0;
+
+   for (int i = 0; i < NUM_ITEMS; i++)
+      sum += (uint32_t)((frame >> items[i].offsetBits) & FIELD_MASK(items[i].numBits)) * (i + 1);
+
+   return sum;
+}
+
+static uint32_t __attribute__((noinline)) UnpackTwoWords(const uint32_t* data)
+{
+   uint32_t sum = 0;
+
+   for (int i = 0; i < NUM_ITEMS; i++)
+   {
+      uint32_t val;
+
+      if (items[i].offsetBits > 31)
+         val = (data[1] >> (items[i].offsetBits - 32)) & ((1 << items[i].numBits) - 1);
+      else
+         val = (data[0] >> items[i].offsetBits) & ((1 << items[i].numBits) - 1);
+
+      sum += val * (i + 1);
+   }
+   return sum;
+}
+
+int main()
+{
+   uint32_t values[NUM_ITEMS] = { 0x1234, 0xABC, 0x5, 0x7F, 0x80, 1, 0x33, 0xEE };
+   uint64_t start, twoNs, oneNs, check = 0;
+   uint32_t sum = 0;
+
+   CHECK(Pack64(values) == PackTwoWords(values));
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      values[0] = round;
+      check += PackTwoWords(values);
+   }
+   twoNs = NowNs() - start;
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      values[0] = round;
+      check -= Pack64(values);
+   }
+   oneNs = NowNs() - start;
+
+   CHECK(check == 0);
+   printf("Pack %d items: two words %.1f ns, 64 bit word %.1f ns per frame\n", NUM_ITEMS,
+          (double)twoNs / ROUNDS, (double)oneNs / ROUNDS);
+
+   start = NowNs();
+   for (uint32_t round = 0; round < ROUNDS; round++)
+   {
+      uint32_t data[2] = { round * 0x9E3779B1, round };
+      sum += UnpackTwoWords(data);
+   }
+   twoNs = NowNs() - start;
+
+   start = NowNs();
+   for (uint32_t round = 0; round < ROUNDS; round++)
+   {
+      uint32_t data[2] = { round * 0x9E3779B1, round };
+      sum -= Unpack64(data);
+   }
+   oneNs = NowNs() - start;
+
+   CHECK(sum == 0);
+   printf("Unpack %d items: two words %.1f ns, 64 bit word %.1f ns per frame\n", NUM_ITEMS,
+          (double)twoNs / ROUNDS, (double)oneNs / ROUNDS);
+
+   return TestResult("bench_can_pack");
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Benchmark of the RX interrupt per mapped frame against the number of
+ * mapped ids, built with MAX_MESSAGES 128. With enough filter banks each id
+ * has its own filter and the match index leads to the map, with a single
+ * bank all ids pass a mask and are looked up in the hash. Built with
+ * CAN_RX_LINEAR_SEARCH the lookup searches the receive map like before the
+ * hash, the single bank column then times that. The time the model takes to
+ * filter and hand out a frame is subtracted. */
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+#define ROUNDS 200
+
+static RamFlash flash(16384);
+static uint32_t ids[MAX_MESSAGES];
+
+static Can* Init(int numIds, int can2Start)
+{
+   Can* can = HostCan::Boot(&flash, CAN1, can2Start);
+
+   for (int i = 0; i < numIds; i++)
+      CHECK(can->AddRecv(Param::udc, ids[i], 0, 16, 1) == i + 1);
+
+   return can;
+}
+
+/** @return ns per frame, each mapped id received once per round */
+static double TimeRx(Can* can, int numIds)
+{
+   uint64_t start = NowNs();
+
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      for (int i = 0; i < numIds; i++)
+      {
+         uint32_t data[2] = { (uint32_t)i, 0 };
+         can->HandleRx(HostCan::Receive(CAN1, ids[i], false, data));
+      }
+   }
+
+   uint64_t rxNs = NowNs() - start;
+
+   CHECK(Param::GetInt(Param::udc) == numIds - 1);
+
+   //Same frames, only taken out of the FIFO
+   start = NowNs();
+
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      for (int i = 0; i < numIds; i++)
+      {
+         uint32_t id, data[2] = { (uint32_t)i, 0 };
+         bool ext, rtr;
+         uint8_t fmi, len;
+
+         can_receive(CAN1, HostCan::Receive(CAN1, ids[i], false, data), true, &id, &ext, &rtr, &fmi, &len, (uint8_t*)data, 0);
+      }
+   }
+
+   uint64_t modelNs = NowNs() - start;
+
+   return ((double)rxNs - modelNs) / (ROUNDS * numIds);
+}
+
+int main()
+{
+   const int sizes[] = { 1, 10, 32, 100, MAX_MESSAGES };
+
+   for (int i = 0; i < MAX_MESSAGES; i++)
+      ids[i] = 0x100 + i * 13;
+
+#ifdef CAN_RX_LINEAR_SEARCH
+   printf("ids  linear search\n");
+#else
+   printf("ids  filter match  hash lookup\n");
+#endif // CAN_RX_LINEAR_SEARCH
+
+   for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+   {
+      int n = sizes[s];
+      double maskNs = TimeRx(Init(n, 1), n);
+
+#ifdef CAN_RX_LINEAR_SEARCH
+      printf("%3d  %10.1f ns\n", n, maskNs);
+#else
+      //27 list banks hold 108 ids and the SDO id
+      if (n <= 100)
+         printf("%3d  %9.1f ns  %8.1f ns\n", n, TimeRx(Init(n, 27), n), maskNs);
+      else
+         printf("%3d  %12s  %8.1f ns\n", n, "-", maskNs);
+#endif // CAN_RX_LINEAR_SEARCH
+   }
+
+   return TestResult("bench_can_rx");
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Benchmark of Can::Send() straight into a mailbox and through the send
+ * queue and HandleTx(), including interrupt masking, and of SendAll()
+ * packing a frame of exact and inexact gains with negative values. The
+ * times include the bxCAN model, so they compare paths rather than predict
+ * target cycles. */
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+#define ROUNDS 100000
+
+int main()
+{
+   RamFlash flash(16384);
+   uint32_t data[2] = { 0x12345678, 0x9ABCDEF0 };
+   uint64_t start, directNs, queuedNs, sendAllNs;
+   long frames = 0;
+
+   Can* can = HostCan::Boot(&flash);
+
+   //Idle bus, every frame finds an empty mailbox
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      can->Send(0x100, data);
+      frames += HostCan::Transmit(CAN1);
+   }
+   directNs = NowNs() - start;
+
+   CHECK(frames == ROUNDS);
+   CHECK(can->GetSendHighWater() == 0);
+
+   //Mailboxes full, bursts of SENDBUFFER_LEN frames wait for the TX interrupt
+   for (int i = 0; i < 3; i++)
+      can->Send(0x100, data);
+
+   frames = 0;
+   start = NowNs();
+   for (int round = 0; round < ROUNDS / SENDBUFFER_LEN; round++)
+   {
+      for (int i = 0; i < SENDBUFFER_LEN; i++)
+         can->Send(0x100 + i, data);
+
+      for (int i = 0; i < SENDBUFFER_LEN; i++)
+      {
+         frames += HostCan::Transmit(CAN1);
+         can->HandleTx();
+      }
+   }
+   queuedNs = NowNs() - start;
+
+   CHECK(frames == ROUNDS / SENDBUFFER_LEN * SENDBUFFER_LEN);
+   CHECK(can->GetSendDrops() == 0);
+   CHECK(can->GetSendHighWater() == SENDBUFFER_LEN);
+
+   printf("Send: direct %.1f ns, queued and sent by HandleTx %.1f ns per frame\n",
+          (double)directNs / ROUNDS, (double)queuedNs / frames);
+
+   //Same items as bench_scaling, the gains of 0.1 and -0.3 take the float path
+   can->Clear();
+   can->AddSend(Param::udc, 0x200, 0, 16, 1);
+   can->AddSend(Param::idc, 0x200, 16, 16, 0.1, -100);
+   can->AddSend(Param::speed, 0x200, 32, 16, 0.5);
+   can->AddSend(Param::tmphs, 0x200, 48, 8, 1, 40);
+   can->AddSend(Param::boost, 0x200, 56, 8, -0.3);
+   Param::SetFixed(Param::udc, FP_FROMFLT(398.5));
+   Param::SetFixed(Param::idc, FP_FROMFLT(-12.25));
+   Param::SetFixed(Param::tmphs, FP_FROMFLT(-20));
+   Param::SetFixed(Param::boost, FP_FROMFLT(15.5));
+
+   //Empty the mailboxes left full above
+   while (HostCan::Transmit(CAN1))
+      can->HandleTx();
+
+   frames = 0;
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      Param::SetFixed(Param::speed, -round);
+      can->SendAll();
+      frames += HostCan::Transmit(CAN1);
+   }
+   sendAllNs = NowNs() - start;
+
+   CHECK(frames == ROUNDS);
+   printf("SendAll, 5 items: %.1f ns per frame, %.1f ns of it packing\n",
+          (double)sendAllNs / ROUNDS, (double)(sendAllNs - directNs) / ROUNDS);
+
+   return TestResult("bench_can_send");
+}
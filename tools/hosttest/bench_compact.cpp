@@ -0,0 +1,131 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Benchmark of the compact parameter page size, built with PARAM_SAVE_COMPACT
+ * for each BENCH_SIZE of bench/param_prj.h. A share of the parameters is set
+ * to random integers within their range, some hidden, like a tuned
+ * configuration. The fixed size page always needs 8 bytes per parameter.
+ * It only fails if a page that fits does not load as saved.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "hosttest.h"
+#include "hwdefs.h"
+#include "params.h"
+#include "param_save.h"
+
+#define ROUNDS 100
+#define SECTOR_SIZE 16384
+
+static RamFlash flash(SECTOR_SIZE);
+
+static void Configure(int percent, int round)
+{
+   srand(round);
+
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, 0);
+   Param::LoadDefaults();
+
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      Param::PARAM_NUM param = (Param::PARAM_NUM)i;
+      const Param::Attributes* attr = Param::GetAttrib(param);
+
+      if (!Param::IsParam(param) || rand() % 100 >= percent) continue;
+
+      Param::SetFixed(param, attr->min + FP_FROMINT(rand() % FP_TOINT(attr->max - attr->min + FP_FROMINT(1))));
+      if (rand() % 8 == 0)
+         Param::SetFlagsRaw(param, Param::FLAG_HIDDEN);
+   }
+}
+
+/** @return true if all parameters equal the values */
+static bool Equal(const s32fp* values)
+{
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      if (Param::IsParam((Param::PARAM_NUM)i) && values[i] != Param::Get((Param::PARAM_NUM)i))
+         return false;
+   }
+   return true;
+}
+
+int main()
+{
+   const int percents[] = { 0, 10, 25, 50, 100 };
+   int numParams = 0;
+
+   parm_set_flash(&flash);
+
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+      numParams += Param::IsParam((Param::PARAM_NUM)i);
+
+   printf("%d parameters, fixed size page %d bytes, %d available\n", numParams, 8 * numParams + 8, PARAM_BLKSIZE);
+
+   for (unsigned p = 0; p < sizeof(percents) / sizeof(percents[0]); p++)
+   {
+      uint32_t bytes = 0, maxBytes = 0;
+      uint64_t saveNs = 0, loadNs = 0;
+      int full = 0;
+
+      for (int round = 0; round < ROUNDS; round++)
+      {
+         s32fp values[Param::PARAM_LAST];
+
+         Configure(percents[p], round);
+         for (int i = 0; i < Param::PARAM_LAST; i++)
+            values[i] = Param::Get((Param::PARAM_NUM)i);
+         flash.EraseBank(0);
+
+         uint64_t start = NowNs();
+         parm_save();
+         saveNs += NowNs() - start;
+
+         if (parm_save_step(0) == PARAM_SAVE_ERR_FULL)
+         {
+            full++;
+            continue;
+         }
+
+         //Header and data
+         uint32_t length = 16 + flash.GetBank(0)[PARAM_BLKOFFSET / 4 + 2];
+         bytes += length;
+         if (length > maxBytes) maxBytes = length;
+
+         Param::LoadDefaults();
+         start = NowNs();
+         CHECK(parm_load() == 0);
+         loadNs += NowNs() - start;
+         CHECK(Equal(values));
+      }
+
+      if (full < ROUNDS)
+      {
+         printf("%3d%% changed: %.0f bytes average, %u worst, %d of %d do not fit, save %.1f us, load %.1f us\n",
+                percents[p], (double)bytes / (ROUNDS - full), maxBytes, full, ROUNDS,
+                saveNs / (ROUNDS * 1000.0), loadNs / ((ROUNDS - full) * 1000.0));
+      }
+      else
+      {
+         printf("%3d%% changed: none of %d fit\n", percents[p], ROUNDS);
+      }
+   }
+
+   return TestResult("bench_compact");
+}
@@ -0,0 +1,194 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Benchmark of the parameter journal against the full page parm_save(),
+ * built without PARAM_SAVE_JOURNAL for each BENCH_SIZE of bench/param_prj.h.
+ * Each save changes a number of random parameters within their range. The
+ * page is erased and programmed entirely like TerminalCommands does it, the
+ * journal only appends the changes and compacts when its bank is full.
+ * Counted are programmed words and erases per save and the host time of a
+ * save, which for the journal includes replaying it to find the changes.
+ * It only fails if the last state does not load from either of them, the
+ * page only holds the first PAGE_PARAMS parameters of the larger list.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "hosttest.h"
+#include "hwdefs.h"
+#include "params.h"
+#include "param_save.h"
+#include "param_journal.h"
+
+#define SAVES 1000
+#define SECTOR_SIZE 16384
+#define PAGE_PARAMS ((PARAM_BLKSIZE - 8) / 8) //the page stores at most this many
+
+#ifdef PARAM_SAVE_JOURNAL
+#error Build without PARAM_SAVE_JOURNAL, the journal is used directly
+#endif
+
+/** RamFlash that counts programmed words and erases */
+class CountingFlash: public RamFlash
+{
+public:
+   CountingFlash() : RamFlash(SECTOR_SIZE), programmed(0), erases(0) {}
+
+   void EraseBank(int bank) { erases++; RamFlash::EraseBank(bank); }
+
+   void ProgramWord(int bank, uint32_t offset, uint32_t value)
+   {
+      programmed++;
+      RamFlash::ProgramWord(bank, offset, value);
+   }
+
+   long programmed;
+   long erases;
+};
+
+struct Result
+{
+   long programmed;
+   long erases;
+   uint64_t ns;
+};
+
+static void LoadDefaults()
+{
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, 0);
+   Param::LoadDefaults();
+}
+
+/** Set changes random parameters to random integers within their range */
+static void Change(int changes)
+{
+   for (int n = 0; n < changes; n++)
+   {
+      Param::PARAM_NUM param;
+
+      do
+         param = (Param::PARAM_NUM)(rand() % Param::PARAM_LAST);
+      while (!Param::IsParam(param));
+
+      const Param::Attributes* attr = Param::GetAttrib(param);
+      Param::SetFixed(param, attr->min + FP_FROMINT(rand() % FP_TOINT(attr->max - attr->min + FP_FROMINT(1))));
+   }
+}
+
+/** @return true if the first count parameters equal the values */
+static bool Equal(const s32fp* values, int count)
+{
+   for (int i = 0; i < count; i++)
+   {
+      if (Param::IsParam((Param::PARAM_NUM)i) && values[i] != Param::Get((Param::PARAM_NUM)i))
+         return false;
+   }
+   return true;
+}
+
+static void Capture(s32fp* values)
+{
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+      values[i] = Param::Get((Param::PARAM_NUM)i);
+}
+
+static Result SavePages(int changes)
+{
+   CountingFlash flash;
+   s32fp values[Param::PARAM_LAST];
+   Result result = { 0, 0, 0 };
+
+   parm_set_flash(&flash);
+   LoadDefaults();
+   srand(changes);
+
+   for (int save = 0; save < SAVES; save++)
+   {
+      Change(changes);
+
+      uint64_t start = NowNs();
+      flash.EraseBank(parm_save_bank());
+      parm_save();
+      result.ns += NowNs() - start;
+   }
+
+   result.programmed = flash.programmed;
+   result.erases = flash.erases;
+
+   Capture(values);
+   LoadDefaults();
+   CHECK(parm_load() == 0);
+   CHECK(Equal(values, PAGE_PARAMS < Param::PARAM_LAST ? PAGE_PARAMS : Param::PARAM_LAST));
+
+   return result;
+}
+
+static Result SaveJournal(int changes)
+{
+   CountingFlash flash;
+   ParamJournal journal(&flash);
+   s32fp values[Param::PARAM_LAST];
+   Result result = { 0, 0, 0 };
+
+   LoadDefaults();
+   srand(changes);
+
+   for (int save = 0; save < SAVES; save++)
+   {
+      Change(changes);
+
+      uint64_t start = NowNs();
+      journal.Save();
+      result.ns += NowNs() - start;
+   }
+
+   result.programmed = flash.programmed;
+   result.erases = flash.erases;
+
+   Capture(values);
+   LoadDefaults();
+   ParamJournal loader(&flash);
+   CHECK(loader.Load() == 0);
+   CHECK(Equal(values, Param::PARAM_LAST));
+
+   return result;
+}
+
+int main()
+{
+   const int changes[] = { 1, 5, 20 };
+   int numParams = 0;
+
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+      numParams += Param::IsParam((Param::PARAM_NUM)i);
+
+   printf("%d parameters, %d saves, %d byte banks\n", numParams, SAVES, SECTOR_SIZE);
+   printf("changes  page: words  erases  us/save    journal: words  erases  us/save\n");
+
+   for (unsigned c = 0; c < sizeof(changes) / sizeof(changes[0]); c++)
+   {
+      Result page = SavePages(changes[c]);
+      Result journal = SaveJournal(changes[c]);
+
+      printf("%7d  %12.1f  %6.3f  %7.2f  %15.1f  %6.3f  %7.2f\n", changes[c],
+             (double)page.programmed / SAVES, (double)page.erases / SAVES, page.ns / (SAVES * 1000.0),
+             (double)journal.programmed / SAVES, (double)journal.erases / SAVES, journal.ns / (SAVES * 1000.0));
+   }
+
+   return TestResult("bench_journal");
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Benchmark of the parameter lookups against the linear scans they replaced,
+ * built for each BENCH_SIZE of bench/param_prj.h. The id lookup is measured
+ * like parm_load() uses it, all ids of a page at once. */
+#include "hosttest.h"
+#include "params.h"
+#include "my_string.h"
+
+#define ROUNDS 200
+
+void parm_Change(Param::PARAM_NUM) {}
+
+/** NumFromString() as it was before the hash table */
+static Param::PARAM_NUM LinearFromString(const char *name)
+{
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      if (0 == my_strcmp(Param::GetAttrib((Param::PARAM_NUM)idx)->name, name))
+         return (Param::PARAM_NUM)idx;
+   }
+   return Param::PARAM_INVALID;
+}
+
+/** NumFromId() as it was before the id table */
+static Param::PARAM_NUM LinearFromId(uint32_t id)
+{
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      if (Param::GetAttrib((Param::PARAM_NUM)idx)->id == id)
+         return (Param::PARAM_NUM)idx;
+   }
+   return Param::PARAM_INVALID;
+}
+
+int main()
+{
+   //Same mix as a terminal "get", every name once plus some unknown ones
+   const char* unknown[] = { "boostzzz", "fweakzzz", "nonexistent", "u" };
+   uint32_t sum = 0;
+   uint64_t start, linearNs, hashNs;
+
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      const char* name = Param::GetAttrib((Param::PARAM_NUM)idx)->name;
+      CHECK(Param::NumFromString(name) == idx);
+      CHECK(LinearFromString(name) == idx);
+   }
+
+   for (unsigned i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++)
+      CHECK(Param::NumFromString(unknown[i]) == Param::PARAM_INVALID);
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+         sum += LinearFromString(Param::GetAttrib((Param::PARAM_NUM)idx)->name);
+   }
+   linearNs = NowNs() - start;
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+         sum -= Param::NumFromString(Param::GetAttrib((Param::PARAM_NUM)idx)->name);
+   }
+   hashNs = NowNs() - start;
+
+   CHECK(sum == 0);
+
+   printf("NumFromString, %d entries: linear %.1f ns, hashed %.1f ns per lookup\n", Param::PARAM_LAST,
+          (double)linearNs / (ROUNDS * Param::PARAM_LAST), (double)hashNs / (ROUNDS * Param::PARAM_LAST));
+
+   //Like parm_load(), look up the id of every stored parameter
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      uint32_t id = Param::GetAttrib((Param::PARAM_NUM)idx)->id;
+      CHECK(Param::NumFromId(id) == idx);
+      CHECK(LinearFromId(id) == idx);
+   }
+
+   CHECK(Param::NumFromId(0) == Param::PARAM_INVALID);
+   CHECK(Param::NumFromId(1999) == Param::PARAM_INVALID);
+   CHECK(Param::NumFromId(0xFFFF) == Param::PARAM_INVALID);
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+         sum += LinearFromId(Param::GetAttrib((Param::PARAM_NUM)idx)->id);
+   }
+   linearNs = NowNs() - start;
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+         sum -= Param::NumFromId(Param::GetAttrib((Param::PARAM_NUM)idx)->id);
+   }
+   hashNs = NowNs() - start;
+
+   CHECK(sum == 0);
+
+   printf("NumFromId, %d entries: linear %.1f us, table %.1f us per load of all ids\n", Param::PARAM_LAST,
+          linearNs / (ROUNDS * 1000.0), hashNs / (ROUNDS * 1000.0));
+
+   return TestResult("bench_lookup");
+}
@@ -0,0 +1,138 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Benchmark of the SendAll() item loop, scaling parameters through float
+ * like before and through Param::GetScaled() with integer gains like now.
+ * Half of the gains are decimals that are not exact in binary, both loops
+ * must still give the same frame. The host has an FPU, on targets without
+ * one the float loop is far slower still. */
+#include "hosttest.h"
+#include "params.h"
+
+#define ROUNDS 1000000
+#define NUM_ITEMS 8
+#define FIELD_MASK(n) ((1ULL << (n)) - 1)
+
+void parm_Change(Param::PARAM_NUM) {}
+
+struct Item
+{
+   Param::PARAM_NUM param;
+   float gain;
+   int16_t offset;
+   uint8_t offsetBits;
+   uint8_t numBits;
+   int32_t fixedGain;
+   uint8_t gainDigits;
+};
+
+static Item items[NUM_ITEMS] =
+{
+   { Param::udc,    1,     0,   0,  16, 0, 0 },
+   { Param::idc,    0.1,   0,   16, 16, 0, 0 },
+   { Param::speed,  0.5,   0,   32, 16, 0, 0 },
+   { Param::tmphs,  1,     40,  48, 8, 0, 0 },
+   { Param::boost,  0.7,   0,   56, 8, 0, 0 },
+   { Param::fweak,  3.6,   -10, 0,  12, 0, 0 },
+   { Param::udcmin, 0.125, 0,   12, 12, 0, 0 },
+   { Param::trim,   -0.3,  0,   24, 8, 0, 0 },
+};
+
+/** Like Can::SetGain() */
+static void SetGain(Item& item)
+{
+   float gain = item.gain;
+   int digits = 0;
+
+   while (digits < 62 - CST_DIGITS && gain > -16777216.0f && gain < 16777216.0f && gain != (float)(int32_t)gain)
+   {
+      gain *= 2;
+      digits++;
+   }
+   item.fixedGain = (int32_t)gain;
+   item.gainDigits = digits;
+}
+
+static uint64_t PackFloat()
+{
+   uint64_t frame = 0;
+
+   for (int i = 0; i < NUM_ITEMS; i++)
+   {
+      float fval = Param::GetFloat(items[i].param) * items[i].gain + items[i].offset;
+      frame |= ((uint32_t)(int32_t)fval & FIELD_MASK(items[i].numBits)) << items[i].offsetBits;
+   }
+   return frame;
+}
+
+static uint64_t PackScaled()
+{
+   uint64_t frame = 0;
+
+   for (int i = 0; i < NUM_ITEMS; i++)
+   {
+      uint32_t val = Param::GetScaled(items[i].param, items[i].fixedGain, items[i].gainDigits, items[i].offset);
+      frame |= (val & FIELD_MASK(items[i].numBits)) << items[i].offsetBits;
+   }
+   return frame;
+}
+
+int main()
+{
+   uint64_t start, floatNs, scaledNs, check = 0;
+
+   for (int i = 0; i < NUM_ITEMS; i++)
+      SetGain(items[i]);
+
+   Param::SetFixed(Param::udc, FP_FROMFLT(398.5));
+   Param::SetFixed(Param::idc, FP_FROMFLT(-12.25));
+   Param::SetFixed(Param::tmphs, FP_FROMFLT(-20));
+   Param::SetFixed(Param::boost, FP_FROMFLT(10));
+   Param::SetFixed(Param::fweak, FP_FROMFLT(-100));
+   Param::SetFixed(Param::trim, FP_FROMFLT(-17));
+
+   //Same frame for every speed
+   for (int speed = -100000; speed <= 100000; speed++)
+   {
+      Param::SetFixed(Param::speed, speed);
+      CHECK(PackFloat() == PackScaled());
+   }
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      Param::SetFixed(Param::speed, round);
+      check += PackFloat();
+   }
+   floatNs = NowNs() - start;
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+   {
+      Param::SetFixed(Param::speed, round);
+      check -= PackScaled();
+   }
+   scaledNs = NowNs() - start;
+
+   CHECK(check == 0);
+
+   printf("%d items per frame: float %.1f ns, GetScaled() %.1f ns per frame\n", NUM_ITEMS,
+          (double)floatNs / ROUNDS, (double)scaledNs / ROUNDS);
+
+   return TestResult("bench_scaling");
+}
@@ -0,0 +1,460 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Model of the bxCAN peripherals of the STM32F4 for the host tests */
+#include <new>
+#include <string.h>
+#include <libopencm3/stm32/can.h>
+#include <libopencm3/cm3/cortex.h>
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+#define FILTER_BANKS 28
+#define FIFO_DEPTH 3
+#define FMR_RESET 0x2A1C0E01 //CAN2 starts at bank 14
+
+struct Mailbox
+{
+   bool pending;
+   HostCanFrame frame;
+};
+
+struct RxFrame
+{
+   HostCanFrame frame;
+   uint8_t fmi;
+};
+
+struct Device
+{
+   uint32_t tsr;
+   uint32_t ier;
+   Mailbox mailboxes[3];
+   RxFrame fifos[2][FIFO_DEPTH];
+   int rxCount[2];
+};
+
+struct Bank
+{
+   uint32_t fr1;
+   uint32_t fr2;
+   bool scale32;
+   bool list;
+   int fifo;
+   bool active;
+};
+
+static const uint32_t rqcp[3] = { CAN_TSR_RQCP0, CAN_TSR_RQCP1, CAN_TSR_RQCP2 };
+static const uint32_t tme[3] = { CAN_TSR_TME0, CAN_TSR_TME1, CAN_TSR_TME2 };
+
+static Device devices[2];
+static Bank banks[FILTER_BANKS];
+static uint32_t fmr;
+static uint32_t can2Fmr; //the register of CAN2 does not exist, it reads 0
+
+static long calls;
+static long preemptAt = -1;
+static void (*preemptIsr)();
+static bool isrPending;
+static uint8_t isrPriority;
+static bool preempted;
+static uint32_t basepri;
+
+static Device& GetDevice(uint32_t canport)
+{
+   return devices[canport == CAN2 ? 1 : 0];
+}
+
+/** Every call into the model is a point where an interrupt can preempt */
+static void PreemptionPoint()
+{
+   if (preemptAt >= 0 && calls++ == preemptAt)
+   {
+      preemptAt = -1;
+      isrPending = true;
+   }
+
+   if (isrPending && !HostCan::IrqMasked(isrPriority))
+   {
+      isrPending = false;
+      preempted = true;
+      preemptIsr();
+   }
+}
+
+static void ResetDevice(Device& dev)
+{
+   memset(&dev, 0, sizeof(dev));
+   dev.tsr = CAN_TSR_TME_MASK;
+}
+
+static bool FirstBank(uint32_t canport, int& first, int& end)
+{
+   int can2Start = (fmr >> 8) & 0x3F;
+
+   first = canport == CAN2 ? can2Start : 0;
+   end = canport == CAN2 ? FILTER_BANKS : can2Start;
+   return first < end;
+}
+
+/** Frame as compared by a 16 bit filter: STID, RTR, IDE, EXID[17:15] */
+static uint32_t Frame16(uint32_t id, bool ext)
+{
+   if (ext)
+      return ((id >> 18) << 5) | 0x8 | ((id >> 15) & 0x7);
+   return id << 5;
+}
+
+/** Frame as compared by a 32 bit filter: STID, EXID, IDE, RTR */
+static uint32_t Frame32(uint32_t id, bool ext)
+{
+   if (ext)
+      return (id << 3) | 0x4;
+   return id << 21;
+}
+
+/** Match a frame against the banks of an interface
+ * @return filter match index within the FIFO, -1 if no filter matched
+ */
+static int Match(uint32_t canport, uint32_t id, bool ext, int& fifo)
+{
+   int first, end, fmi[2] = { 0, 0 };
+   int bestFmi = -1, bestRank = -1;
+   uint32_t f16 = Frame16(id, ext), f32 = Frame32(id, ext);
+
+   if (!FirstBank(canport, first, end)) return -1;
+
+   for (int nr = first; nr < end; nr++)
+   {
+      const Bank& b = banks[nr];
+      uint32_t ids[4], masks[4];
+      int count;
+
+      if (b.scale32 && b.list)
+      {
+         ids[0] = b.fr1; ids[1] = b.fr2;
+         masks[0] = masks[1] = 0xFFFFFFFF;
+         count = 2;
+      }
+      else if (b.scale32)
+      {
+         ids[0] = b.fr1; masks[0] = b.fr2;
+         count = 1;
+      }
+      else if (b.list)
+      {
+         ids[0] = b.fr1 & 0xFFFF; ids[1] = b.fr1 >> 16;
+         ids[2] = b.fr2 & 0xFFFF; ids[3] = b.fr2 >> 16;
+         masks[0] = masks[1] = masks[2] = masks[3] = 0xFFFF;
+         count = 4;
+      }
+      else
+      {
+         ids[0] = b.fr1 & 0xFFFF; masks[0] = b.fr1 >> 16;
+         ids[1] = b.fr2 & 0xFFFF; masks[1] = b.fr2 >> 16;
+         count = 2;
+      }
+
+      //Inactive banks are numbered all the same
+      for (int i = 0; i < count; i++, fmi[b.fifo]++)
+      {
+         uint32_t frame = b.scale32 ? f32 : f16;
+
+         if (!b.active || ((frame ^ ids[i]) & masks[i]) != 0) continue;
+
+         //32 bit before 16 bit filters, list before mask filters, then lowest number
+         int rank = (b.scale32 ? 2 : 0) + (b.list ? 1 : 0);
+
+         if (rank > bestRank)
+         {
+            bestRank = rank;
+            bestFmi = fmi[b.fifo];
+            fifo = b.fifo;
+         }
+      }
+   }
+
+   return bestFmi;
+}
+
+HostCanTsr::operator uint32_t() const
+{
+   PreemptionPoint();
+   return GetDevice(canport).tsr;
+}
+
+HostCanTsr& HostCanTsr::operator=(uint32_t clear)
+{
+   PreemptionPoint();
+   GetDevice(canport).tsr &= ~(clear & (CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2));
+   return *this;
+}
+
+uint32_t* hostcan_fmr(uint32_t canport)
+{
+   PreemptionPoint();
+   return canport == CAN1 ? &fmr : &can2Fmr;
+}
+
+void can_reset(uint32_t canport)
+{
+   ResetDevice(GetDevice(canport));
+}
+
+int can_init(uint32_t, bool, bool, bool, bool, bool, bool, uint32_t, uint32_t, uint32_t, uint32_t, bool, bool)
+{
+   return 0;
+}
+
+void can_filter_init(uint32_t nr, bool scale_32bit, bool id_list_mode, uint32_t fr1, uint32_t fr2, uint32_t fifo, bool enable)
+{
+   if (nr >= FILTER_BANKS) return;
+
+   banks[nr].fr1 = fr1;
+   banks[nr].fr2 = fr2;
+   banks[nr].scale32 = scale_32bit;
+   banks[nr].list = id_list_mode;
+   banks[nr].fifo = fifo ? 1 : 0;
+   banks[nr].active = enable;
+}
+
+void can_filter_id_mask_16bit_init(uint32_t nr, uint16_t id1, uint16_t mask1, uint16_t id2, uint16_t mask2, uint32_t fifo, bool enable)
+{
+   can_filter_init(nr, false, false, ((uint32_t)mask1 << 16) | id1, ((uint32_t)mask2 << 16) | id2, fifo, enable);
+}
+
+void can_filter_id_mask_32bit_init(uint32_t nr, uint32_t id, uint32_t mask, uint32_t fifo, bool enable)
+{
+   can_filter_init(nr, true, false, id, mask, fifo, enable);
+}
+
+void can_filter_id_list_16bit_init(uint32_t nr, uint16_t id1, uint16_t id2, uint16_t id3, uint16_t id4, uint32_t fifo, bool enable)
+{
+   can_filter_init(nr, false, true, ((uint32_t)id2 << 16) | id1, ((uint32_t)id4 << 16) | id3, fifo, enable);
+}
+
+void can_filter_id_list_32bit_init(uint32_t nr, uint32_t id1, uint32_t id2, uint32_t fifo, bool enable)
+{
+   can_filter_init(nr, true, true, id1, id2, fifo, enable);
+}
+
+void can_enable_irq(uint32_t canport, uint32_t irq)
+{
+   PreemptionPoint();
+   GetDevice(canport).ier |= irq;
+}
+
+void can_disable_irq(uint32_t canport, uint32_t irq)
+{
+   PreemptionPoint();
+   GetDevice(canport).ier &= ~irq;
+}
+
+int can_transmit(uint32_t canport, uint32_t id, bool ext, bool, uint8_t length, uint8_t *data)
+{
+   PreemptionPoint();
+
+   Device& dev = GetDevice(canport);
+
+   for (int i = 0; i < 3; i++)
+   {
+      if (dev.tsr & tme[i])
+      {
+         Mailbox& mb = dev.mailboxes[i];
+
+         mb.pending = true;
+         mb.frame.id = id;
+         mb.frame.ext = ext;
+         mb.frame.len = length;
+         memcpy(mb.frame.data, data, 8);
+         dev.tsr &= ~tme[i];
+         return i;
+      }
+   }
+   return -1;
+}
+
+int can_receive(uint32_t canport, uint8_t fifo, bool release, uint32_t *id, bool *ext,
+                bool *rtr, uint8_t *fmi, uint8_t *length, uint8_t *data, uint16_t *timestamp)
+{
+   PreemptionPoint();
+
+   Device& dev = GetDevice(canport);
+
+   if (dev.rxCount[fifo] == 0) return 0;
+
+   const RxFrame& rx = dev.fifos[fifo][0];
+
+   *id = rx.frame.id;
+   *ext = rx.frame.ext;
+   *rtr = false;
+   *fmi = rx.fmi;
+   *length = rx.frame.len;
+   memcpy(data, rx.frame.data, 8);
+   if (timestamp) *timestamp = 0;
+
+   if (release)
+   {
+      dev.rxCount[fifo]--;
+      memmove(&dev.fifos[fifo][0], &dev.fifos[fifo][1], dev.rxCount[fifo] * sizeof(RxFrame));
+   }
+   return 1;
+}
+
+uint32_t cm_raise_basepri(uint32_t priority)
+{
+   uint32_t old = basepri;
+
+   if (priority != 0 && (basepri == 0 || priority < basepri))
+      basepri = priority;
+   PreemptionPoint();
+   return old;
+}
+
+void cm_restore_basepri(uint32_t old)
+{
+   basepri = old;
+   PreemptionPoint();
+}
+
+namespace HostCan
+{
+
+void Reset()
+{
+   ResetDevice(devices[0]);
+   ResetDevice(devices[1]);
+   memset(banks, 0, sizeof(banks));
+   fmr = FMR_RESET;
+   can2Fmr = 0;
+   preemptAt = -1;
+   isrPending = false;
+   basepri = 0;
+}
+
+int Receive(uint32_t canport, uint32_t id, bool ext, const uint32_t* data, uint8_t len)
+{
+   Device& dev = GetDevice(canport);
+   int fifo = 0;
+   int fmi = Match(canport, id, ext, fifo);
+
+   if (fmi < 0 || dev.rxCount[fifo] == FIFO_DEPTH) return -1;
+
+   RxFrame& rx = dev.fifos[fifo][dev.rxCount[fifo]++];
+
+   rx.frame.id = id;
+   rx.frame.ext = ext;
+   rx.frame.len = len;
+   rx.frame.data[0] = data ? data[0] : 0;
+   rx.frame.data[1] = data ? data[1] : 0;
+   rx.fmi = fmi;
+   return fifo;
+}
+
+int RxPending(uint32_t canport, int fifo)
+{
+   return GetDevice(canport).rxCount[fifo];
+}
+
+bool Transmit(uint32_t canport, HostCanFrame* frame)
+{
+   Device& dev = GetDevice(canport);
+   int winner = -1;
+
+   //Lowest id wins arbitration, equal ids go out in mailbox order
+   for (int i = 0; i < 3; i++)
+   {
+      if (dev.mailboxes[i].pending && (winner < 0 || dev.mailboxes[i].frame.id < dev.mailboxes[winner].frame.id))
+         winner = i;
+   }
+
+   if (winner < 0) return false;
+
+   dev.mailboxes[winner].pending = false;
+   dev.tsr |= tme[winner] | rqcp[winner];
+   if (frame) *frame = dev.mailboxes[winner].frame;
+   return true;
+}
+
+int TxPending(uint32_t canport)
+{
+   Device& dev = GetDevice(canport);
+   return dev.mailboxes[0].pending + dev.mailboxes[1].pending + dev.mailboxes[2].pending;
+}
+
+bool TxIrq(uint32_t canport)
+{
+   Device& dev = GetDevice(canport);
+   return (dev.ier & CAN_IER_TMEIE) && (dev.tsr & (CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2));
+}
+
+uint32_t GetIer(uint32_t canport)
+{
+   return GetDevice(canport).ier;
+}
+
+int ActiveBanks(uint32_t canport)
+{
+   int first, end, count = 0;
+
+   FirstBank(canport, first, end);
+
+   for (int nr = first; nr < end; nr++)
+      count += banks[nr].active;
+
+   return count;
+}
+
+void PreemptAt(long call, void (*isr)(), uint8_t priority)
+{
+   calls = 0;
+   preemptAt = call;
+   preemptIsr = isr;
+   isrPriority = priority;
+   isrPending = false;
+   preempted = false;
+}
+
+bool Preempted()
+{
+   return preempted;
+}
+
+bool IrqMasked(uint8_t priority)
+{
+   return basepri != 0 && priority >= basepri;
+}
+
+Can* Create(uint32_t canport)
+{
+   static char memory[2][sizeof(Can)] __attribute__((aligned(8)));
+
+   return new (memory[canport == CAN2]) Can(canport, Can::Baud500);
+}
+
+Can* Boot(IFlashBanks* flash, uint32_t canport, int can2Start)
+{
+   Reset();
+   parm_set_flash(flash);
+   fmr = (fmr & ~0x3F00) | (can2Start << 8);
+
+   return Create(canport);
+}
+
+}
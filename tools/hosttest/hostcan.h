@@ -0,0 +1,101 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOSTCAN_H
+#define HOSTCAN_H
+
+/* Test side of the bxCAN model behind tools/hosttest/libopencm3/stm32/can.h
+ *
+ * Each interface has three TX mailboxes and two RX FIFOs of three frames.
+ * The 28 filter banks are shared, CAN2 uses the banks from the start bank in
+ * CAN_FMR on. Filters match and number their match indexes like the
+ * reference manual describes. Nothing runs by itself: the tests put frames
+ * on the bus, let the bus send mailboxes and call the interrupt handlers. */
+
+#include <stdint.h>
+#include <libopencm3/stm32/can.h>
+
+class Can;
+class IFlashBanks;
+
+struct HostCanFrame
+{
+   uint32_t id;
+   bool ext;
+   uint8_t len;
+   uint32_t data[2];
+};
+
+namespace HostCan
+{
+   /** Power on state of both interfaces and all filter banks */
+   void Reset();
+
+   /** A frame arrives from the bus
+    * @return FIFO it was stored in, -1 if no filter accepted it or the FIFO was full
+    */
+   int Receive(uint32_t canport, uint32_t id, bool ext, const uint32_t* data = 0, uint8_t len = 8);
+
+   /** @return number of frames in an RX FIFO */
+   int RxPending(uint32_t canport, int fifo);
+
+   /** The pending mailbox with the lowest id wins arbitration and is sent
+    * @return false if no mailbox was pending
+    */
+   bool Transmit(uint32_t canport, HostCanFrame* frame = 0);
+
+   /** @return number of mailboxes waiting for the bus */
+   int TxPending(uint32_t canport);
+
+   /** @return true while the TX interrupt is requested, i.e. TMEIE is
+    * enabled and a mailbox completed */
+   bool TxIrq(uint32_t canport);
+
+   /** @return interrupt enable register */
+   uint32_t GetIer(uint32_t canport);
+
+   /** @return number of active filter banks belonging to an interface */
+   int ActiveBanks(uint32_t canport);
+
+   /** Let isr preempt the code at the given number of calls into the model
+    * from now on. Counted are register accesses and calls of the CAN
+    * functions. While BASEPRI masks its priority, by default that of the
+    * CAN interrupts, isr waits until it is unmasked again. It runs once and
+    * without further preemption.
+    */
+   void PreemptAt(long call, void (*isr)(), uint8_t priority = 0xf << 4);
+
+   /** @return true if the isr set by PreemptAt() has run */
+   bool Preempted();
+
+   /** @return true if BASEPRI masks interrupts of the given priority */
+   bool IrqMasked(uint8_t priority);
+
+   /** Construct the Can of an interface at 500 kBaud, it loads its map from
+    * the flash set by parm_set_flash(). Each interface has its own memory,
+    * creating it again replaces the previous one.
+    */
+   Can* Create(uint32_t canport);
+
+   /** Power on, select the configuration flash and create the Can of canport
+    * like at boot. can2Start is the first filter bank of CAN2.
+    */
+   Can* Boot(IFlashBanks* flash, uint32_t canport = CAN1, int can2Start = 14);
+}
+
+#endif // HOSTCAN_H
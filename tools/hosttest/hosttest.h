@@ -0,0 +1,112 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOSTTEST_H
+#define HOSTTEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include "flashbanks.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/** Print the result of a test program
+ * @return exit code of the test program
+ */
+static inline int TestResult(const char* name)
+{
+   printf("%s: %s\n", name, failures == 0 ? "passed" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
+
+/** @return monotonic time in nanoseconds, for the benchmarks */
+static inline uint64_t NowNs()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** @brief Flash banks in RAM that can lose power at any erase or program
+ *
+ * Programming a word that is not erased counts as failure, like it fails on
+ * the target. After SetPowerCut(n) the n-th following erase or program throws
+ * PowerCut instead of completing. An erase that is cut short only erases the
+ * upper half of the bank, so a header in the lower half survives it.
+ */
+class RamFlash: public IFlashBanks
+{
+public:
+   struct PowerCut {};
+
+   RamFlash(uint32_t size) : size(size), cutAt(-1), operations(0)
+   {
+      for (int bank = 0; bank < 2; bank++)
+         data[bank].assign(size / sizeof(uint32_t), 0xFFFFFFFF);
+   }
+
+   uint32_t GetBankSize() { return size; }
+   const uint32_t* GetBank(int bank) { return &data[bank][0]; }
+
+   void EraseBank(int bank)
+   {
+      uint32_t words = data[bank].size();
+      bool cut = Cut();
+
+      for (uint32_t i = cut ? words / 2 : 0; i < words; i++)
+         data[bank][i] = 0xFFFFFFFF;
+
+      if (cut) throw PowerCut();
+   }
+
+   void ProgramWord(int bank, uint32_t offset, uint32_t value)
+   {
+      if (Cut()) throw PowerCut();
+
+      CHECK(offset < data[bank].size());
+      CHECK(data[bank][offset] == 0xFFFFFFFF);
+      data[bank][offset] = value;
+   }
+
+   /** @param operation number of erases and programs that still complete, -1 for none */
+   void SetPowerCut(long operation) { cutAt = operation < 0 ? -1 : operations + operation; }
+   long GetOperations() { return operations; }
+
+private:
+   bool Cut()
+   {
+      if (cutAt >= 0 && operations >= cutAt)
+      {
+         cutAt = -1;
+         return true;
+      }
+      operations++;
+      return false;
+   }
+
+   uint32_t size;
+   long cutAt;
+   long operations;
+   std::vector<uint32_t> data[2];
+};
+
+#endif // HOSTTEST_H
@@ -0,0 +1,37 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HWDEFS_H_INCLUDED
+#define HWDEFS_H_INCLUDED
+
+/* Flash layout of the host tests, the addresses are never accessed as the
+ * tests replace the flash drivers by RamFlash */
+#define FLASH_CONF_BASE       0x08004000
+#define CAN1_BLKOFFSET        0
+#ifndef CAN_BLKSIZE //test_canmap also runs with a small block at the end of the sector
+#define CAN2_BLKOFFSET        0x1800
+#define CAN_BLKSIZE           0x1800
+#endif
+#define PARAM_BLKOFFSET       0x3000
+#define PARAM_BLKSIZE         1024
+#define FLASH_JOURNAL_BASE    0x08008000
+#define FLASH_JOURNAL_SECTOR  2
+#define FLASH_JOURNAL_BASE2   0x0800C000
+#define FLASH_JOURNAL_SECTOR2 3
+
+#endif // HWDEFS_H_INCLUDED
@@ -0,0 +1,55 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAM_PRJ_H_INCLUDED
+#define PARAM_PRJ_H_INCLUDED
+
+/* Parameter lists that params.cpp must refuse to compile, one per define.
+ * Without any define the list is valid, so the compile checks can not pass
+ * because of an unrelated error. */
+#if defined(DUPLICATE_ID)
+#define PARAM_LIST \
+    PARAM_ENTRY("Test", boost,     "dig", 0,    37813, 1700, 1) \
+    PARAM_ENTRY("Test", fweak,     "Hz",  0,    400,   67,   2) \
+    VALUE_ENTRY(udc,   "V",   2000) \
+    VALUE_ENTRY(idc,   "A",   2) //same as fweak
+#elif defined(MIN_ABOVE_MAX)
+#define PARAM_LIST \
+    PARAM_ENTRY("Test", boost,     "dig", 0,    37813, 1700, 1) \
+    PARAM_ENTRY("Test", fweak,     "Hz",  400,  0,     67,   2) \
+    VALUE_ENTRY(udc,   "V",   2000)
+#elif defined(DEFAULT_OUT_OF_RANGE)
+#define PARAM_LIST \
+    PARAM_ENTRY("Test", boost,     "dig", 0,    37813, 1700, 1) \
+    PARAM_ENTRY("Test", trim,      "",    -100, 100,   -101, 4) \
+    VALUE_ENTRY(udc,   "V",   2000)
+#elif defined(ID_TOO_WIDE)
+#define PARAM_LIST \
+    PARAM_ENTRY("Test", boost,     "dig", 0,    37813, 1700, 1) \
+    VALUE_ENTRY(udc,   "V",   65536)
+#else
+#define PARAM_LIST \
+    PARAM_ENTRY("Test", boost,     "dig", 0,    37813, 1700, 1) \
+    PARAM_ENTRY("Test", fweak,     "Hz",  0,    400,   67,   2) \
+    PARAM_ENTRY("Test", trim,      "",    -100, 100,   -100, 4) \
+    VALUE_ENTRY(udc,   "V",   65535) \
+    VALUE_ENTRY(idc,   "A",   0) \
+    VALUE_ENTRY(speed, "rpm", 0) //id 0 may repeat
+#endif
+
+#endif // PARAM_PRJ_H_INCLUDED
@@ -0,0 +1,32 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_CORTEX_H
+#define HOST_CORTEX_H
+
+/* Host replacement of the interrupt masking, implemented by
+ * tools/hosttest/hostcan.cpp. On the target src/stm32_can.cpp sets BASEPRI
+ * itself. An interrupt that a test lets preempt the code is held back while
+ * BASEPRI masks its priority. */
+
+#include <stdint.h>
+
+uint32_t cm_raise_basepri(uint32_t priority);
+void cm_restore_basepri(uint32_t basepri);
+
+#endif // HOST_CORTEX_H
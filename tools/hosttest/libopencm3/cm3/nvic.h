@@ -0,0 +1,37 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_NVIC_H
+#define HOST_NVIC_H
+
+/* Host replacement of the libopencm3 NVIC functions, the tests call the
+ * interrupt handlers themselves */
+
+#include <stdint.h>
+
+#define NVIC_CAN1_TX_IRQ      19
+#define NVIC_CAN1_RX0_IRQ     20
+#define NVIC_CAN1_RX1_IRQ     21
+#define NVIC_CAN2_TX_IRQ      63
+#define NVIC_CAN2_RX0_IRQ     64
+#define NVIC_CAN2_RX1_IRQ     65
+
+static inline void nvic_enable_irq(uint8_t) {}
+static inline void nvic_set_priority(uint8_t, uint8_t) {}
+
+#endif // HOST_NVIC_H
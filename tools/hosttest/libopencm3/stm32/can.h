@@ -0,0 +1,80 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_CAN_H
+#define HOST_CAN_H
+
+/* Host replacement of the libopencm3 bxCAN API used by stm32_can.cpp. The
+ * peripherals are modelled by tools/hosttest/hostcan.cpp, see hostcan.h for
+ * the side the tests control. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAN1                  0x40006400U
+#define CAN2                  0x40006800U
+
+#define CAN_IER_TMEIE         (1 << 0)
+#define CAN_IER_FMPIE0        (1 << 1)
+#define CAN_IER_FMPIE1        (1 << 4)
+
+#define CAN_TSR_RQCP0         (1 << 0)
+#define CAN_TSR_RQCP1         (1 << 8)
+#define CAN_TSR_RQCP2         (1 << 16)
+#define CAN_TSR_TME0          (1 << 26)
+#define CAN_TSR_TME1          (1 << 27)
+#define CAN_TSR_TME2          (1 << 28)
+#define CAN_TSR_TME_MASK      (7 << 26)
+
+#define CAN_BTR_SJW_1TQ       (0x0 << 24)
+#define CAN_BTR_TS1_11TQ      (0xA << 16)
+#define CAN_BTR_TS1_13TQ      (0xC << 16)
+#define CAN_BTR_TS2_2TQ       (0x1 << 20)
+
+/** CAN_TSR is write 1 to clear for the request completed bits */
+struct HostCanTsr
+{
+   uint32_t canport;
+   operator uint32_t() const;
+   HostCanTsr& operator=(uint32_t clear);
+};
+
+uint32_t* hostcan_fmr(uint32_t canport);
+
+#define CAN_TSR(canport)      (HostCanTsr{ canport })
+#define CAN_FMR(canport)      (*hostcan_fmr(canport))
+
+void can_reset(uint32_t canport);
+int can_init(uint32_t canport, bool ttcm, bool abom, bool awum, bool nart,
+             bool rflm, bool txfp, uint32_t sjw, uint32_t ts1, uint32_t ts2,
+             uint32_t brp, bool loopback, bool silent);
+void can_filter_init(uint32_t nr, bool scale_32bit, bool id_list_mode,
+                     uint32_t fr1, uint32_t fr2, uint32_t fifo, bool enable);
+void can_filter_id_mask_16bit_init(uint32_t nr, uint16_t id1, uint16_t mask1,
+                                   uint16_t id2, uint16_t mask2, uint32_t fifo, bool enable);
+void can_filter_id_mask_32bit_init(uint32_t nr, uint32_t id, uint32_t mask, uint32_t fifo, bool enable);
+void can_filter_id_list_16bit_init(uint32_t nr, uint16_t id1, uint16_t id2,
+                                   uint16_t id3, uint16_t id4, uint32_t fifo, bool enable);
+void can_filter_id_list_32bit_init(uint32_t nr, uint32_t id1, uint32_t id2, uint32_t fifo, bool enable);
+void can_enable_irq(uint32_t canport, uint32_t irq);
+void can_disable_irq(uint32_t canport, uint32_t irq);
+int can_transmit(uint32_t canport, uint32_t id, bool ext, bool rtr, uint8_t length, uint8_t *data);
+int can_receive(uint32_t canport, uint8_t fifo, bool release, uint32_t *id, bool *ext,
+                bool *rtr, uint8_t *fmi, uint8_t *length, uint8_t *data, uint16_t *timestamp);
+
+#endif // HOST_CAN_H
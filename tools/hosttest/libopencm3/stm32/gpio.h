@@ -0,0 +1,39 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+/* Host replacement of the libopencm3 GPIO functions used by stm32_can.cpp,
+ * pin setup has no effect on the host */
+
+#include <stdint.h>
+
+#define GPIOB                 0x40020400U
+#define GPIO_MODE_AF          2
+#define GPIO_PUPD_NONE        0
+#define GPIO_AF9              9
+#define GPIO8                 (1 << 8)
+#define GPIO9                 (1 << 9)
+#define GPIO12                (1 << 12)
+#define GPIO13                (1 << 13)
+
+static inline void gpio_mode_setup(uint32_t, uint8_t, uint8_t, uint16_t) {}
+static inline void gpio_set_af(uint32_t, uint8_t, uint16_t) {}
+
+#endif // HOST_GPIO_H
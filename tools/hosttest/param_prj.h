@@ -0,0 +1,36 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAM_PRJ_H_INCLUDED
+#define PARAM_PRJ_H_INCLUDED
+
+/* Parameter list of the host tests, ids of values start at 2000 like in the
+ * projects so the sorted id table is used */
+#define PARAM_LIST \
+    PARAM_ENTRY("Test", boost,     "dig", 0,    37813, 1700, 1) \
+    PARAM_ENTRY("Test", fweak,     "Hz",  0,    400,   67,   2) \
+    PARAM_ENTRY("Test", udcmin,    "V",   0,    1000,  450,  3) \
+    PARAM_ENTRY("Test", trim,      "",    -100, 100,   0,    4) \
+    PARAM_ENTRY("Test", polepairs, "",    1,    16,    2,    32) \
+    PARAM_ENTRY("Test", canspeed,  "",    0,    3,     1,    40) \
+    VALUE_ENTRY(udc,   "V",   2000) \
+    VALUE_ENTRY(idc,   "A",   2001) \
+    VALUE_ENTRY(speed, "rpm", 2002) \
+    VALUE_ENTRY(tmphs, "C",   2003)
+
+#endif // PARAM_PRJ_H_INCLUDED
@@ -0,0 +1,172 @@
+#!/bin/sh
+# Build and run the host tests, call it from the repository root:
+#   tools/hosttest/run.sh
+# Each test is a plain program that prints its result and exits with 1 on failure.
+# param_prj.h and hwdefs.h of the tests are in tools/hosttest, the libopencm3
+# CRC functions and the flash driver are replaced by tools/paramimage/hostshim.cpp.
+# The CAN tests run stm32_can.cpp on the bxCAN model in tools/hosttest/hostcan.cpp,
+# which tools/hosttest/libopencm3 connects it to.
+# The benchmarks use the larger parameter list in tools/hosttest/bench and
+# print their timings, they only fail if the results are wrong.
+set -e
+
+CXX=${CXX:-g++}
+OUT=${OUT:-${TMPDIR:-/tmp}/libopeninv-hosttest}
+CXXFLAGS="-std=c++11 -Wall -Wextra -Itools/hosttest -Itools/paramimage -Iinclude"
+CAN_SOURCES="src/stm32_can.cpp src/param_save.cpp src/params.cpp src/crc32.cpp src/my_string.c \
+    tools/paramimage/hostshim.cpp tools/hosttest/hostcan.cpp"
+
+mkdir -p "$OUT"
+
+run()
+{
+   name=$1
+   shift
+   #Include paths given to run come before the default ones
+   $CXX "$@" $CXXFLAGS -o "$OUT/$name"
+   "$OUT/$name"
+}
+
+#params.cpp must refuse the list of tools/hosttest/invalid/param_prj.h selected
+#by the define, with the given static_assert message. No define must compile.
+compile_fails()
+{
+   name=$1
+   message=$2
+   log="$OUT/$name.log"
+
+   if $CXX -Itools/hosttest/invalid $CXXFLAGS ${name:+-D$name} -fsyntax-only src/params.cpp 2> "$log"
+   then
+      [ -z "$name" ] && return
+      echo "compile_fails $name: compiled"
+      exit 1
+   fi
+
+   if [ -z "$name" ] || ! grep -q "$message" "$log"
+   then
+      cat "$log"
+      echo "compile_fails $name: FAILED"
+      exit 1
+   fi
+   echo "compile_fails $name: passed"
+}
+
+run journal -DPARAM_SAVE_JOURNAL tools/hosttest/test_journal.cpp src/param_save.cpp src/param_journal.cpp \
+    src/params.cpp src/crc8.cpp src/crc32.cpp src/my_string.c tools/paramimage/hostshim.cpp
+
+compile_fails "" ""
+compile_fails DUPLICATE_ID "PARAM_LIST: duplicate id"
+compile_fails MIN_ABOVE_MAX "PARAM_LIST: parameter with min > max"
+compile_fails DEFAULT_OUT_OF_RANGE "PARAM_LIST: parameter with min > max or default outside"
+compile_fails ID_TOO_WIDE "PARAM_LIST: ids must fit in 16 bits"
+
+#paramimage must print the expected output of tools/paramimage/corpus for its
+#images, a failing exit code is appended as "exit <code>". The images were
+#saved by this code with the tools/hosttest parameter list, trailing erased
+#words cut off:
+#  defaults    default parameters, no CAN maps
+#  tuned       changed and hidden parameters, CAN maps on both interfaces
+#  tuned_v2    like tuned with changed parameters and CAN items
+#  compact     tuned with PARAM_SAVE_COMPACT
+#  legacy      fixed size CAN map, parameter page from before A/B saving
+#  bad_params  tuned with a changed parameter value
+#  bad_canmap  tuned with a changed CAN2 item
+#  empty       no data at all
+CORPUS=tools/paramimage/corpus
+IMAGES="bad_canmap bad_params compact defaults empty legacy tuned tuned_v2"
+PARAMIMAGE="$OUT/paramimage"
+
+corpus()
+{
+   expected=$1
+   shift
+   "$PARAMIMAGE" "$@" > "$OUT/$expected" 2>&1 || echo "exit $?" >> "$OUT/$expected"
+
+   if ! diff -u "$CORPUS/$expected" "$OUT/$expected"
+   then
+      echo "corpus $expected: FAILED"
+      exit 1
+   fi
+   echo "corpus $expected: passed"
+}
+
+$CXX $CXXFLAGS -Wno-unused-parameter -o "$PARAMIMAGE" tools/paramimage/main.cpp tools/paramimage/paramimage.cpp $CAN_SOURCES
+
+corpus validate.txt validate $(for image in $IMAGES; do echo $CORPUS/$image.bin; done)
+for image in $IMAGES; do echo $CORPUS/$image.bin; done | corpus validate.txt validate -
+for image in compact defaults legacy tuned tuned_v2 bad_params
+do
+   corpus dump_$image.txt dump $CORPUS/$image.bin
+done
+corpus diff_tuned_v2.txt diff $CORPUS/tuned.bin $CORPUS/tuned_v2.bin
+corpus diff_compact.txt diff $CORPUS/tuned.bin $CORPUS/compact.bin
+corpus diff_legacy.txt diff $CORPUS/legacy.bin $CORPUS/tuned.bin
+corpus diff_bad_params.txt diff $CORPUS/tuned.bin $CORPUS/bad_params.bin
+#set keeps the CAN maps, from "-" it starts with an erased image
+corpus set.txt set $CORPUS/tuned.bin "$OUT/set.bin" boost=3000 trim=5
+corpus dump_set.txt dump "$OUT/set.bin"
+corpus set_erased.txt set - "$OUT/set.bin" fweak=100
+corpus dump_set_erased.txt dump "$OUT/set.bin"
+corpus set_unknown.txt set $CORPUS/tuned.bin "$OUT/set.bin" nosuch=1
+corpus set_range.txt set $CORPUS/tuned.bin "$OUT/set.bin" boost=40000
+
+run crc32 tools/hosttest/test_crc32.cpp src/crc32.cpp
+run crc32_slice8 -DCRC32_SLICE_BY_8 tools/hosttest/test_crc32.cpp src/crc32.cpp
+run crc8 -O2 tools/hosttest/test_crc8.cpp src/crc8.cpp
+run crc8_slice4 -O2 -DCRC8_SLICE_BY_4 tools/hosttest/test_crc8.cpp src/crc8.cpp
+
+run params -DPARAM_BATCH_SIZE=4 tools/hosttest/test_params.cpp src/params.cpp src/my_string.c
+run generation tools/hosttest/test_generation.cpp src/my_string.c
+run snapshot -O2 -pthread tools/hosttest/test_snapshot.cpp src/params.cpp src/my_string.c
+#Ranges and values move to RAM with the hot/cold split, same behaviour
+run params_hotcold -DPARAM_HOT_COLD_SPLIT -DPARAM_BATCH_SIZE=4 tools/hosttest/test_params.cpp src/params.cpp src/my_string.c
+run generation_hotcold -DPARAM_HOT_COLD_SPLIT tools/hosttest/test_generation.cpp src/my_string.c
+run snapshot_hotcold -O2 -pthread -DPARAM_HOT_COLD_SPLIT tools/hosttest/test_snapshot.cpp src/params.cpp src/my_string.c
+run can_tx -Wno-unused-parameter tools/hosttest/test_can_tx.cpp $CAN_SOURCES
+run can_pack -fsanitize=undefined,float-cast-overflow -fno-sanitize-recover=all -Wno-unused-parameter tools/hosttest/test_can_pack.cpp $CAN_SOURCES
+run configsave -Wno-unused-parameter tools/hosttest/test_configsave.cpp src/configsave.cpp $CAN_SOURCES
+run configsave_journal -DPARAM_SAVE_JOURNAL -Wno-unused-parameter tools/hosttest/test_configsave.cpp src/configsave.cpp \
+    src/param_journal.cpp src/crc8.cpp $CAN_SOURCES
+run configsave_compact -DPARAM_SAVE_COMPACT -Wno-unused-parameter tools/hosttest/test_configsave.cpp src/configsave.cpp \
+    $CAN_SOURCES
+for variant in "" -DPARAM_SAVE_JOURNAL -DPARAM_SAVE_COMPACT
+do
+   run configsave_bench$variant $variant -Wno-unused-parameter -Itools/hosttest/bench -DBENCH_SIZE=2 \
+       tools/hosttest/test_configsave.cpp src/configsave.cpp src/param_journal.cpp src/crc8.cpp $CAN_SOURCES
+done
+run ab -Wno-unused-parameter -DFLASH_CONF_BASE2=0x0800C000 -DFLASH_CONF_SECTOR2=3 tools/hosttest/test_ab.cpp $CAN_SOURCES
+run ab_compact -Wno-unused-parameter -DFLASH_CONF_BASE2=0x0800C000 -DFLASH_CONF_SECTOR2=3 -DPARAM_SAVE_COMPACT \
+    tools/hosttest/test_ab.cpp $CAN_SOURCES
+run compact -fsanitize=address,undefined -DPARAM_SAVE_COMPACT tools/hosttest/test_compact.cpp src/param_save.cpp src/params.cpp \
+    src/crc32.cpp src/my_string.c tools/paramimage/hostshim.cpp
+run compact_full -Wno-unused-parameter -DPARAM_SAVE_COMPACT -Itools/hosttest/bench -DBENCH_SIZE=2 tools/hosttest/test_compact.cpp \
+    src/configsave.cpp $CAN_SOURCES
+run compact_full_ab -Wno-unused-parameter -DPARAM_SAVE_COMPACT -DFLASH_CONF_BASE2=0x0800C000 -DFLASH_CONF_SECTOR2=3 \
+    -Itools/hosttest/bench -DBENCH_SIZE=2 tools/hosttest/test_compact.cpp src/configsave.cpp $CAN_SOURCES
+run canmap -Wno-unused-parameter tools/hosttest/test_canmap.cpp $CAN_SOURCES
+run canmap_limits -Wno-unused-parameter -DMAX_MESSAGES=4 -DMAX_ITEMS_PER_MESSAGE=16 tools/hosttest/test_canmap.cpp $CAN_SOURCES
+run canmap_small -fsanitize=address -Wno-unused-parameter -DCAN_BLKSIZE=1024 -DCAN2_BLKOFFSET=0x3C00 \
+    tools/hosttest/test_canmap.cpp $CAN_SOURCES
+run can_sched -Wno-unused-parameter tools/hosttest/test_can_sched.cpp $CAN_SOURCES
+run can_latency -Wno-unused-parameter tools/hosttest/test_can_latency.cpp $CAN_SOURCES
+run can_rx -Wno-unused-parameter tools/hosttest/test_can_rx.cpp $CAN_SOURCES
+run can_rxqueue -O2 -pthread -Wno-unused-parameter tools/hosttest/test_can_rxqueue.cpp $CAN_SOURCES
+run can_rxqueue_tsan -O1 -g -fsanitize=thread -Wno-tsan -Wno-unused-parameter tools/hosttest/test_can_rxqueue.cpp $CAN_SOURCES
+run can_filters -Wno-unused-parameter tools/hosttest/test_can_filters.cpp $CAN_SOURCES
+run can_filters128 -O2 -Wno-unused-parameter -DMAX_MESSAGES=128 tools/hosttest/test_can_filters.cpp $CAN_SOURCES
+run bench_can_pack -O2 tools/hosttest/bench_can_pack.cpp
+run bench_can_rx -O2 -Wno-unused-parameter -DMAX_MESSAGES=128 tools/hosttest/bench_can_rx.cpp $CAN_SOURCES
+run bench_can_rx_linear -O2 -Wno-unused-parameter -DMAX_MESSAGES=128 -DCAN_RX_LINEAR_SEARCH \
+    tools/hosttest/bench_can_rx.cpp $CAN_SOURCES
+run bench_can_send -O2 -Wno-unused-parameter tools/hosttest/bench_can_send.cpp $CAN_SOURCES
+run bench_scaling -O2 tools/hosttest/bench_scaling.cpp src/params.cpp src/my_string.c
+
+for size in 1 2
+do
+   run bench_lookup$size -O2 -Itools/hosttest/bench -DBENCH_SIZE=$size tools/hosttest/bench_lookup.cpp src/params.cpp src/my_string.c
+   run bench_compact$size -O2 -DPARAM_SAVE_COMPACT -Itools/hosttest/bench -DBENCH_SIZE=$size tools/hosttest/bench_compact.cpp \
+       src/param_save.cpp src/params.cpp src/crc32.cpp src/my_string.c tools/paramimage/hostshim.cpp
+   run bench_journal$size -O2 -Itools/hosttest/bench -DBENCH_SIZE=$size tools/hosttest/bench_journal.cpp \
+       src/param_save.cpp src/param_journal.cpp src/params.cpp src/crc8.cpp src/crc32.cpp src/my_string.c \
+       tools/paramimage/hostshim.cpp
+done
@@ -0,0 +1,264 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Power loss test of A/B saving, built with a second configuration sector
+ *
+ * Each save of a new configuration, parameters and the CAN maps of both
+ * interfaces, is repeated with the power cut at each of its flash operations
+ * like TerminalCommands::SaveParameters() does them. After a cut the old
+ * configuration must load entirely and its bank must be untouched, after a
+ * complete save the new one. Saving again must then recover. Runs with the
+ * legacy and the compact parameter page. Legacy pages of a firmware before
+ * A/B saving have an erased sequence number and must still load and be
+ * replaced by the next save.
+ */
+#include <string.h>
+#include <vector>
+#include "hosttest.h"
+#include "hostcan.h"
+#include "hwdefs.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+#ifndef FLASH_CONF_BASE2
+#error Build with a second configuration sector
+#endif
+
+#define SECTOR_SIZE 16384
+
+struct Item
+{
+   Param::PARAM_NUM param;
+   int canId, offset, length;
+   float gain;
+   bool rx;
+
+   bool operator==(const Item& other) const
+   {
+      return param == other.param && canId == other.canId && offset == other.offset &&
+             length == other.length && gain == other.gain && rx == other.rx;
+   }
+};
+
+struct State
+{
+   s32fp values[Param::udc];
+   uint8_t flags[Param::udc];
+   std::vector<Item> items[2];
+
+   bool operator==(const State& other) const
+   {
+      return memcmp(values, other.values, sizeof(values)) == 0 && memcmp(flags, other.flags, sizeof(flags)) == 0 &&
+             items[0] == other.items[0] && items[1] == other.items[1];
+   }
+};
+
+static RamFlash flash(SECTOR_SIZE);
+static Can* cans[2];
+static std::vector<Item>* collecting;
+
+static void Collect(Param::PARAM_NUM param, int canId, int offset, int length, float gain, bool rx)
+{
+   Item item = { param, canId, offset, length, gain, rx };
+   collecting->push_back(item);
+}
+
+/** Only parameters are saved, values are not */
+static State Capture()
+{
+   State state;
+
+   for (int i = 0; i < Param::udc; i++)
+   {
+      state.values[i] = Param::Get((Param::PARAM_NUM)i);
+      state.flags[i] = Param::GetFlag((Param::PARAM_NUM)i);
+   }
+
+   for (int i = 0; i < 2; i++)
+   {
+      collecting = &state.items[i];
+      cans[i]->IterateCanMap(Collect);
+   }
+   return state;
+}
+
+/** Simulate a reset, parameters start at their defaults and the CAN maps load in the constructor */
+static int Reboot()
+{
+   for (int i = 0; i < Param::udc; i++)
+   {
+      Param::SetFixed((Param::PARAM_NUM)i, Param::GetAttrib((Param::PARAM_NUM)i)->def);
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, 0);
+   }
+
+   HostCan::Reset();
+   int result = parm_load();
+   cans[0] = HostCan::Create(CAN1);
+   cans[1] = HostCan::Create(CAN2);
+   return result;
+}
+
+/** Configuration number round, the CAN maps grow and shrink between rounds */
+static void Configure(int round)
+{
+   Param::SetInt(Param::boost, 1000 + round);
+   Param::SetInt(Param::fweak, 100 + round % 50);
+   Param::SetFlagsRaw(Param::trim, round & 1 ? Param::FLAG_HIDDEN : 0);
+
+   for (int i = 0; i < 2; i++)
+   {
+      CHECK(cans[i]->Clear() >= 0);
+      CHECK(cans[i]->AddSend(Param::udc, 0x100 + round, 0, 16, 1) > 0);
+
+      for (int item = 0; item < (round + i) % 4; item++)
+         CHECK(cans[i]->AddSend(Param::idc, 0x180 + item, 16, 16, 0.5 * item, -round) > 0);
+
+      CHECK(cans[i]->AddRecv(Param::fweak, 0x200 + round, 8 * i, 8, 1) > 0);
+      CHECK(cans[i]->SetSendTiming(0x100 + round, 10 + round % 5, 1, 0) == 0);
+   }
+}
+
+/** Save like TerminalCommands::SaveParameters() */
+static void Save()
+{
+   flash.EraseBank(parm_save_bank());
+   cans[0]->Save();
+   cans[1]->Save();
+   parm_save();
+}
+
+/** Save configuration round with the power cut at every flash operation of the save */
+static long SaveWithPowerCuts(int round)
+{
+   State before = Capture();
+   int activeBefore = parm_active_bank();
+   RamFlash saved = flash;
+   long cut;
+
+   for (cut = 0; ; cut++)
+   {
+      bool complete = true;
+
+      flash = saved;
+      Reboot();
+      Configure(round);
+      State after = Capture();
+      flash.SetPowerCut(cut);
+
+      try
+      {
+         Save();
+      }
+      catch (RamFlash::PowerCut&)
+      {
+         complete = false;
+      }
+
+      flash.SetPowerCut(-1);
+      int loaded = Reboot();
+
+      if (complete)
+      {
+         CHECK(loaded == 0);
+         CHECK(Capture() == after);
+         CHECK(parm_active_bank() != activeBefore);
+         break;
+      }
+
+      CHECK(Capture() == before);
+      CHECK(parm_active_bank() == activeBefore);
+      CHECK(memcmp(flash.GetBank(activeBefore), saved.GetBank(activeBefore), SECTOR_SIZE) == 0);
+
+      //Saving again after the cut recovers
+      Configure(round);
+      Save();
+      CHECK(Reboot() == 0);
+      CHECK(Capture() == after);
+   }
+
+   return cut;
+}
+
+#ifndef PARAM_SAVE_COMPACT
+/** Strip the sequence number from the page of bank 0, as saved before A/B saving */
+static void MakeOldFirmwareImage()
+{
+   RamFlash old(SECTOR_SIZE);
+   const uint32_t* bank = flash.GetBank(0);
+   const uint32_t sequenceWord = PARAM_BLKOFFSET / 4 + 2 * ((PARAM_BLKSIZE - 8) / 8) + 1;
+
+   for (uint32_t i = 0; i < SECTOR_SIZE / 4; i++)
+   {
+      if (bank[i] != 0xFFFFFFFF && i != sequenceWord)
+         old.ProgramWord(0, i, bank[i]);
+   }
+   flash = old;
+}
+
+static void TestOldFirmware()
+{
+   flash = RamFlash(SECTOR_SIZE);
+   Reboot();
+   Configure(100);
+   State first = Capture();
+   Save();
+   CHECK(parm_active_bank() == 0);
+   MakeOldFirmwareImage();
+
+   CHECK(Reboot() == 0);
+   CHECK(Capture() == first);
+   CHECK(parm_active_bank() == 0);
+   CHECK(parm_save_bank() == 1);
+
+   //The next save goes to the other bank and becomes the active one
+   SaveWithPowerCuts(101);
+   CHECK(parm_active_bank() == 1);
+}
+#endif // PARAM_SAVE_COMPACT
+
+int main()
+{
+   parm_set_flash(&flash);
+
+   //Nothing saved yet
+   CHECK(Reboot() == -1);
+   CHECK(parm_active_bank() == -1);
+
+   //Without a valid bank the CAN maps load from bank 0 like before A/B saving,
+   //so the cuts start with the second save
+   Configure(0);
+   Save();
+   CHECK(Reboot() == 0);
+   CHECK(parm_active_bank() == 0);
+
+   long cuts = 0;
+
+   for (int round = 1; round < 7; round++)
+   {
+      cuts += SaveWithPowerCuts(round);
+      CHECK(parm_active_bank() == (round & 1));
+   }
+
+   printf("%ld power cuts\n", cuts);
+
+#ifndef PARAM_SAVE_COMPACT
+   TestOldFirmware();
+#endif // PARAM_SAVE_COMPACT
+
+   return TestResult("ab");
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Test of the filter configuration on the bxCAN model: banks used per
+ * interface, ids let through that are not ours and the time ConfigureFilters()
+ * takes when ids have to be merged. Built with MAX_MESSAGES 10 and 128. */
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+static RamFlash flash(16384);
+
+static Can* Create(uint32_t canport, int can2Start)
+{
+   CAN_FMR(CAN1) = (CAN_FMR(CAN1) & ~0x3F00) | (can2Start << 8);
+   return HostCan::Create(canport);
+}
+
+static void Init()
+{
+   HostCan::Reset();
+   parm_set_flash(&flash);
+}
+
+/** @return true if a frame with this id reaches the udc mapping */
+static bool Updates(Can* can, uint32_t canport, uint32_t id)
+{
+   uint32_t data[2] = { (id * 7) & 0xFFFF, 0 };
+   int fifo = HostCan::Receive(canport, id, id > 0x7FF, data);
+
+   Param::SetInt(Param::udc, 0xFFFFF);
+   if (fifo >= 0) can->HandleRx(fifo);
+   return Param::GetInt(Param::udc) == (int)data[0];
+}
+
+/** @return number of standard ids let through by the filters that are neither SDO nor mapped */
+static int FalseAccepts(Can* can, uint32_t canport, const uint32_t* ids, int count)
+{
+   int accepted = 0;
+
+   for (uint32_t id = 0; id <= 0x7FF; id++)
+   {
+      bool ours = id == 0x601;
+
+      for (int i = 0; i < count; i++)
+         ours |= ids[i] == id;
+
+      int fifo = HostCan::Receive(canport, id, false);
+
+      if (fifo >= 0)
+      {
+         can->HandleRx(fifo);
+         accepted += !ours;
+      }
+   }
+   return accepted;
+}
+
+static void Map(Can* can, const uint32_t* ids, int count)
+{
+   for (int i = 0; i < count; i++)
+      CHECK(can->AddRecv(Param::udc, ids[i], 0, 16, 1) == i + 1);
+}
+
+static void TestBanksPerInterface()
+{
+   const uint32_t ids[] = { 0x100, 0x123, 0x200, 0x201, 0x3FF, 0x400, 0x555, 0x7FF, 0x1000, 0x1ABCDEF };
+
+   Init();
+   Can* can1 = Create(CAN1, 14);
+   Can* can2 = Create(CAN2, 14);
+
+   //SDO and 8 standard ids in 3 list banks, the 2 extended ids in one bank
+   Map(can1, ids, 10);
+   CHECK(HostCan::ActiveBanks(CAN1) == 4);
+   CHECK(HostCan::ActiveBanks(CAN2) == 1);
+
+   for (int i = 0; i < 10; i++)
+      CHECK(Updates(can1, CAN1, ids[i]));
+
+   //CAN2 has its own banks, CAN1 frames don't reach it and vice versa
+   Map(can2, ids + 2, 3);
+   CHECK(HostCan::ActiveBanks(CAN1) == 4);
+   CHECK(HostCan::ActiveBanks(CAN2) == 1);
+   CHECK(Updates(can2, CAN2, 0x200));
+   CHECK(!Updates(can2, CAN2, 0x100));
+   CHECK(Updates(can1, CAN1, 0x100));
+   CHECK(FalseAccepts(can1, CAN1, ids, 10) == 0);
+}
+
+static void TestClusteredIds()
+{
+   //Two runs of ids, each fits exactly in one mask
+   const uint32_t ids[] = { 0x107, 0x100, 0x102, 0x101, 0x106, 0x103, 0x105, 0x104, 0x381, 0x380 };
+
+   Init();
+   Can* can = Create(CAN1, 2);
+
+   Map(can, ids, 10);
+   CHECK(HostCan::ActiveBanks(CAN1) == 2);
+
+   for (int i = 0; i < 10; i++)
+      CHECK(Updates(can, CAN1, ids[i]));
+   CHECK(Updates(can, CAN1, 0x601) == false); //SDO, does not touch udc
+
+   CHECK(FalseAccepts(can, CAN1, ids, 10) == 0);
+}
+
+static void TestScatteredIds()
+{
+   const uint32_t ids[] = { 0x010, 0x0F3, 0x150, 0x2A7, 0x301, 0x444, 0x5A5, 0x6C0, 0x70F, 0x7F0 };
+
+   for (int budget = 1; budget <= 3; budget++)
+   {
+      Init();
+      Can* can = Create(CAN1, budget);
+
+      Map(can, ids, 10);
+      CHECK(HostCan::ActiveBanks(CAN1) <= budget);
+      CHECK(HostCan::ActiveBanks(CAN2) == 0);
+
+      for (int i = 0; i < 10; i++)
+         CHECK(Updates(can, CAN1, ids[i]));
+
+      int falseAccepts = FalseAccepts(can, CAN1, ids, 10);
+
+      //3 list banks take all ids, every bank less lets through more but far from all
+      if (budget == 3)
+         CHECK(falseAccepts == 0);
+      else
+         CHECK(falseAccepts > 0 && falseAccepts < 0x7FF - 11);
+      printf("%d bank(s) for 11 scattered ids: %d other standard ids let through\n", budget, falseAccepts);
+   }
+}
+
+static void TestMergeTime()
+{
+   //Worst case: every mapped id needs merging into a single bank
+   Init();
+   Can* can = Create(CAN1, 1);
+
+   uint64_t worst = 0;
+
+   for (int i = 0; i < MAX_MESSAGES; i++)
+   {
+      uint32_t id = (i * 0x29B) & 0x7FF;
+      uint64_t start = NowNs();
+
+      CHECK(can->AddRecv(Param::udc, id, 0, 16, 1) == i + 1);
+
+      uint64_t ns = NowNs() - start;
+      if (ns > worst) worst = ns;
+
+      CHECK(Updates(can, CAN1, id));
+   }
+
+   CHECK(HostCan::ActiveBanks(CAN1) == 1);
+   printf("AddRecv with %d ids into 1 bank: %.1f us worst case\n", MAX_MESSAGES, worst / 1000.0);
+}
+
+int main()
+{
+   TestBanksPerInterface();
+   TestClusteredIds();
+   TestScatteredIds();
+   TestMergeTime();
+
+   return TestResult("can_filters");
+}
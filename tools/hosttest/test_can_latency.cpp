@@ -0,0 +1,119 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Simulation of the transmit latency per priority class on the bxCAN model.
+ * Time is counted in frame slots, the bus sends one frame per slot and the
+ * pending mailbox with the lowest id wins. Every 10 slots SendAll() sends a
+ * burst of 8 normal frames, high priority frames are sent at random slots.
+ * The worst case is compared with and without SetHighPriorityIdLimit(). */
+#include <stdlib.h>
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+#define SLOTS 100000
+#define BURST_PERIOD 10
+#define BURST_FRAMES 8
+#define HIGH_ID 0x100
+#define NORMAL_ID 0x300
+
+struct Latency
+{
+   int worst[2]; //high, normal
+   long sum[2];
+   long count[2];
+};
+
+static RamFlash flash(16384);
+static uint32_t sendSlot[SLOTS * 2];
+
+static Latency Simulate(uint32_t idLimit)
+{
+   Latency result = { { 0, 0 }, { 0, 0 }, { 0, 0 } };
+   uint32_t seq = 0;
+
+   Can* can = HostCan::Boot(&flash);
+   can->SetHighPriorityIdLimit(idLimit);
+   srand(1);
+
+   for (uint32_t slot = 0; slot < SLOTS; slot++)
+   {
+      if (slot % BURST_PERIOD == 0)
+      {
+         //Ids in reverse so later frames of a burst win arbitration over earlier ones
+         for (int i = 0; i < BURST_FRAMES; i++)
+         {
+            uint32_t data[2] = { seq, 0 };
+            sendSlot[seq++] = slot;
+            can->Send(NORMAL_ID + BURST_FRAMES - i, data);
+         }
+      }
+
+      //One high priority frame every 10 slots on average, also within bursts
+      if (rand() % BURST_PERIOD == 0)
+      {
+         uint32_t data[2] = { seq, 0 };
+         sendSlot[seq++] = slot;
+         can->Send(HIGH_ID, data);
+      }
+
+      HostCanFrame frame;
+
+      if (HostCan::Transmit(CAN1, &frame))
+      {
+         int cls = frame.id == HIGH_ID ? 0 : 1;
+         int latency = slot - sendSlot[frame.data[0]] + 1;
+
+         if (latency > result.worst[cls]) result.worst[cls] = latency;
+         result.sum[cls] += latency;
+         result.count[cls]++;
+      }
+
+      while (HostCan::TxIrq(CAN1))
+         can->HandleTx();
+   }
+
+   CHECK(can->GetSendDrops() == 0);
+   return result;
+}
+
+static void Print(const char* name, const Latency& l)
+{
+   printf("%-22s high: worst %3d avg %5.2f  normal: worst %3d avg %5.2f slots\n", name,
+          l.worst[0], (double)l.sum[0] / l.count[0], l.worst[1], (double)l.sum[1] / l.count[1]);
+}
+
+int main()
+{
+   Latency shared = Simulate(0);
+   Latency prioritized = Simulate(HIGH_ID + 1);
+
+   Print("one queue", shared);
+   Print("high priority limit", prioritized);
+
+   //A high priority frame waits at most for the frame on the bus
+   CHECK(prioritized.worst[0] <= 2);
+   //Behind a whole burst in the shared queue
+   CHECK(shared.worst[0] > BURST_FRAMES / 2);
+   //Normal frames still get through, only somewhat later
+   CHECK(prioritized.worst[1] <= shared.worst[1] + 3);
+   CHECK(prioritized.count[1] == shared.count[1]);
+
+   return TestResult("can_latency");
+}
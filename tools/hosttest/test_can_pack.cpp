@@ -0,0 +1,170 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Golden test of packing send items into and unpacking receive items from
+ * the 64 frame bits, for every offset and length Add() accepts, and of the
+ * ranges it rejects. The expected frames are built bit by bit. Built with
+ * the undefined behaviour sanitizer, which catches bad shifts and float
+ * conversions on the way. */
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+static RamFlash flash(16384);
+static Can* can;
+
+static void Init()
+{
+   can = HostCan::Boot(&flash);
+}
+
+/** Place the lowest length bits of value at offset, one bit at a time */
+static uint64_t PlaceBits(uint64_t frame, int offset, int length, uint32_t value)
+{
+   for (int bit = 0; bit < length; bit++)
+   {
+      uint64_t mask = 1ULL << (offset + bit);
+      frame = (value >> bit) & 1 ? frame | mask : frame & ~mask;
+   }
+   return frame;
+}
+
+static uint64_t SendOne(int offset, int length, int value)
+{
+   HostCanFrame frame;
+
+   can->Clear();
+   CHECK(can->AddSend(Param::udc, 0x100, offset, length, 1) == 1);
+   Param::SetFixed(Param::udc, value * FRAC_FAC); //FP_FROMINT() shifts negative values
+   can->SendAll();
+   CHECK(HostCan::Transmit(CAN1, &frame));
+
+   return frame.data[0] | ((uint64_t)frame.data[1] << 32);
+}
+
+static int ReceiveOne(int offset, int length, uint32_t value)
+{
+   //All other bits are set so they must be masked off
+   uint64_t frame = PlaceBits(~0ULL, offset, length, value);
+   uint32_t data[2] = { (uint32_t)frame, (uint32_t)(frame >> 32) };
+
+   can->Clear();
+   CHECK(can->AddRecv(Param::udc, 0x100, offset, length, 1) == 1);
+   Param::SetFixed(Param::udc, -FRAC_FAC);
+   can->HandleRx(HostCan::Receive(CAN1, 0x100, false, data));
+
+   return Param::GetInt(Param::udc);
+}
+
+static void TestGolden()
+{
+   //Parameters hold 26 integer bits, negative values fill the upper bits of long items
+   const int values[] = { 0x2A5A5A5, -0x1234567, -1, 1 };
+
+   for (int offset = 0; offset < 64; offset++)
+   {
+      for (int length = 1; length <= 32 && offset + length <= 64; length++)
+      {
+         for (int i = 0; i < 4; i++)
+            CHECK(SendOne(offset, length, values[i]) == PlaceBits(0, offset, length, values[i]));
+
+         uint32_t value = 0x2A5A5A5 & (uint32_t)((1ULL << (length < 26 ? length : 26)) - 1);
+         CHECK(ReceiveOne(offset, length, value) == (int)value);
+      }
+   }
+}
+
+static uint32_t SendScaled(float gain, int16_t offset, float value)
+{
+   HostCanFrame frame;
+
+   can->Clear();
+   CHECK(can->AddSend(Param::udc, 0x100, 0, 32, gain, offset) == 1);
+   Param::SetFixed(Param::udc, FP_FROMFLT(value));
+   can->SendAll();
+   CHECK(HostCan::Transmit(CAN1, &frame));
+
+   return frame.data[0];
+}
+
+static s32fp ReceiveScaled(float gain, uint32_t value)
+{
+   uint32_t data[2] = { value, 0 };
+
+   can->Clear();
+   CHECK(can->AddRecv(Param::udc, 0x100, 0, 32, gain) == 1);
+   can->HandleRx(HostCan::Receive(CAN1, 0x100, false, data));
+
+   return Param::Get(Param::udc);
+}
+
+static void TestScaling()
+{
+   //All gains are integers scaled by a power of two, results truncate towards zero like float
+   CHECK(SendScaled(1, -40, -100.5) == (uint32_t)-140);
+   CHECK(SendScaled(-3, 0, 7.25) == (uint32_t)-21);
+   CHECK(SendScaled(0.5, -32768, -1) == (uint32_t)-32768);
+   CHECK(SendScaled(0.1, -40, -100.5) == (uint32_t)-50);
+   CHECK(SendScaled(-0.3, 0, 7) == (uint32_t)-2);
+   CHECK(SendScaled(0.3, 0, -1) == 0);
+   //Decimal gains are rounded like float, 0.7f alone is 0.69999999
+   CHECK(SendScaled(0.7, 0, 10) == 7);
+   CHECK(SendScaled(0.01, 0, -99400) == (uint32_t)-994);
+   CHECK(SendScaled(3.6, 5, -100000) == (uint32_t)-359995);
+   CHECK(ReceiveScaled(0.7, 10) == FP_FROMINT(7));
+   CHECK(ReceiveScaled(0.1, 1005) == FP_FROMFLT(100.5));
+   CHECK(ReceiveScaled(0.5, 3) == FP_FROMFLT(1.5));
+   //Values outside of int32_t saturate
+   CHECK(SendScaled(1e6, 0, 10000) == 0x7FFFFFFF);
+   CHECK(SendScaled(1e6, 0, -10000) == 0x80000000);
+   //Also with an exact power of two gain that is never rounded
+   CHECK(SendScaled(65536, 0, 100000) == 0x7FFFFFFF);
+   CHECK(SendScaled(65536, 0, -100000) == 0x80000000);
+   CHECK(ReceiveScaled(65536, 0x10000) == INT32_MAX);
+   CHECK(ReceiveScaled(-65536, 0x10000) == INT32_MIN);
+}
+
+static void TestRanges()
+{
+   Init();
+
+   CHECK(can->AddSend(Param::udc, 0x100, 64, 1, 1) == CAN_ERR_INVALID_OFS);
+   CHECK(can->AddSend(Param::udc, 0x100, -1, 8, 1) == CAN_ERR_INVALID_OFS);
+   CHECK(can->AddSend(Param::udc, 0x100, 0, 0, 1) == CAN_ERR_INVALID_LEN);
+   CHECK(can->AddSend(Param::udc, 0x100, 0, 33, 1) == CAN_ERR_INVALID_LEN);
+   CHECK(can->AddSend(Param::udc, 0x100, 57, 8, 1) == CAN_ERR_INVALID_LEN);
+   CHECK(can->AddRecv(Param::udc, 0x100, 33, 32, 1) == CAN_ERR_INVALID_LEN);
+   CHECK(can->AddRecv(Param::udc, 0x100, 200, 8, 1) == CAN_ERR_INVALID_OFS);
+   CHECK(can->AddSend(Param::udc, 0x20000000, 0, 8, 1) == CAN_ERR_INVALID_ID);
+
+   //The value offset is not a bit position, any int16_t is fine
+   CHECK(can->AddSend(Param::udc, 0x100, 56, 8, 1, 100) == 1);
+   CHECK(can->AddSend(Param::udc, 0x100, 0, 32, 1, -1000) == 1);
+   CHECK(can->AddRecv(Param::udc, 0x100, 32, 32, 1, 1000) == 1);
+}
+
+int main()
+{
+   TestRanges();
+   Init();
+   TestGolden();
+   TestScaling();
+
+   return TestResult("can_pack");
+}
@@ -0,0 +1,199 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Tests of receiving CAN frames on the bxCAN model: dispatch by filter match
+ * index on both FIFOs, frames that were matched by an older configuration
+ * and the receive map after it changed */
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+//The match index table is compared with the indexes the model reports
+#define private public
+#include "stm32_can.h"
+#undef private
+
+static RamFlash flash(16384);
+
+static Can* Init(int can2Start = 14)
+{
+   return HostCan::Boot(&flash, CAN1, can2Start);
+}
+
+/** Receive a frame with value in its first 16 bits */
+static void Receive(Can* can, uint32_t id, uint32_t value)
+{
+   uint32_t data[2] = { value, 0 };
+   int fifo = HostCan::Receive(CAN1, id, id > 0x7FF, data);
+
+   if (fifo >= 0) can->HandleRx(fifo);
+}
+
+static uint32_t userId = 0;
+
+static void UserCallback(uint32_t id, uint32_t*)
+{
+   userId = id;
+}
+
+/** @return true if the driver recorded the handler of a standard id at the match index of the frame in the FIFO */
+static bool InFmiTable(Can* can, int fifo, uint32_t canId, int handler)
+{
+   uint32_t id, data[2];
+   bool ext, rtr;
+   uint8_t fmi, len;
+
+   if (can_receive(CAN1, fifo, false, &id, &ext, &rtr, &fmi, &len, (uint8_t*)data, 0) == 0 || id != canId)
+      return false;
+
+   return fmi < FMI_ENTRIES && can->fmiTable[fifo][fmi].id == canId && can->fmiTable[fifo][fmi].handler == handler;
+}
+
+static void TestFilterMatchIndex()
+{
+   const uint32_t mapped[] = { 0x100, 0x101, 0x180, 0x200, 0x2FF, 0x350, 0x3A0, 0x400, 0x12345, 0x1FFFFFFF };
+   const uint32_t user[] = { 0x110, 0x7FF, 0x54321 };
+   int perFifo[2] = { 0, 0 };
+   Can* can = Init();
+
+   can->SetReceiveCallback(UserCallback);
+
+   for (int i = 0; i < 3; i++)
+      CHECK(can->RegisterUserMessage(user[i]));
+
+   for (int i = 0; i < 10; i++)
+      CHECK(can->AddRecv(Param::udc, mapped[i], 0, 16, 1) == i + 1);
+
+   //Banks alternate between the FIFOs, every id reaches its handler through the match index
+   for (int i = 0; i < 10; i++)
+   {
+      uint32_t data[2] = { (uint32_t)i + 1, 0 };
+      int fifo = HostCan::Receive(CAN1, mapped[i], mapped[i] > 0x7FF, data);
+
+      CHECK(fifo >= 0);
+      if (fifo < 0) continue;
+      perFifo[fifo]++;
+      //Extended ids have list filters of their own and are looked up
+      CHECK(mapped[i] > 0x7FF || InFmiTable(can, fifo, mapped[i], Can::RX_MAP + i));
+      can->HandleRx(fifo);
+      CHECK(Param::GetInt(Param::udc) == i + 1);
+   }
+
+   for (int i = 0; i < 3; i++)
+   {
+      int fifo = HostCan::Receive(CAN1, user[i], user[i] > 0x7FF);
+
+      CHECK(fifo >= 0);
+      if (fifo < 0) continue;
+      perFifo[fifo]++;
+      CHECK(user[i] > 0x7FF || InFmiTable(can, fifo, user[i], Can::RX_USER));
+      userId = 0;
+      can->HandleRx(fifo);
+      CHECK(userId == user[i]);
+   }
+
+   CHECK(perFifo[0] > 0 && perFifo[1] > 0);
+
+   //SDO read of the first parameter is answered
+   uint32_t request[2] = { 0x00200022, 0 };
+   int fifo = HostCan::Receive(CAN1, 0x601, false, request);
+   HostCanFrame reply;
+
+   CHECK(fifo >= 0 && InFmiTable(can, fifo, 0x601, Can::RX_SDO));
+   if (fifo >= 0) can->HandleRx(fifo);
+   CHECK(HostCan::Transmit(CAN1, &reply));
+   CHECK(reply.id == 0x581 && (reply.data[0] & 0xFF) == 0x43 && (int32_t)reply.data[1] == Param::Get((Param::PARAM_NUM)0));
+
+   //An extended id equal to a mapped standard id does not pass the list filters
+   CHECK(HostCan::Receive(CAN1, 0x100, true) < 0);
+   CHECK(HostCan::RxPending(CAN1, 0) == 0 && HostCan::RxPending(CAN1, 1) == 0);
+}
+
+static void TestStaleMatchIndex()
+{
+   Can* can = Init();
+
+   CHECK(can->AddRecv(Param::boost, 0x100, 0, 16, 1) == 1);
+   CHECK(can->AddRecv(Param::fweak, 0x200, 0, 16, 1) == 2);
+   CHECK(can->AddRecv(Param::udcmin, 0x300, 0, 16, 1) == 3);
+
+   //Frames wait in the FIFO with the match index of the current filters
+   uint32_t data[2] = { 77, 0 };
+   int fifo200 = HostCan::Receive(CAN1, 0x200, false, data);
+   data[0] = 88;
+   int fifo300 = HostCan::Receive(CAN1, 0x300, false, data);
+
+   //Reconfiguring moves all ids to other match indexes
+   CHECK(can->Remove(Param::boost) == 1);
+   CHECK(can->AddRecv(Param::boost, 0x080, 0, 16, 1) == 3);
+
+   can->HandleRx(fifo200);
+   if (fifo300 != fifo200) can->HandleRx(fifo300);
+
+   CHECK(Param::GetInt(Param::fweak) == 77);
+   CHECK(Param::GetInt(Param::udcmin) == 88);
+   CHECK(Param::GetInt(Param::boost) != 77 && Param::GetInt(Param::boost) != 88);
+}
+
+static void TestRemove(int can2Start)
+{
+   Can* can = Init(can2Start);
+
+   Param::SetInt(Param::boost, 0);
+   Param::SetInt(Param::fweak, 0);
+   Param::SetInt(Param::udcmin, 0);
+
+   CHECK(can->AddRecv(Param::boost, 0x100, 0, 16, 1) == 1);
+   CHECK(can->AddRecv(Param::fweak, 0x200, 0, 16, 1) == 2);
+   CHECK(can->AddRecv(Param::udcmin, 0x300, 0, 16, 1) == 3);
+
+   CHECK(can->Remove(Param::boost) == 1);
+
+   //0x200 and 0x300 moved to the front of the map
+   Receive(can, 0x200, 100);
+   Receive(can, 0x300, 200);
+   CHECK(Param::GetInt(Param::fweak) == 100);
+   CHECK(Param::GetInt(Param::udcmin) == 200);
+
+   //The removed id changes nothing
+   Receive(can, 0x100, 300);
+   CHECK(Param::GetInt(Param::boost) == 0);
+   CHECK(Param::GetInt(Param::fweak) == 100);
+
+   //Removing from the middle and re-adding
+   CHECK(can->AddRecv(Param::boost, 0x400, 0, 16, 1) == 3);
+   CHECK(can->Remove(Param::udcmin) == 1);
+   CHECK(can->Remove(Param::udcmin) == 0);
+   Receive(can, 0x400, 7);
+   Receive(can, 0x200, 8);
+   Receive(can, 0x300, 9);
+   CHECK(Param::GetInt(Param::boost) == 7);
+   CHECK(Param::GetInt(Param::fweak) == 8);
+   CHECK(Param::GetInt(Param::udcmin) == 200);
+}
+
+int main()
+{
+   TestFilterMatchIndex();
+   TestStaleMatchIndex();
+
+   //Single id filters and mask filters that leave the lookup to the hash
+   TestRemove(14);
+   TestRemove(1);
+
+   return TestResult("can_rx");
+}
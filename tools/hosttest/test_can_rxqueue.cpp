@@ -0,0 +1,177 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Multi-threaded stress test of the deferred receive path
+ *
+ * A producer thread stands in for the RX interrupt: it puts numbered frames
+ * into the bxCAN model and calls HandleRx(). A consumer thread stands in for
+ * the scheduler task calling ProcessRx(). Every frame must be dispatched
+ * exactly once, in order and in the consumer, or be counted as a drop.
+ * Bursts the queue can hold must not drop anything, long bursts into a
+ * consumer that pauses now and then make it overflow. The same
+ * frames dispatched by HandleRx() directly serve as reference. Also built
+ * with ThreadSanitizer.
+ */
+#include <thread>
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+#define FRAMES 200000
+#define USER_ID 0x300
+#define MAPPED_ID 0x200
+
+static RamFlash flash(16384);
+static Can* can;
+static std::thread::id dispatcher;
+static uint32_t lastSeq;
+static uint32_t received;
+static long outOfOrder, wrongThread;
+static volatile bool producing;
+
+static void Received(uint32_t id, uint32_t* data)
+{
+   if (id != USER_ID) return;
+
+   if (std::this_thread::get_id() != dispatcher)
+      wrongThread++;
+   if (received > 0 && data[0] <= lastSeq)
+      outOfOrder++;
+   if (data[1] != ~data[0])
+      outOfOrder++;
+
+   lastSeq = data[0];
+   __atomic_store_n(&received, received + 1, __ATOMIC_RELEASE);
+}
+
+static Can* Init()
+{
+   Can* c = HostCan::Boot(&flash);
+   c->SetReceiveCallback(Received);
+   CHECK(c->RegisterUserMessage(USER_ID));
+   CHECK(c->AddRecv(Param::udc, MAPPED_ID, 0, 16, 1) == 1);
+   return c;
+}
+
+/** Receive all frames in bursts
+ * \param burst frames per burst
+ * \param wait wait for ProcessRx() to dispatch a burst before the next one */
+static void Produce(int burst, bool wait)
+{
+   for (uint32_t seq = 1; seq <= FRAMES; seq++)
+   {
+      uint32_t data[2] = { seq, ~seq };
+      int fifo = HostCan::Receive(CAN1, USER_ID, false, data);
+
+      CHECK(fifo >= 0);
+      can->HandleRx(fifo);
+
+      if ((seq % burst) == 0)
+      {
+         while (wait && __atomic_load_n(&received, __ATOMIC_ACQUIRE) < seq)
+            std::this_thread::yield();
+         std::this_thread::yield();
+      }
+   }
+   __atomic_store_n(&producing, false, __ATOMIC_RELEASE);
+}
+
+static void Consume(bool slow)
+{
+   long calls = 0;
+
+   while (__atomic_load_n(&producing, __ATOMIC_ACQUIRE))
+   {
+      can->ProcessRx();
+
+      //A busy task misses its slot every so often
+      if (slow && (++calls % 16) == 0)
+         std::this_thread::sleep_for(std::chrono::microseconds(50));
+      else
+         std::this_thread::yield();
+   }
+   can->ProcessRx();
+}
+
+static void ResetCounts()
+{
+   received = 0;
+   outOfOrder = 0;
+   wrongThread = 0;
+   lastSeq = 0;
+   producing = true;
+}
+
+static void TestImmediate()
+{
+   can = Init();
+   ResetCounts();
+   dispatcher = std::this_thread::get_id();
+   Produce(1, false);
+
+   CHECK(received == FRAMES);
+   CHECK(outOfOrder == 0 && wrongThread == 0);
+   CHECK(can->GetRecvDrops() == 0);
+   CHECK(can->GetRecvHighWater() == 0);
+}
+
+/** \param flood the bus sends long bursts without waiting and the task is slow */
+static void TestDeferred(bool flood)
+{
+   can = Init();
+   can->SetDeferredRx(true);
+   ResetCounts();
+
+   std::thread consumer(Consume, flood);
+   dispatcher = consumer.get_id();
+   std::thread producer(Produce, flood ? 4 * RECVBUFFER_LEN : RECVBUFFER_LEN, !flood);
+   producer.join();
+   consumer.join();
+
+   uint32_t drops = can->GetRecvDrops();
+   uint32_t highWater = can->GetRecvHighWater();
+
+   CHECK(received + drops == FRAMES);
+   CHECK(outOfOrder == 0 && wrongThread == 0);
+   CHECK(highWater <= RECVBUFFER_LEN);
+   if (flood)
+      CHECK(drops > 0 && highWater == RECVBUFFER_LEN);
+   else
+      CHECK(drops == 0);
+
+   printf("%s: %u dispatched, %u dropped, queue depth up to %u\n",
+          flood ? "flooded" : "bursts of RECVBUFFER_LEN", received, drops, highWater);
+
+   //Mapped parameters are only set when ProcessRx() runs
+   uint32_t data[2] = { 1234, 0 };
+   Param::SetInt(Param::udc, 0);
+   can->HandleRx(HostCan::Receive(CAN1, MAPPED_ID, false, data));
+   CHECK(Param::GetInt(Param::udc) == 0);
+   can->ProcessRx();
+   CHECK(Param::GetInt(Param::udc) == 1234);
+}
+
+int main()
+{
+   TestImmediate();
+   TestDeferred(false);
+   TestDeferred(true);
+
+   return TestResult("can_rxqueue");
+}
@@ -0,0 +1,182 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Test of the per message send timing on a realistic map: a 1 ms torque
+ * frame next to 10 ms, 100 ms and 1 s frames and one sent on change, with
+ * SendAll() called every millisecond. Counts the frames that reach the bus
+ * against sending everything on every call, also after saving and loading
+ * the timing and after removing a message. */
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+#define CALLS 10000
+#define NUM_MESSAGES 8
+#define CHANGE_ID 0x108
+#define CHANGE_GAP 20
+#define CHANGE_EVERY 7
+
+static RamFlash flash(16384);
+static Can* can;
+
+struct Message
+{
+   uint32_t id;
+   Param::PARAM_NUM param;
+   int period;
+   int phase;
+   int minGap;
+};
+
+static const Message messages[NUM_MESSAGES] =
+{
+   { 0x101, Param::idc,      1,    0,   0 },          //torque request
+   { 0x102, Param::speed,    10,   0,   0 },
+   { 0x103, Param::udc,      100,  3,   0 },
+   { 0x104, Param::fweak,    100,  53,  0 },
+   { 0x105, Param::tmphs,    1000, 0,   0 },          //temperatures
+   { 0x106, Param::udcmin,   1000, 333, 0 },
+   { 0x107, Param::polepairs, 1000, 666, 0 },
+   { CHANGE_ID, Param::boost, 0,   0,   CHANGE_GAP },  //status, on change only
+};
+
+static Can* Init()
+{
+   return HostCan::Boot(&flash);
+}
+
+/** Run SendAll() like a 1 ms task, the bus takes every frame before the next call
+ * \param timed check the on change message against its timing
+ * \return number of frames sent */
+static long Run(long* perMessage, bool timed = true)
+{
+   HostCanFrame frame;
+   long lastChangeSent = -CHANGE_GAP, frames = 0;
+   int lastChangeValue = -1;
+
+   for (int i = 0; i < NUM_MESSAGES; i++)
+      perMessage[i] = 0;
+
+   for (long call = 0; call < CALLS; call++)
+   {
+      Param::SetInt(Param::boost, call / CHANGE_EVERY);
+      can->SendAll();
+
+      while (HostCan::Transmit(CAN1, &frame))
+      {
+         can->HandleTx();
+         frames++;
+
+         for (int i = 0; i < NUM_MESSAGES; i++)
+         {
+            if (messages[i].id == frame.id)
+               perMessage[i]++;
+         }
+
+         if (timed && frame.id == CHANGE_ID)
+         {
+            //Only sent with a new value and never faster than the gap
+            CHECK(call - lastChangeSent >= CHANGE_GAP);
+            CHECK((int)(frame.data[0] & 0xFFFF) != lastChangeValue);
+            lastChangeSent = call;
+            lastChangeValue = frame.data[0] & 0xFFFF;
+         }
+      }
+   }
+   CHECK(can->GetSendDrops() == 0);
+
+   return frames;
+}
+
+static void CheckCounts(const long* perMessage, int numMessages)
+{
+   for (int i = 0; i < numMessages; i++)
+   {
+      if (messages[i].period > 0)
+         CHECK(perMessage[i] == CALLS / messages[i].period);
+   }
+   //A new value every 7 calls goes out after at most 20 + 6 calls
+   CHECK(perMessage[NUM_MESSAGES - 1] >= CALLS / (CHANGE_GAP + CHANGE_EVERY - 1));
+   CHECK(perMessage[NUM_MESSAGES - 1] <= CALLS / CHANGE_GAP);
+}
+
+static void TestBusLoad()
+{
+   long perMessage[NUM_MESSAGES];
+
+   can = Init();
+
+   for (int i = 0; i < NUM_MESSAGES; i++)
+      CHECK(can->AddSend(messages[i].param, messages[i].id, 0, 16, 1) == i + 1);
+
+   //Without timing every message goes out on every call
+   long all = Run(perMessage, false);
+   CHECK(all == (long)CALLS * NUM_MESSAGES);
+
+   for (int i = 0; i < NUM_MESSAGES; i++)
+   {
+      const Message& m = messages[i];
+      CHECK(can->SetSendTiming(m.id, m.period, m.phase, m.minGap) == 0);
+   }
+
+   long timed = Run(perMessage);
+   CheckCounts(perMessage, NUM_MESSAGES);
+
+   printf("%d messages, %d calls: %ld frames on every call, %ld with timing, %.1f%% of the bus load\n",
+          NUM_MESSAGES, CALLS, all, timed, 100.0 * timed / all);
+
+   //The timing is saved with the map
+   can->Save();
+   can = Init();
+
+   for (int i = 0; i < NUM_MESSAGES; i++)
+   {
+      int period, phase, minGap;
+
+      CHECK(can->GetSendTiming(messages[i].id, period, phase, minGap));
+      CHECK(period == messages[i].period && phase == messages[i].phase && minGap == messages[i].minGap);
+   }
+
+   CHECK(Run(perMessage) == timed);
+   CheckCounts(perMessage, NUM_MESSAGES);
+}
+
+static void TestRemove()
+{
+   long perMessage[NUM_MESSAGES];
+
+   //Removing the 10 ms frame moves all later messages down, their timing goes with them
+   CHECK(can->Remove(Param::speed) == 1);
+   CHECK(Run(perMessage) > 0);
+   CHECK(perMessage[1] == 0);
+   CHECK(perMessage[0] == CALLS);
+
+   for (int i = 2; i < NUM_MESSAGES - 1; i++)
+      CHECK(perMessage[i] == CALLS / messages[i].period);
+
+   CHECK(perMessage[NUM_MESSAGES - 1] <= CALLS / CHANGE_GAP);
+}
+
+int main()
+{
+   TestBusLoad();
+   TestRemove();
+
+   return TestResult("can_sched");
+}
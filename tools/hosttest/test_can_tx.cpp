@@ -0,0 +1,258 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Tests of the CAN send queues with all TX mailboxes full, the TX interrupt
+ * and interrupts that send while the task or HandleTx() are interrupted.
+ * The preemption tests let the interrupt hit every access to the CAN
+ * peripheral in turn. Interrupts above CAN_SEND_PRIORITY must not be held
+ * back by Send(). High priority frames may overtake queued normal ones. */
+#include <vector>
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+
+static RamFlash flash(16384);
+static Can* can;
+static std::vector<HostCanFrame> sent;
+
+static void Init()
+{
+   can = HostCan::Boot(&flash);
+   sent.clear();
+}
+
+static void Send(uint32_t id, uint32_t seq)
+{
+   uint32_t data[2] = { seq, ~seq };
+   can->Send(id, data);
+}
+
+/** Bus sends until all mailboxes are empty, the TX interrupt runs when requested */
+static void RunBus()
+{
+   HostCanFrame frame;
+
+   for (;;)
+   {
+      if (HostCan::TxIrq(CAN1))
+         can->HandleTx();
+      else if (HostCan::Transmit(CAN1, &frame))
+         sent.push_back(frame);
+      else
+         break;
+   }
+}
+
+/** @return number of frames sent with the given id */
+static int SentCount(uint32_t id)
+{
+   int count = 0;
+
+   for (size_t i = 0; i < sent.size(); i++)
+      count += sent[i].id == id;
+
+   return count;
+}
+
+static void TestMailboxFull()
+{
+   Init();
+
+   //Three frames go straight to the mailboxes
+   for (uint32_t i = 0; i < 3; i++)
+      Send(0x100 + i, i);
+
+   CHECK(HostCan::TxPending(CAN1) == 3);
+   CHECK((HostCan::GetIer(CAN1) & CAN_IER_TMEIE) == 0);
+   CHECK(can->GetSendHighWater() == 0);
+
+   //The rest waits for the TX interrupt
+   for (uint32_t i = 3; i < 3 + SENDBUFFER_LEN; i++)
+      Send(0x100 + i, i);
+
+   CHECK(HostCan::TxPending(CAN1) == 3);
+   CHECK(HostCan::GetIer(CAN1) & CAN_IER_TMEIE);
+   CHECK(can->GetSendHighWater() == SENDBUFFER_LEN);
+   CHECK(can->GetSendDrops() == 0);
+
+   //The queue is full now
+   Send(0x200, 0);
+   Send(0x201, 0);
+   CHECK(can->GetSendDrops() == 2);
+
+   RunBus();
+
+   //Increasing ids win arbitration in send order, so this is the queue order
+   CHECK(sent.size() == 3 + SENDBUFFER_LEN);
+
+   for (uint32_t i = 0; i < sent.size(); i++)
+      CHECK(sent[i].id == 0x100 + i && sent[i].data[0] == i && sent[i].data[1] == ~i);
+
+   //Nothing left, the interrupt is off again
+   CHECK((HostCan::GetIer(CAN1) & CAN_IER_TMEIE) == 0);
+   CHECK(HostCan::TxPending(CAN1) == 0);
+
+   //An idle interface sends directly again
+   Send(0x300, 1);
+   CHECK(HostCan::TxPending(CAN1) == 1);
+   CHECK((HostCan::GetIer(CAN1) & CAN_IER_TMEIE) == 0);
+}
+
+static void SendFromIsr()
+{
+   Send(0x400, 0);
+}
+
+static void TestSendDuringHandleTx()
+{
+   for (long call = 0; ; call++)
+   {
+      Init();
+
+      //Full mailboxes and one queued frame
+      for (uint32_t i = 0; i < 4; i++)
+         Send(0x100 + i, i);
+
+      //The bus frees a mailbox, HandleTx() refills it and empties the queue
+      HostCanFrame frame;
+      HostCan::Transmit(CAN1, &frame);
+      sent.push_back(frame);
+
+      //A higher priority interrupt finds all mailboxes full and queues its frame
+      HostCan::PreemptAt(call, SendFromIsr);
+      can->HandleTx();
+
+      if (!HostCan::Preempted()) break;
+      HostCan::PreemptAt(-1, 0);
+
+      RunBus();
+
+      //Used to stay queued when it hit right before TMEIE was disabled
+      CHECK(sent.size() == 5);
+      CHECK(SentCount(0x400) == 1);
+      CHECK(can->GetSendDrops() == 0);
+   }
+}
+
+/** Like ProcessSDO() replying from the RX interrupt */
+static void SdoReplyFromIsr()
+{
+   Send(0x581, 0);
+}
+
+static void TestSdoReplyDuringSend()
+{
+   for (long call = 0; ; call++)
+   {
+      Init();
+
+      //Full mailboxes, nothing queued
+      for (uint32_t i = 0; i < 3; i++)
+         Send(0x100 + i, i);
+
+      //The task sends while the reply goes out from the interrupt
+      HostCan::PreemptAt(call, SdoReplyFromIsr);
+      Send(0x500, 1);
+
+      bool preempted = HostCan::Preempted();
+      HostCan::PreemptAt(-1, 0);
+
+      if (!preempted)
+         SdoReplyFromIsr();
+
+      RunBus();
+
+      //Both producers used to write the same queue slot
+      CHECK(sent.size() == 5);
+      CHECK(SentCount(0x500) == 1);
+      CHECK(SentCount(0x581) == 1);
+      CHECK(can->GetSendDrops() == 0);
+
+      if (!preempted) break;
+   }
+}
+
+static bool pwmDuringMask;
+
+/** Like the PWM interrupt, at the highest priority */
+static void PwmIsr()
+{
+   pwmDuringMask |= HostCan::IrqMasked(CAN_SEND_PRIORITY);
+}
+
+static void TestHigherPriorityDuringSend()
+{
+   pwmDuringMask = false;
+
+   for (long call = 0; ; call++)
+   {
+      Init();
+
+      //Full mailboxes, the frame is queued
+      for (uint32_t i = 0; i < 3; i++)
+         Send(0x100 + i, i);
+
+      HostCan::PreemptAt(call, PwmIsr, 0);
+      Send(0x500, 1);
+
+      bool preempted = HostCan::Preempted();
+      HostCan::PreemptAt(-1, 0);
+      if (!preempted) break;
+   }
+
+   //Used to wait for the end of Send() while all interrupts were masked
+   CHECK(pwmDuringMask);
+}
+
+static void TestHighPriorityOvertakes()
+{
+   Init();
+   can->SetHighPriorityIdLimit(0x100);
+
+   //Normal frames keep one mailbox free and queue the rest
+   for (uint32_t i = 0; i < 4; i++)
+      Send(0x300 + i, i);
+
+   CHECK(HostCan::TxPending(CAN1) == 2);
+
+   //A high priority frame goes straight to the free mailbox
+   Send(0x80, 0);
+   CHECK(HostCan::TxPending(CAN1) == 3);
+   CHECK(can->GetSendHighWater() == 2);
+
+   //Once it is queued the next one waits behind it
+   Send(0x81, 1);
+   CHECK(HostCan::TxPending(CAN1) == 3);
+
+   RunBus();
+   CHECK(sent.size() == 6);
+   CHECK(sent[0].id == 0x80 && sent[1].id == 0x81);
+   CHECK(SentCount(0x303) == 1);
+}
+
+int main()
+{
+   TestMailboxFull();
+   TestSendDuringHandleTx();
+   TestSdoReplyDuringSend();
+   TestHigherPriorityDuringSend();
+   TestHighPriorityOvertakes();
+
+   return TestResult("can_tx");
+}
@@ -0,0 +1,266 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Test of loading CAN maps from a simulated flash, built with different
+ * limits:
+ * - The fixed size layout, written with the default limits of 10 messages
+ *   and 10 items, must load with any MAX_MESSAGES and MAX_ITEMS_PER_MESSAGE,
+ *   dropping what does not fit, and migrate to the compact layout.
+ * - Compact maps must survive a round trip and be rejected when corrupted.
+ * - With a CAN_BLKSIZE too small for the fixed size layout at the end of
+ *   the sector, nothing is read past the block. That build runs with the
+ *   address sanitizer, the sector is exactly as large as the simulation.
+ */
+#include <string.h>
+#include <vector>
+#include "hosttest.h"
+#include "hostcan.h"
+#include "hwdefs.h"
+#include "param_save.h"
+#include "stm32_can.h"
+#include <libopencm3/stm32/crc.h>
+
+#define SECTOR_SIZE 16384
+//Fixed size layout as saved before the compact one
+#define LEGACY_MESSAGES 10
+#define LEGACY_ITEMS 10
+#define LEGACY_MAP_WORDS (LEGACY_MESSAGES * (1 + 3 * LEGACY_ITEMS))
+#define LEGACY_WORDS (2 * LEGACY_MAP_WORDS + 1)
+#define NUM_LEGACY_SEND 6
+
+struct LegacyPos
+{
+   uint16_t paramId;
+   int16_t offset;
+   float gain;
+   uint8_t offsetBits;
+   int8_t numBits;
+   uint8_t unused[2];
+};
+
+struct Item
+{
+   Param::PARAM_NUM param;
+   int canId, offset, length;
+   float gain;
+   bool rx;
+};
+
+static RamFlash flash(SECTOR_SIZE);
+static std::vector<Item> items;
+
+static void Collect(Param::PARAM_NUM param, int canId, int offset, int length, float gain, bool rx)
+{
+   Item item = { param, canId, offset, length, gain, rx };
+   items.push_back(item);
+}
+
+static Can* Init(uint32_t canport)
+{
+   return HostCan::Boot(&flash, canport);
+}
+
+static std::vector<Item> Iterate(Can* can)
+{
+   items.clear();
+   can->IterateCanMap(Collect);
+   return items;
+}
+
+static bool Equal(const std::vector<Item>& a, const std::vector<Item>& b)
+{
+   if (a.size() != b.size()) return false;
+
+   for (unsigned i = 0; i < a.size(); i++)
+   {
+      if (a[i].param != b[i].param || a[i].canId != b[i].canId || a[i].offset != b[i].offset ||
+          a[i].length != b[i].length || a[i].gain != b[i].gain || a[i].rx != b[i].rx)
+         return false;
+   }
+   return true;
+}
+
+#if CAN_BLKSIZE >= 4 * LEGACY_WORDS
+/** Write a map in the fixed size layout to the CAN1 block
+ * Send message i has i + 1 items, the first one all 10, the receive message
+ * has one. The words that were never set in RAM hold garbage. */
+static void WriteLegacyMap()
+{
+   uint32_t words[LEGACY_WORDS];
+   const Param::PARAM_NUM params[] = { Param::udc, Param::idc, Param::speed, Param::tmphs, Param::fweak };
+
+   for (int i = 0; i < LEGACY_WORDS; i++)
+      words[i] = 0xA5A5A5A5;
+
+   for (int map = 0; map < 2; map++)
+   {
+      int numMessages = map == 0 ? NUM_LEGACY_SEND : 1;
+
+      for (int i = 0; i < LEGACY_MESSAGES; i++)
+      {
+         uint32_t* record = words + map * LEGACY_MAP_WORDS + i * (1 + 3 * LEGACY_ITEMS);
+         int numItems = map == 1 ? 1 : i == 0 ? LEGACY_ITEMS : i + 1;
+
+         record[0] = i < numMessages ? (map == 0 ? 0x100 : 0x200) + i : 0xFFFFFFFF;
+
+         for (int j = 0; j < LEGACY_ITEMS; j++)
+         {
+            LegacyPos* pos = (LegacyPos*)(record + 1 + 3 * j);
+
+            pos->numBits = 0;
+            if (i >= numMessages || j >= numItems) continue;
+
+            pos->paramId = Param::GetAttrib(params[(i + j) % 5])->id;
+            pos->offset = 0;
+            pos->gain = j == 1 ? 0.1f : j + 1;
+            pos->offsetBits = 6 * j;
+            pos->numBits = 6;
+         }
+      }
+   }
+
+   crc_reset();
+   words[2 * LEGACY_MAP_WORDS] = crc_calculate_block(words, 2 * LEGACY_MAP_WORDS);
+
+   flash.EraseBank(0);
+   for (int i = 0; i < LEGACY_WORDS; i++)
+      flash.ProgramWord(0, CAN1_BLKOFFSET / 4 + i, words[i]);
+}
+
+static void CheckLegacyMap(Can* can)
+{
+   std::vector<Item> map = Iterate(can);
+   int expected = 0, period, phase, minGap;
+
+   for (int i = 0; i < NUM_LEGACY_SEND && i < MAX_MESSAGES; i++)
+   {
+      int numItems = i == 0 ? LEGACY_ITEMS : i + 1;
+      int loaded = numItems < MAX_ITEMS_PER_MESSAGE ? numItems : MAX_ITEMS_PER_MESSAGE;
+
+      for (int j = 0; j < loaded && expected < (int)map.size(); j++, expected++)
+      {
+         const Item& item = map[expected];
+         CHECK(item.canId == 0x100 + i && !item.rx);
+         CHECK(item.offset == 6 * j && item.length == 6);
+         CHECK(item.gain == (j == 1 ? 0.1f : j + 1));
+      }
+
+      //The layout has no timing, every message is sent on each call
+      CHECK(can->GetSendTiming(0x100 + i, period, phase, minGap));
+      CHECK(period == 1 && phase == 0 && minGap == 0);
+   }
+
+   CHECK(!can->GetSendTiming(0x100 + MAX_MESSAGES, period, phase, minGap));
+   //The receive message has 1 item
+   CHECK(expected + 1 == (int)map.size());
+   CHECK(map.back().canId == 0x200 && map.back().rx);
+}
+
+static void TestLegacy()
+{
+   WriteLegacyMap();
+   Can* can = Init(CAN1);
+   CheckLegacyMap(can);
+   std::vector<Item> loaded = Iterate(can);
+
+   //Migrated to the compact layout on save
+   flash.EraseBank(0);
+   can->Save();
+   CHECK(flash.GetBank(0)[CAN1_BLKOFFSET / 4] == 0x314E4143);
+   CHECK(flash.GetBank(0)[CAN1_BLKOFFSET / 4 + 1] < LEGACY_WORDS);
+
+   can = Init(CAN1);
+   CheckLegacyMap(can);
+   CHECK(Equal(Iterate(can), loaded));
+
+   //A corrupted fixed size map is not loaded
+   WriteLegacyMap();
+   std::vector<uint32_t> copy(flash.GetBank(0), flash.GetBank(0) + SECTOR_SIZE / 4);
+   copy[CAN1_BLKOFFSET / 4 + 40] ^= 0x100;
+   flash.EraseBank(0);
+   for (int i = 0; i < SECTOR_SIZE / 4; i++)
+      if (copy[i] != 0xFFFFFFFF) flash.ProgramWord(0, i, copy[i]);
+
+   CHECK(Iterate(Init(CAN1)).empty());
+}
+
+#endif
+
+/** Fill the map until the block is full, save, load and corrupt it */
+static void TestCompact(uint32_t canport, uint32_t blockOffset)
+{
+   Can* can = Init(canport);
+   int added = 0;
+
+   can->Clear();
+   //More than fits, the map or the block runs full
+   for (int i = 0; i < 4 * MAX_MESSAGES * MAX_ITEMS_PER_MESSAGE; i++)
+   {
+      int canId = (i % 2 ? 0x300 : 0x400) + i / (2 * MAX_ITEMS_PER_MESSAGE);
+      Param::PARAM_NUM param = (Param::PARAM_NUM)(i % Param::PARAM_LAST);
+      int result = i % 2 ? can->AddRecv(param, canId, i % 8 * 8, 8, 0.5f + i) : can->AddSend(param, canId, i % 8 * 8, 8, 2);
+
+      if (result >= 0) added++;
+   }
+
+   std::vector<Item> saved = Iterate(can);
+   CHECK((int)saved.size() == added);
+
+   flash.EraseBank(0);
+   can->Save();
+   CHECK(flash.GetBank(0)[blockOffset / 4 + 1] <= CAN_BLKSIZE / 4 - 3);
+   CHECK(Equal(Iterate(Init(canport)), saved));
+
+   printf("CAN_BLKSIZE %d, MAX_MESSAGES %d, MAX_ITEMS_PER_MESSAGE %d: %d items saved\n",
+          CAN_BLKSIZE, MAX_MESSAGES, MAX_ITEMS_PER_MESSAGE, added);
+
+   //A flipped bit anywhere is detected
+   std::vector<uint32_t> copy(flash.GetBank(0), flash.GetBank(0) + SECTOR_SIZE / 4);
+   copy[blockOffset / 4 + 3 + added / 2] ^= 0x8;
+   flash.EraseBank(0);
+   for (int i = 0; i < SECTOR_SIZE / 4; i++)
+      if (copy[i] != 0xFFFFFFFF) flash.ProgramWord(0, i, copy[i]);
+
+   CHECK(Iterate(Init(canport)).empty());
+}
+
+#if CAN_BLKSIZE < 4 * LEGACY_WORDS
+/** The fixed size layout does not fit the block, so it is not read */
+static void TestSmallBlock()
+{
+   flash.EraseBank(0);
+   //Looks like the start of a fixed size map
+   flash.ProgramWord(0, CAN2_BLKOFFSET / 4, 0x100);
+   flash.ProgramWord(0, CAN2_BLKOFFSET / 4 + 1, 0x12340001);
+
+   CHECK(Iterate(Init(CAN2)).empty());
+}
+#endif
+
+int main()
+{
+#if CAN_BLKSIZE >= 4 * LEGACY_WORDS
+   TestLegacy();
+   TestCompact(CAN1, CAN1_BLKOFFSET);
+#else
+   TestSmallBlock();
+   TestCompact(CAN2, CAN2_BLKOFFSET);
+#endif
+
+   return TestResult("canmap");
+}
@@ -0,0 +1,259 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Round trip test of the compact parameter page, built with PARAM_SAVE_COMPACT
+ *
+ * Random values, including the extremes whose deltas wrap around, and flags
+ * must load exactly as saved, saving in steps of any size must give the same
+ * page. Parameters without a record load their default. With the larger
+ * parameter list of tools/hosttest/bench a page full of changed parameters
+ * does not fit: parm_save_start() must find that out before anything is
+ * erased, parm_save() and ConfigSave must leave the flash untouched and the
+ * previous configuration must still load. Built with a second configuration
+ * sector, values that grow while saving must not commit the page either.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "hosttest.h"
+#include "hwdefs.h"
+#include "params.h"
+#include "param_save.h"
+#include "configsave.h"
+
+#ifndef PARAM_SAVE_COMPACT
+#error Build with PARAM_SAVE_COMPACT
+#endif
+
+#define SECTOR_SIZE 16384
+#define PAGE_WORDS (PARAM_BLKSIZE / 4)
+
+struct State
+{
+   s32fp values[Param::PARAM_LAST];
+   uint8_t flags[Param::PARAM_LAST];
+
+   bool operator==(const State& other) const
+   {
+      return memcmp(values, other.values, sizeof(values)) == 0 && memcmp(flags, other.flags, sizeof(flags)) == 0;
+   }
+};
+
+static RamFlash flash(SECTOR_SIZE);
+
+/** Only parameters are saved, values are left out */
+static State Capture()
+{
+   State state;
+
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      bool isParam = Param::IsParam((Param::PARAM_NUM)i);
+      state.values[i] = isParam ? Param::Get((Param::PARAM_NUM)i) : 0;
+      state.flags[i] = isParam ? Param::GetFlag((Param::PARAM_NUM)i) : 0;
+   }
+   return state;
+}
+
+/** Simulate a reset with garbage in RAM, loading must set every parameter */
+static int Reboot()
+{
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      Param::SetFixed((Param::PARAM_NUM)i, 0x12345);
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, Param::FLAG_HIDDEN);
+   }
+
+   return parm_load();
+}
+
+static void LoadDefaults()
+{
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, 0);
+   Param::LoadDefaults();
+}
+
+static s32fp RandomValue()
+{
+   switch (rand() % 4)
+   {
+   case 0: return rand() % 2 ? INT32_MAX : INT32_MIN;
+   case 1: return rand() % 2000 - 1000;
+   default: return (s32fp)((uint32_t)rand() << 16 ^ rand());
+   }
+}
+
+/** Change each parameter with the given probability in percent */
+static void ChangeParams(int percent)
+{
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      if (!Param::IsParam((Param::PARAM_NUM)i) || rand() % 100 >= percent) continue;
+
+      if (rand() % 4 == 0)
+         Param::SetFlagsRaw((Param::PARAM_NUM)i, Param::FLAG_HIDDEN);
+      else
+         Param::SetFixed((Param::PARAM_NUM)i, RandomValue());
+   }
+}
+
+/** Save in steps of maxWords words like ConfigSave does
+ * @return result of the last step
+ */
+static int Save(int maxWords)
+{
+   int result;
+
+   flash.EraseBank(parm_save_bank());
+   parm_save_start();
+   while ((result = parm_save_step(maxWords)) > 0);
+
+   return result;
+}
+
+static void TestRoundTrip()
+{
+   const int stepSizes[] = { 1, 3, PAGE_WORDS };
+   uint32_t page[PAGE_WORDS];
+
+   //Changing all parameters of the bench list does not fit, see TestOverflow()
+   const int maxPercent = Param::PARAM_LAST > 100 ? 30 : 100;
+
+   srand(1);
+
+   for (int round = 0; round < 200; round++)
+   {
+      LoadDefaults();
+      ChangeParams(round % 5 == 0 ? maxPercent : rand() % maxPercent);
+      State saved = Capture();
+
+      CHECK(Save(PAGE_WORDS) == 0);
+      int bank = parm_active_bank();
+      CHECK(bank >= 0);
+      memcpy(page, flash.GetBank(bank) + PARAM_BLKOFFSET / 4, sizeof(page));
+
+      CHECK(Reboot() == 0);
+      CHECK(Capture() == saved);
+
+      //Any step size programs the same page, apart from the sequence number
+      int steps = stepSizes[round % 3];
+      CHECK(Save(steps) == 0);
+      bank = parm_active_bank();
+      page[1] = flash.GetBank(bank)[PARAM_BLKOFFSET / 4 + 1];
+      page[3] = flash.GetBank(bank)[PARAM_BLKOFFSET / 4 + 3];
+      CHECK(memcmp(page, flash.GetBank(bank) + PARAM_BLKOFFSET / 4, sizeof(page)) == 0);
+      CHECK(Reboot() == 0);
+      CHECK(Capture() == saved);
+   }
+
+   //Only the header without any changed parameter
+   LoadDefaults();
+   State defaults = Capture();
+   CHECK(Save(PAGE_WORDS) == 0);
+   CHECK(flash.GetBank(parm_active_bank())[PARAM_BLKOFFSET / 4 + 2] == 0);
+   CHECK(Reboot() == 0);
+   CHECK(Capture() == defaults);
+}
+
+#ifdef BENCH_SIZE
+static bool FlashUnchanged(RamFlash& saved)
+{
+   return memcmp(flash.GetBank(0), saved.GetBank(0), SECTOR_SIZE) == 0 &&
+          memcmp(flash.GetBank(1), saved.GetBank(1), SECTOR_SIZE) == 0;
+}
+
+static void TestOverflow()
+{
+   LoadDefaults();
+   Param::SetFixed((Param::PARAM_NUM)0, FP_FROMINT(5));
+   State before = Capture();
+   CHECK(Save(PAGE_WORDS) == 0);
+   int activeBefore = parm_active_bank();
+   RamFlash saved = flash;
+
+   //Every parameter changed with flags and 5 byte deltas takes more than a page
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      if (!Param::IsParam((Param::PARAM_NUM)i)) continue;
+      Param::SetFixed((Param::PARAM_NUM)i, i & 1 ? INT32_MAX : 0);
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, Param::FLAG_HIDDEN);
+   }
+
+   //Known right after parm_save_start(), before anything is erased
+   parm_save_start();
+   CHECK(parm_save_step(0) == PARAM_SAVE_ERR_FULL);
+   CHECK(parm_save_step(16) == PARAM_SAVE_ERR_FULL);
+   CHECK(FlashUnchanged(saved));
+
+   //parm_save() programs nothing and reports it the same way
+   parm_save();
+   CHECK(parm_save_step(0) == PARAM_SAVE_ERR_FULL);
+   CHECK(FlashUnchanged(saved));
+
+   //The background save refuses to start and erases nothing
+   CHECK(!ConfigSave::Start());
+   CHECK(!ConfigSave::IsBusy());
+   CHECK(ConfigSave::HasFailed());
+   CHECK(FlashUnchanged(saved));
+
+   //The previous configuration survives, also with a single bank
+   CHECK(parm_active_bank() == activeBefore);
+   CHECK(Reboot() == 0);
+   CHECK(Capture() == before);
+
+#ifdef FLASH_CONF_BASE2
+   //Values that grow while saving still stop the save, the page is never committed
+   flash.EraseBank(parm_save_bank());
+   parm_save_start();
+   CHECK(parm_save_step(0) > 0);
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      if (Param::IsParam((Param::PARAM_NUM)i))
+         Param::SetFixed((Param::PARAM_NUM)i, i & 1 ? INT32_MAX : 0);
+   }
+   while (parm_save_step(16) > 0);
+   CHECK(parm_save_step(0) == PARAM_SAVE_ERR_FULL);
+   CHECK(parm_active_bank() == activeBefore);
+   CHECK(Reboot() == 0);
+   CHECK(Capture() == before);
+#endif // FLASH_CONF_BASE2
+
+   //Fewer changes fit again
+   LoadDefaults();
+   ChangeParams(10);
+   State fewer = Capture();
+   CHECK(ConfigSave::Start());
+   while (ConfigSave::IsBusy())
+      ConfigSave::Run(16);
+   CHECK(!ConfigSave::HasFailed());
+   CHECK(Reboot() == 0);
+   CHECK(Capture() == fewer);
+}
+#endif // BENCH_SIZE
+
+int main()
+{
+   parm_set_flash(&flash);
+
+   TestRoundTrip();
+#ifdef BENCH_SIZE
+   TestOverflow();
+#endif // BENCH_SIZE
+
+   return TestResult("compact");
+}
@@ -0,0 +1,226 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Test and timing simulation of the background save by ConfigSave
+ *
+ * The flash simulation takes a number of IsBusy() polls to erase and counts
+ * the words programmed in each Run(), no step may program more than it was
+ * given. The worst case time of a step on the target is estimated from the
+ * programmed words and the CPU time of the step on the host. In between
+ * steps frames are sent and received through the CAN map, and every change
+ * of the map must be rejected until it is saved. The finished CAN maps must
+ * equal those of a blocking save. Built with PARAM_SAVE_JOURNAL the sector
+ * must only be erased for changed maps. With the larger parameter list of
+ * tools/hosttest/bench half of the parameters are changed, so the compact
+ * page and the journal records span many words.
+ */
+#include <string.h>
+#include "hosttest.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+#include "configsave.h"
+#include "hwdefs.h"
+
+//STM32F4 datasheet, typical word program time at 32 bit parallelism
+#define PROGRAM_US 16
+#define ERASE_POLLS 5
+
+class SimFlash: public RamFlash
+{
+public:
+   SimFlash(uint32_t size) : RamFlash(size), busyPolls(0), programmed(0), erases(0) {}
+
+   void EraseBank(int bank) { erases++; RamFlash::EraseBank(bank); }
+   void StartErase(int bank) { EraseBank(bank); busyPolls = ERASE_POLLS; }
+   bool IsBusy() { return busyPolls > 0 && busyPolls--; }
+
+   void ProgramWord(int bank, uint32_t offset, uint32_t value)
+   {
+      programmed++;
+      RamFlash::ProgramWord(bank, offset, value);
+   }
+
+   int busyPolls;
+   int programmed;
+   int erases;
+};
+
+#ifdef BENCH_SIZE
+static const Param::PARAM_NUM udc = Param::udcaaa, idc = Param::udcaab, speed = Param::udcaac, fweak = Param::fweakaaa;
+#else
+static const Param::PARAM_NUM udc = Param::udc, idc = Param::idc, speed = Param::speed, fweak = Param::fweak;
+#endif // BENCH_SIZE
+
+static SimFlash flash(16384);
+#ifdef PARAM_SAVE_JOURNAL
+static SimFlash journalFlash(16384);
+#endif // PARAM_SAVE_JOURNAL
+static Can* can;
+
+static void Init()
+{
+   can = HostCan::Boot(&flash);
+
+   for (int i = 0; i < 8; i++)
+   {
+      can->AddSend(udc, 0x100 + i, 0, 16, 1);
+      can->AddSend(idc, 0x100 + i, 16, 16, 0.1, -100);
+      can->AddRecv(fweak, 0x200 + i, 8 * i, 8, 1);
+   }
+   CHECK(can->SetSendTiming(0x103, 10, 3, 0) == 0);
+}
+
+static void CheckEditsRejected()
+{
+   int canId, offset, length;
+   float gain;
+   bool rx;
+
+   CHECK(can->AddSend(speed, 0x300, 0, 16, 1) == CAN_ERR_SAVING);
+   CHECK(can->AddRecv(speed, 0x301, 0, 16, 1) == CAN_ERR_SAVING);
+   CHECK(can->Remove(udc) == CAN_ERR_SAVING);
+   CHECK(can->Clear() == CAN_ERR_SAVING);
+   CHECK(can->SetSendTiming(0x103, 1, 0, 0) == CAN_ERR_SAVING);
+   //Nothing changed
+   CHECK(can->FindMap(udc, canId, offset, length, gain, rx) && canId == 0x100);
+   CHECK(!can->FindMap(speed, canId, offset, length, gain, rx));
+}
+
+/** Run the background save and check the map stays in use throughout
+ * \return worst case estimated step time in us */
+static double BackgroundSave(int maxWords)
+{
+   double worstUs = 0;
+   int steps = 0, lastProgress = 0;
+
+   CHECK(ConfigSave::Start());
+   CHECK(!ConfigSave::Start());
+
+   while (ConfigSave::IsBusy())
+   {
+      flash.programmed = 0;
+#ifdef PARAM_SAVE_JOURNAL
+      journalFlash.programmed = 0;
+#endif // PARAM_SAVE_JOURNAL
+      uint64_t start = NowNs();
+      ConfigSave::Run(maxWords);
+      uint64_t ns = NowNs() - start;
+
+      int programmed = flash.programmed;
+#ifdef PARAM_SAVE_JOURNAL
+      programmed += journalFlash.programmed;
+#endif // PARAM_SAVE_JOURNAL
+      double us = ns / 1000.0 + programmed * PROGRAM_US;
+      if (us > worstUs) worstUs = us;
+      CHECK(programmed <= maxWords);
+
+      if (can->SaveStep(0) > 0)
+         CheckEditsRejected();
+
+      //Live values are still sent and received
+      uint32_t data[2] = { 0x1234, 0 };
+      Param::SetInt(fweak, 0);
+      can->HandleRx(HostCan::Receive(CAN1, 0x200, false, data));
+      CHECK(Param::GetInt(fweak) == 0x34);
+      can->SendAll();
+      while (HostCan::Transmit(CAN1));
+
+      int progress = ConfigSave::GetProgress();
+      CHECK(progress >= lastProgress);
+      lastProgress = progress;
+      steps++;
+   }
+
+   CHECK(ConfigSave::GetProgress() == 100);
+   printf("%d words per step: %d steps, worst case %.0f us per step\n", maxWords, steps, worstUs);
+
+   return worstUs;
+}
+
+int main()
+{
+   static uint32_t reference[PARAM_BLKOFFSET / 4];
+
+#ifdef PARAM_SAVE_JOURNAL
+   parm_set_journal_flash(&journalFlash);
+#endif // PARAM_SAVE_JOURNAL
+
+#ifdef BENCH_SIZE
+   for (int i = 0; i < Param::PARAM_LAST; i += 2)
+   {
+      if (!Param::IsParam((Param::PARAM_NUM)i)) continue;
+      Param::SetInt((Param::PARAM_NUM)i, i * 37 % 1000);
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, i % 6 == 0 ? Param::FLAG_HIDDEN : 0);
+   }
+#endif // BENCH_SIZE
+
+   Init();
+   Param::SetInt(fweak, 0x34); //the value BackgroundSave() receives
+
+   //Blocking save like TerminalCommands::SaveParameters()
+   flash.EraseBank(parm_save_bank());
+   can->Save();
+   parm_save();
+   memcpy(reference, flash.GetBank(0), sizeof(reference));
+
+   const int sizes[] = { 1, 16, 64 };
+
+   for (int i = 0; i < 3; i++)
+   {
+      double worstUs = BackgroundSave(sizes[i]);
+
+      //The parameter page differs in its sequence number
+      CHECK(memcmp(reference, flash.GetBank(0), PARAM_BLKOFFSET) == 0);
+      CHECK(parm_load() == 0);
+      CHECK(worstUs < (sizes[i] + 1) * PROGRAM_US + 1000);
+   }
+
+#ifdef PARAM_SAVE_JOURNAL
+   //Parameters go to the journal, the sector is only erased for changed CAN maps
+   int erases = flash.erases;
+   CHECK(ConfigSave::CanMapsSaved());
+   Param::SetInt(fweak, 0x35); //saved in the first step, received afterwards
+   BackgroundSave(16);
+   CHECK(flash.erases == erases);
+   CHECK(memcmp(reference, flash.GetBank(0), PARAM_BLKOFFSET) == 0);
+   Param::SetInt(fweak, 0);
+   CHECK(parm_load() == 0 && Param::GetInt(fweak) == 0x35);
+   Param::SetInt(fweak, 0x34);
+
+   CHECK(can->SetSendTiming(0x103, 20, 3, 0) == 0);
+   CHECK(!ConfigSave::CanMapsSaved());
+   BackgroundSave(16);
+   CHECK(flash.erases == erases + 1);
+   CHECK(ConfigSave::CanMapsSaved());
+   CHECK(can->SetSendTiming(0x103, 10, 3, 0) == 0);
+#endif // PARAM_SAVE_JOURNAL
+
+   //Edits are accepted again once saved
+   CHECK(can->AddSend(speed, 0x300, 0, 16, 1) > 0);
+   CHECK(can->SetSendTiming(0x300, 100, 0, 0) == 0);
+   CHECK(can->Remove(speed) == 1);
+
+   //The saved image loads
+   Init();
+   CHECK(parm_load() == 0);
+   int period, phase, minGap;
+   CHECK(can->GetSendTiming(0x103, period, phase, minGap) && period == 10 && phase == 3);
+
+   return TestResult("configsave");
+}
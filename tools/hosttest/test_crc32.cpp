@@ -0,0 +1,86 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Test of crc32() against the STM32 CRC unit vectors and a bitwise model of
+ * the unit, built with and without CRC32_SLICE_BY_8. */
+#include "hosttest.h"
+#include "crc32.h"
+
+/** The CRC unit as described in the reference manual, one bit at a time */
+static uint32_t BitwiseCrc32(const uint32_t* p, uint32_t len, uint32_t crc)
+{
+   while (len--)
+   {
+      crc ^= *p++;
+
+      for (int bit = 0; bit < 32; bit++)
+         crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+   }
+   return crc;
+}
+
+static uint32_t NextRandom(uint32_t& state)
+{
+   state = state * 1664525 + 1013904223;
+   return state;
+}
+
+int main()
+{
+   uint32_t data[67];
+   uint32_t seed = 1;
+
+   //Vectors of the reference manual and the header
+   CHECK(crc32(0x00000000, CRC32_INIT) == 0xC704DD7B);
+   CHECK(crc32(0x12345678, CRC32_INIT) == 0xDF8A8A2B);
+   CHECK(crc32(0xFFFFFFFF, CRC32_INIT) == 0x00000000);
+
+   for (uint32_t i = 0; i < sizeof(data) / sizeof(data[0]); i++)
+      data[i] = NextRandom(seed);
+
+   //Every length, odd and even ones take different paths with slice-by-8
+   for (uint32_t len = 0; len <= sizeof(data) / sizeof(data[0]); len++)
+   {
+      uint32_t expected = BitwiseCrc32(data, len, CRC32_INIT);
+      uint32_t crc = CRC32_INIT;
+
+      CHECK(crc32(data, len, CRC32_INIT) == expected);
+      CHECK(crc32(data, len, 0x5A5A5A5A) == BitwiseCrc32(data, len, 0x5A5A5A5A));
+
+      //Word by word like crc_calculate()
+      for (uint32_t i = 0; i < len; i++)
+         crc = crc32(data[i], crc);
+      CHECK(crc == expected);
+
+      //Continued from a split point like a block followed by more data
+      CHECK(crc32(data + len / 3, len - len / 3, crc32(data, len / 3, CRC32_INIT)) == expected);
+   }
+
+   for (int i = 0; i < 100000; i++)
+   {
+      uint32_t word = NextRandom(seed);
+      uint32_t init = NextRandom(seed);
+      CHECK(crc32(word, init) == BitwiseCrc32(&word, 1, init));
+   }
+
+#ifdef CRC32_SLICE_BY_8
+   return TestResult("crc32 slice-by-8");
+#else
+   return TestResult("crc32");
+#endif // CRC32_SLICE_BY_8
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Test of crc8() and Crc8Stream against a bitwise CRC-8 (polynomial 0x07)
+ * and throughput benchmark, built with and without CRC8_SLICE_BY_4. */
+#include "hosttest.h"
+#include "crc8.h"
+
+#define BENCH_BYTES 64
+#define ROUNDS 200000
+
+static uint8_t BitwiseCrc8(const uint8_t* p, int len, uint8_t crc)
+{
+   while (len--)
+   {
+      crc ^= *p++;
+
+      for (int bit = 0; bit < 8; bit++)
+         crc = crc & 0x80 ? (uint8_t)(crc << 1) ^ 0x07 : crc << 1;
+   }
+   return crc;
+}
+
+int main()
+{
+   uint8_t data[255];
+   uint32_t state = 1;
+
+   for (unsigned i = 0; i < sizeof(data); i++)
+   {
+      state = state * 1664525 + 1013904223;
+      data[i] = state >> 24;
+   }
+
+   //Standard check value of CRC-8/SMBUS
+   CHECK(crc8((const uint8_t*)"123456789", 9, 0) == 0xF4);
+
+   for (int byte = 0; byte < 256; byte++)
+   {
+      uint8_t input = byte;
+      CHECK(crc_table[byte] == BitwiseCrc8(&input, 1, 0));
+      CHECK(crc8(input, 0x3C) == BitwiseCrc8(&input, 1, 0x3C));
+   }
+
+   //Every length and initial value, lengths not divisible by 4 leave a tail
+   for (int len = 0; len <= 255; len++)
+   {
+      for (int init = 0; init < 256; init += 17)
+         CHECK(crc8(data, len, init) == BitwiseCrc8(data, len, init));
+   }
+
+   //Streaming in pieces of any size gives the single call result
+   for (int piece = 1; piece <= 9; piece++)
+   {
+      Crc8Stream stream;
+      int pos = 0;
+
+      for (; pos + piece <= 255; pos += piece)
+         stream.Add(data + pos, piece);
+      for (; pos < 255; pos++)
+         stream.Add(data[pos]);
+
+      CHECK(stream.Get() == BitwiseCrc8(data, 255, 0));
+      stream.Reset(0xFF);
+      stream.Add(data, 10);
+      CHECK(stream.Get() == BitwiseCrc8(data, 10, 0xFF));
+   }
+
+   uint64_t start = NowNs();
+   uint8_t crc = 0;
+
+   for (int round = 0; round < ROUNDS; round++)
+      crc = crc8(data, BENCH_BYTES, crc);
+
+   uint64_t tableNs = NowNs() - start;
+   uint8_t expected = 0;
+
+   start = NowNs();
+   for (int round = 0; round < ROUNDS; round++)
+      expected = BitwiseCrc8(data, BENCH_BYTES, expected);
+
+   uint64_t bitwiseNs = NowNs() - start;
+
+   CHECK(crc == expected);
+
+#ifdef CRC8_SLICE_BY_4
+   const char* name = "crc8 slice-by-4";
+#else
+   const char* name = "crc8";
+#endif // CRC8_SLICE_BY_4
+
+   printf("%s, %d bytes: bitwise %.1f ns, table %.1f ns per block\n", name, BENCH_BYTES,
+          (double)bitwiseNs / ROUNDS, (double)tableNs / ROUNDS);
+
+   return TestResult(name);
+}
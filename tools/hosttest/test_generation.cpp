@@ -0,0 +1,92 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Test of the change generation around its wrap around. params.cpp is
+ * included to start the generation counter close to the critical values
+ * instead of counting up for minutes. */
+#include "hosttest.h"
+#include "../../src/params.cpp"
+
+void parm_Change(Param::PARAM_NUM) {}
+
+static int CountChanged(uint32_t since)
+{
+   int count = 0;
+
+   for (int idx = Param::NextChanged(0, since); idx < Param::PARAM_LAST; idx = Param::NextChanged(idx + 1, since))
+      count++;
+
+   return count;
+}
+
+static void TestFromGeneration(uint32_t start)
+{
+   Param::generation = start;
+
+   uint32_t gen = Param::GetGeneration();
+   CHECK(CountChanged(gen) == 0);
+
+   Param::SetInt(Param::fweak, Param::GetInt(Param::fweak) + 1);
+   Param::SetInt(Param::udc, Param::GetInt(Param::udc) + 1);
+   CHECK(CountChanged(gen) == 2);
+   CHECK(Param::NextChanged(0, gen) == Param::fweak);
+   CHECK(Param::NextChanged(Param::fweak + 1, gen) == Param::udc);
+
+   gen = Param::GetGeneration();
+   CHECK(CountChanged(gen) == 0);
+
+   //Changes long ago don't show up again
+   Param::generation += 0x80000000;
+   gen = Param::GetGeneration();
+   Param::SetInt(Param::idc, Param::GetInt(Param::idc) + 1);
+   CHECK(CountChanged(gen) == 1);
+   CHECK(Param::NextChanged(0, gen) == Param::idc);
+
+   CHECK(CountChanged(0) == Param::PARAM_LAST);
+}
+
+int main()
+{
+   //Nothing changed yet, since 0 still lists everything. The generation
+   //starts at 1, so passing it on finds no changes.
+   CHECK(Param::GetGeneration() == 1);
+   CHECK(CountChanged(0) == Param::PARAM_LAST);
+   CHECK(CountChanged(Param::GetGeneration()) == 0);
+
+   //The generation wraps in the middle of these changes, skipping 0
+   Param::generation = 0xFFFFFFFE;
+   uint32_t gen = Param::GetGeneration();
+   Param::SetInt(Param::boost, Param::GetInt(Param::boost) + 1);
+   CHECK(Param::GetGeneration() == 0xFFFFFFFF);
+   Param::SetInt(Param::trim, Param::GetInt(Param::trim) + 1);
+   CHECK(Param::GetGeneration() == 1);
+   Param::SetInt(Param::speed, Param::GetInt(Param::speed) + 1);
+   CHECK(Param::GetGeneration() == 2);
+   CHECK(CountChanged(gen) == 3);
+   CHECK(CountChanged(0xFFFFFFFF) == 2);
+   CHECK(CountChanged(1) == 1);
+   CHECK(Param::NextChanged(0, 1) == Param::speed);
+
+   //Past 2^31 unchanged parameters used to compare as changed. The
+   //generation only moves forward, like it does on the target.
+   TestFromGeneration(0x7FFFFFF0);
+   TestFromGeneration(0xFFFFFFF8);
+   TestFromGeneration(0x80000010);
+
+   return TestResult("generation");
+}
@@ -0,0 +1,352 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Power loss test of the parameter journal behind parm_save() and parm_load()
+ *
+ * Every save of a random sequence of parameter changes is repeated with the
+ * power cut at each of its flash operations. After a cut each parameter must
+ * load either its old or its new state, a compaction into the other bank
+ * must load entirely old or entirely new. Saving again must then recover.
+ * The same holds for the first save after migrating from a parameter page.
+ * Compactions wait for the erase of the other sector in between save steps.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "hosttest.h"
+#include "params.h"
+#include "param_save.h"
+#include "param_journal.h"
+#include "hwdefs.h"
+#include <libopencm3/stm32/crc.h>
+
+struct State
+{
+   s32fp values[Param::PARAM_LAST];
+   uint8_t flags[Param::PARAM_LAST];
+
+   bool operator==(const State& other) const
+   {
+      return memcmp(values, other.values, sizeof(values)) == 0 && memcmp(flags, other.flags, sizeof(flags)) == 0;
+   }
+};
+
+static State Capture()
+{
+   State state;
+
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      state.values[i] = Param::Get((Param::PARAM_NUM)i);
+      state.flags[i] = Param::GetFlag((Param::PARAM_NUM)i);
+   }
+   return state;
+}
+
+static void Restore(const State& state)
+{
+   for (int i = 0; i < Param::PARAM_LAST; i++)
+   {
+      Param::SetFixed((Param::PARAM_NUM)i, state.values[i]);
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, state.flags[i]);
+   }
+}
+
+/** Simulate a reset, parameters start at their defaults before loading */
+static int Reboot()
+{
+   for (int i = 0; i < Param::udc; i++)
+   {
+      Param::SetFixed((Param::PARAM_NUM)i, Param::GetAttrib((Param::PARAM_NUM)i)->def);
+      Param::SetFlagsRaw((Param::PARAM_NUM)i, 0);
+   }
+
+   return parm_load();
+}
+
+static int ChangeRandomParams()
+{
+   int changes = rand() % 4;
+
+   for (int i = 0; i < changes; i++)
+   {
+      //Only parameters are saved, values are not
+      Param::PARAM_NUM param = (Param::PARAM_NUM)(rand() % Param::udc);
+
+      if (rand() % 4 == 0)
+         Param::SetFlagsRaw(param, Param::GetFlag(param) ^ Param::FLAG_HIDDEN);
+      else
+         Param::SetFixed(param, rand() - RAND_MAX / 2);
+   }
+   return changes;
+}
+
+#define ERASE_POLLS 3
+
+/** Flash whose erase takes a number of IsBusy() polls, counts programmed words */
+class SlowFlash: public RamFlash
+{
+public:
+   SlowFlash(uint32_t size) : RamFlash(size), busyPolls(0), erases(0), programmed(0) {}
+
+   void StartErase(int bank) { EraseBank(bank); busyPolls = ERASE_POLLS; erases++; }
+   bool IsBusy() { return busyPolls > 0 && busyPolls--; }
+
+   void ProgramWord(int bank, uint32_t offset, uint32_t value)
+   {
+      programmed++;
+      RamFlash::ProgramWord(bank, offset, value);
+   }
+
+   int busyPolls;
+   int erases;
+   int programmed;
+};
+
+static RamFlash config(16384);
+
+/** Save a parameter page of a firmware without journal to the configuration sector */
+static void WriteParamPage()
+{
+   const uint32_t numParams = (PARAM_BLKSIZE - 8) / 8;
+   uint32_t page[2 * numParams];
+
+   for (uint32_t i = 0; i < 2 * numParams; i++)
+      page[i] = 0xFFFFFFFF;
+
+   for (int i = 0; i < Param::udc; i++)
+   {
+      Param::PARAM_NUM param = (Param::PARAM_NUM)i;
+      page[2 * i] = Param::GetAttrib(param)->id | 0xFF << 16 | (uint32_t)Param::GetFlag(param) << 24;
+      page[2 * i + 1] = Param::Get(param);
+   }
+
+   config.EraseBank(0);
+   for (uint32_t i = 0; i < 2 * numParams; i++)
+   {
+      if (page[i] != 0xFFFFFFFF)
+         config.ProgramWord(0, PARAM_BLKOFFSET / 4 + i, page[i]);
+   }
+
+   crc_reset();
+   config.ProgramWord(0, PARAM_BLKOFFSET / 4 + 2 * numParams, crc_calculate_block(page, 2 * numParams));
+}
+
+/** The first save of a firmware with journal, cut at every flash operation,
+ * loads the parameter page or the journal. The page stays untouched. */
+static void TestMigration()
+{
+   RamFlash journalFlash(128);
+   long cuts = 0;
+
+   parm_set_journal_flash(&journalFlash);
+   Param::SetInt(Param::boost, 1500);
+   Param::SetFlagsRaw(Param::fweak, Param::FLAG_HIDDEN);
+   WriteParamPage();
+
+   State before = Capture();
+   CHECK(Reboot() == 0);
+   CHECK(Capture() == before);
+
+   RamFlash configBefore = config;
+
+   Param::SetInt(Param::boost, 1600);
+   Param::SetInt(Param::trim, -3);
+   State after = Capture();
+
+   for (long cut = 0; ; cut++)
+   {
+      bool complete = true;
+
+      journalFlash = RamFlash(128);
+      Restore(after);
+      journalFlash.SetPowerCut(cut);
+
+      try
+      {
+         parm_save();
+      }
+      catch (RamFlash::PowerCut&)
+      {
+         complete = false;
+      }
+
+      journalFlash.SetPowerCut(-1);
+      CHECK(Reboot() == 0);
+      CHECK(Capture() == (complete ? after : before));
+      CHECK(memcmp(config.GetBank(0), configBefore.GetBank(0), 16384) == 0);
+
+      if (complete) break;
+      cuts++;
+   }
+
+   printf("migration: %ld power cuts\n", cuts);
+
+   //Once migrated the journal is loaded, not the page
+   Param::SetInt(Param::boost, 1700);
+   parm_save();
+   CHECK(Reboot() == 0);
+   CHECK(Param::GetInt(Param::boost) == 1700);
+   Restore(after);
+}
+
+/** A compaction waits for the other sector to be erased in between save steps */
+static void TestSteppedCompaction()
+{
+   SlowFlash journalFlash(128);
+   int steps = 0;
+
+   parm_set_journal_flash(&journalFlash);
+
+   for (int round = 0; round < 20; round++)
+   {
+      Param::SetInt(Param::boost, 1000 + round);
+      Param::SetInt(Param::fweak, 100 + round);
+      State after = Capture();
+      int erases = journalFlash.erases;
+
+      int programmed = journalFlash.programmed;
+      int result;
+
+      parm_save_start();
+      for (steps = 1; (result = parm_save_step(1)) > 0; steps++)
+      {
+         //At most the one word of the budget per step
+         CHECK(journalFlash.programmed - programmed <= 1);
+         programmed = journalFlash.programmed;
+         CHECK(steps < 100);
+      }
+      CHECK(result == 0);
+      CHECK(journalFlash.programmed - programmed <= 1);
+
+      //Parameters stay usable while the erase is running
+      CHECK(Capture() == after);
+      //A compaction also takes one step per busy poll
+      if (journalFlash.erases > erases)
+         CHECK(steps > ERASE_POLLS);
+      CHECK(Reboot() == 0);
+      CHECK(Capture() == after);
+   }
+   CHECK(journalFlash.erases > 2);
+}
+
+static void TestPowerCuts()
+{
+   static RamFlash journalFlash(128); //15 records per bank, compacts often
+   long cuts = 0, compactions = 0;
+
+   parm_set_journal_flash(&journalFlash);
+
+   CHECK(Reboot() == -1);
+
+   //The first save compacts all parameters into a bank
+   Param::SetInt(Param::boost, 1234);
+   State first = Capture();
+   CHECK(parm_save() == 6);
+   CHECK(Reboot() == 0);
+   CHECK(Capture() == first);
+
+   //Only changes are appended
+   Param::SetInt(Param::fweak, 99);
+   CHECK(parm_save() == 1);
+   CHECK(parm_save() == 0);
+
+   srand(1);
+
+   for (int round = 0; round < 200; round++)
+   {
+      State before = Capture();
+      RamFlash saved = journalFlash;
+
+      ChangeRandomParams();
+
+      State after = Capture();
+      int dirty = 0;
+
+      for (int i = 0; i < Param::udc; i++)
+         dirty += before.values[i] != after.values[i] || before.flags[i] != after.flags[i];
+
+      bool compacts = ParamJournal(&journalFlash).GetFreeRecords() < dirty;
+      compactions += compacts;
+
+      for (long cut = 0; ; cut++)
+      {
+         bool complete = true;
+
+         journalFlash = saved;
+         Restore(after);
+         journalFlash.SetPowerCut(cut);
+
+         try
+         {
+            parm_save();
+         }
+         catch (RamFlash::PowerCut&)
+         {
+            complete = false;
+         }
+
+         journalFlash.SetPowerCut(-1);
+         CHECK(Reboot() == 0);
+
+         State loaded = Capture();
+
+         if (complete)
+         {
+            CHECK(loaded == after);
+            break;
+         }
+
+         cuts++;
+
+         if (compacts)
+         {
+            CHECK(loaded == before || loaded == after);
+         }
+         else
+         {
+            for (int i = 0; i < Param::PARAM_LAST; i++)
+            {
+               CHECK(loaded.values[i] == before.values[i] || loaded.values[i] == after.values[i]);
+               CHECK(loaded.flags[i] == before.flags[i] || loaded.flags[i] == after.flags[i]);
+            }
+         }
+
+         //Saving after the reboot stores the state again
+         Restore(after);
+         parm_save();
+         Reboot();
+         loaded = Capture();
+         CHECK(loaded == after);
+      }
+
+      Restore(after);
+   }
+
+   printf("%ld power cuts, %ld compactions\n", cuts, compactions);
+}
+
+int main()
+{
+   parm_set_flash(&config);
+
+   TestPowerCuts();
+   TestSteppedCompaction();
+   TestMigration();
+
+   return TestResult("journal");
+}
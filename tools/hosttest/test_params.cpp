@@ -0,0 +1,240 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Tests of the change notification of the parameter database, single and
+ * batched. Built with PARAM_BATCH_SIZE 4 to reach the full batch. */
+#include "hosttest.h"
+#include "params.h"
+
+static Param::PARAM_NUM changes[64];
+static int numChanges = 0;
+static Param::PARAM_NUM setInCallback = Param::PARAM_INVALID;
+static Param::PARAM_NUM batch[64];
+static int batchSize = 0;
+static int numBatches = 0;
+
+void parm_Change(Param::PARAM_NUM param)
+{
+   if (numChanges < 64)
+      changes[numChanges] = param;
+   numChanges++;
+
+   //Acts like an interrupt that sets a parameter during ProcessChanges()
+   if (setInCallback != Param::PARAM_INVALID)
+   {
+      Param::Set(setInCallback, Param::Get(setInCallback));
+      setInCallback = Param::PARAM_INVALID;
+   }
+}
+
+void parm_ChangeBatch(const Param::PARAM_NUM *params, int count)
+{
+   for (int i = 0; i < count && i < 64; i++)
+      batch[i] = params[i];
+   batchSize = count;
+   numBatches++;
+}
+
+static void TestImmediateChange()
+{
+   numChanges = 0;
+   CHECK(Param::Set(Param::fweak, FP_FROMINT(100)) == 0);
+   CHECK(numChanges == 1 && changes[0] == Param::fweak);
+
+   //Out of range values are neither stored nor notified
+   CHECK(Param::Set(Param::fweak, FP_FROMINT(1000)) == -1);
+   CHECK(numChanges == 1);
+   CHECK(Param::GetInt(Param::fweak) == 100);
+}
+
+static void TestDeferredCoalescing()
+{
+   Param::SetDeferredChange(true);
+   numChanges = 0;
+
+   Param::Set(Param::fweak, FP_FROMINT(101));
+   Param::Set(Param::fweak, FP_FROMINT(102));
+   Param::Set(Param::fweak, FP_FROMINT(103));
+   Param::Set(Param::fweak, FP_FROMINT(1000)); //out of range, not marked
+   CHECK(numChanges == 0);
+   CHECK(Param::GetInt(Param::fweak) == 103);
+
+   Param::ProcessChanges();
+   CHECK(numChanges == 1 && changes[0] == Param::fweak);
+
+   //Nothing left after processing
+   Param::ProcessChanges();
+   CHECK(numChanges == 1);
+
+   //Setting the same value again still notifies, like the immediate mode
+   Param::Set(Param::fweak, FP_FROMINT(103));
+   Param::ProcessChanges();
+   CHECK(numChanges == 2 && changes[1] == Param::fweak);
+
+   Param::SetDeferredChange(false);
+}
+
+static void TestDeferredOrdering()
+{
+   //Set in reverse order, notified in PARAM_LIST order
+   const Param::PARAM_NUM order[] = { Param::canspeed, Param::polepairs, Param::trim, Param::udcmin, Param::boost };
+
+   Param::SetDeferredChange(true);
+   numChanges = 0;
+
+   for (int i = 0; i < 5; i++)
+      Param::Set(order[i], Param::Get(order[i]));
+   Param::Set(Param::boost, FP_FROMINT(1000));
+
+   Param::ProcessChanges();
+   CHECK(numChanges == 5);
+
+   for (int i = 0; i < 5 && i < numChanges; i++)
+      CHECK(changes[i] == order[4 - i]);
+
+   //Values are set without notification in either mode
+   numChanges = 0;
+   Param::SetFixed(Param::udc, FP_FROMINT(400));
+   Param::SetInt(Param::idc, 10);
+   Param::ProcessChanges();
+   CHECK(numChanges == 0);
+
+   Param::SetDeferredChange(false);
+}
+
+static void TestChangeWhileProcessing()
+{
+   Param::SetDeferredChange(true);
+   numChanges = 0;
+
+   Param::Set(Param::fweak, Param::Get(Param::fweak));
+   setInCallback = Param::boost; //already processed when it is set
+   Param::ProcessChanges();
+   CHECK(numChanges == 1 && changes[0] == Param::fweak);
+
+   Param::ProcessChanges();
+   CHECK(numChanges == 2 && changes[1] == Param::boost);
+
+   Param::SetDeferredChange(false);
+}
+
+static void TestBatch()
+{
+   numChanges = 0;
+   numBatches = 0;
+   Param::SetInt(Param::boost, 1000);
+   Param::SetInt(Param::fweak, 100);
+   Param::SetInt(Param::trim, 0);
+
+   Param::BeginBatch();
+   CHECK(Param::AddToBatch(Param::boost, FP_FROMINT(2000)) == 0);
+   CHECK(Param::AddToBatch(Param::fweak, FP_FROMINT(100)) == 0); //unchanged
+   CHECK(Param::AddToBatch(Param::trim, FP_FROMINT(5)) == 0);
+   CHECK(Param::AddToBatch(Param::trim, FP_FROMFLT(-5)) == 0); //replaces 5
+   CHECK(Param::AddToBatch(Param::fweak, FP_FROMINT(1000)) == -1);
+
+   //Nothing is applied before the commit
+   CHECK(Param::GetInt(Param::boost) == 1000);
+   CHECK(Param::GetInt(Param::trim) == 0);
+
+   //One callback with only the changed parameters, none per parameter
+   CHECK(Param::CommitBatch() == 2);
+   CHECK(numBatches == 1 && batchSize == 2);
+   CHECK(batch[0] == Param::boost && batch[1] == Param::trim);
+   CHECK(numChanges == 0);
+   CHECK(Param::GetInt(Param::boost) == 2000);
+   CHECK(Param::GetInt(Param::fweak) == 100);
+   CHECK(Param::GetInt(Param::trim) == -5);
+
+   //Nothing changed, no callback
+   Param::BeginBatch();
+   Param::AddToBatch(Param::boost, FP_FROMINT(2000));
+   CHECK(Param::CommitBatch() == 0);
+   CHECK(numBatches == 1);
+
+   //Aborted batches leave everything untouched
+   Param::BeginBatch();
+   Param::AddToBatch(Param::boost, FP_FROMINT(3000));
+   Param::AbortBatch();
+   CHECK(Param::CommitBatch() == 0);
+   CHECK(Param::GetInt(Param::boost) == 2000);
+   CHECK(numBatches == 1);
+
+   //A full batch takes new values of staged parameters but no new parameters
+   Param::BeginBatch();
+   CHECK(Param::AddToBatch(Param::boost, FP_FROMINT(1)) == 0);
+   CHECK(Param::AddToBatch(Param::fweak, FP_FROMINT(1)) == 0);
+   CHECK(Param::AddToBatch(Param::udcmin, FP_FROMINT(1)) == 0);
+   CHECK(Param::AddToBatch(Param::trim, FP_FROMINT(1)) == 0);
+   CHECK(Param::AddToBatch(Param::polepairs, FP_FROMINT(1)) == -2);
+   CHECK(Param::AddToBatch(Param::boost, FP_FROMINT(2)) == 0);
+   CHECK(Param::CommitBatch() == 4);
+   CHECK(Param::GetInt(Param::boost) == 2);
+   CHECK(numBatches == 2 && batchSize == 4);
+}
+
+static void TestDeferredBatch()
+{
+   Param::SetDeferredChange(true);
+   numChanges = 0;
+   numBatches = 0;
+
+   //Changed parameters are marked instead, ProcessChanges() notifies each once
+   Param::BeginBatch();
+   Param::AddToBatch(Param::trim, FP_FROMINT(10));
+   Param::AddToBatch(Param::boost, Param::Get(Param::boost)); //unchanged
+   Param::AddToBatch(Param::fweak, FP_FROMINT(200));
+   CHECK(Param::CommitBatch() == 2);
+   Param::Set(Param::trim, FP_FROMINT(11));
+   CHECK(numBatches == 0 && numChanges == 0);
+
+   Param::ProcessChanges();
+   CHECK(numBatches == 0);
+   CHECK(numChanges == 2 && changes[0] == Param::fweak && changes[1] == Param::trim);
+
+   Param::SetDeferredChange(false);
+}
+
+static void TestBatchGeneration()
+{
+   //What PrintChangedJson() lists after a batch: exactly the changed values
+   uint32_t gen = Param::GetGeneration();
+
+   Param::BeginBatch();
+   Param::AddToBatch(Param::udcmin, Param::Get(Param::udcmin) + FP_FROMINT(1));
+   Param::AddToBatch(Param::canspeed, Param::Get(Param::canspeed));
+   Param::AddToBatch(Param::polepairs, Param::Get(Param::polepairs) + FP_FROMINT(1));
+   Param::CommitBatch();
+
+   CHECK(Param::NextChanged(0, gen) == Param::udcmin);
+   CHECK(Param::NextChanged(Param::udcmin + 1, gen) == Param::polepairs);
+   CHECK(Param::NextChanged(Param::polepairs + 1, gen) == Param::PARAM_LAST);
+}
+
+int main()
+{
+   TestImmediateChange();
+   TestDeferredCoalescing();
+   TestDeferredOrdering();
+   TestChangeWhileProcessing();
+   TestBatch();
+   TestDeferredBatch();
+   TestBatchGeneration();
+
+   return TestResult("params");
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Multi-threaded stress test of Param::Snapshot()
+ *
+ * Two writer threads stand in for interrupts that update related values,
+ * like HandleRx() does for the items of a frame. One writes udc, idc and
+ * speed as k, k + 1 and k + 2, the other tmphs and trim as -k and k. The
+ * reader thread takes snapshots of all five values and checks that each set
+ * is complete. Reading the same values without Snapshot() shows how often a
+ * set is torn.
+ */
+#include <thread>
+#include "hosttest.h"
+#include "params.h"
+
+#define READS 2000000
+
+void parm_Change(Param::PARAM_NUM) {}
+
+static volatile bool stop = false;
+
+static void WriteCurrents()
+{
+   for (s32fp k = 0; !stop; k++)
+   {
+      Param::BeginUpdate();
+      Param::SetFixed(Param::udc, k);
+      Param::SetFixed(Param::idc, k + 1);
+      Param::SetFixed(Param::speed, k + 2);
+      Param::EndUpdate();
+      //Interrupts write periodically, not all the time
+      std::this_thread::yield();
+   }
+}
+
+static void WriteTemperatures()
+{
+   for (s32fp k = 0; !stop; k++)
+   {
+      Param::BeginUpdate();
+      Param::SetFixed(Param::tmphs, -k);
+      Param::BeginUpdate(); //nested brackets are one write
+      Param::SetFixed(Param::trim, k);
+      Param::EndUpdate();
+      Param::EndUpdate();
+      std::this_thread::yield();
+   }
+}
+
+static bool Consistent(const s32fp* vals)
+{
+   return vals[1] == vals[0] + 1 && vals[2] == vals[0] + 2 && vals[3] == -vals[4];
+}
+
+int main()
+{
+   const Param::PARAM_NUM params[] = { Param::udc, Param::idc, Param::speed, Param::tmphs, Param::trim };
+   s32fp vals[5];
+   long consistent = 0, torn = 0, failed = 0, unprotectedTorn = 0;
+
+   Param::SetFixed(Param::idc, 1);
+   Param::SetFixed(Param::speed, 2);
+
+   std::thread currents(WriteCurrents);
+   std::thread temperatures(WriteTemperatures);
+
+   for (long i = 0; i < READS; i++)
+   {
+      if (Param::Snapshot(params, vals, 5) == 0)
+      {
+         if (Consistent(vals))
+            consistent++;
+         else
+            torn++;
+      }
+      else
+      {
+         failed++;
+      }
+
+      for (int j = 0; j < 5; j++)
+         vals[j] = Param::Get(params[j]);
+
+      unprotectedTorn += !Consistent(vals);
+   }
+
+   stop = true;
+   currents.join();
+   temperatures.join();
+
+   printf("%ld consistent snapshots, %ld torn, %ld gave up after retries, %ld of the unprotected reads torn\n",
+          consistent, torn, failed, unprotectedTorn);
+
+   CHECK(torn == 0);
+   CHECK(consistent > 0);
+
+   return TestResult("snapshot");
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Host implementations of the target dependencies of param_save.cpp */
+#include <libopencm3/stm32/crc.h>
+#include "crc32.h"
+#include "params.h"
+#include "stm32_flash.h"
+
+static uint32_t crcState = CRC32_INIT;
+
+void crc_reset()
+{
+   crcState = CRC32_INIT;
+}
+
+uint32_t crc_calculate(uint32_t data)
+{
+   crcState = crc32(data, crcState);
+   return crcState;
+}
+
+uint32_t crc_calculate_block(uint32_t *datap, int size)
+{
+   crcState = crc32(datap, size, crcState);
+   return crcState;
+}
+
+/* The default flash driver is only constructed, the tool replaces it by a
+ * ParamImage before any access. GetBankSize() still reports the configured
+ * sector size. */
+Stm32Flash::Stm32Flash(uint32_t address0, uint8_t sector0, uint32_t address1, uint8_t sector1, uint32_t size)
+   : size(size)
+{
+   addresses[0] = address0;
+   addresses[1] = address1;
+   sectors[0] = sector0;
+   sectors[1] = sector1;
+}
+
+void Stm32Flash::EraseBank(int) {}
+void Stm32Flash::ProgramWord(int, uint32_t, uint32_t) {}
+void Stm32Flash::StartErase(int) {}
+bool Stm32Flash::IsBusy() { return false; }
+
+void parm_Change(Param::PARAM_NUM) {}
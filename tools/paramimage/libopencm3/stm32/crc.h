@@ -0,0 +1,31 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOST_CRC_H
+#define HOST_CRC_H
+
+/* Host replacement of the libopencm3 CRC unit functions used by param_save.cpp,
+ * implemented with the software CRC from crc32.h */
+
+#include <stdint.h>
+
+void crc_reset(void);
+uint32_t crc_calculate(uint32_t data);
+uint32_t crc_calculate_block(uint32_t *datap, int size);
+
+#endif // HOST_CRC_H
@@ -0,0 +1,278 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/* Offline tool for configuration sector images
+ *
+ * Build it per project, with that project's param_prj.h and hwdefs.h, e.g.
+ *   g++ -DCRC32_SLICE_BY_8 -Itools/paramimage -Iinclude -I<project>/include -Itools/hosttest \
+ *       tools/paramimage/main.cpp tools/paramimage/paramimage.cpp tools/paramimage/hostshim.cpp \
+ *       tools/hosttest/hostcan.cpp src/stm32_can.cpp src/param_save.cpp src/params.cpp \
+ *       src/crc32.cpp src/my_string.c -o paramimage
+ * tools/hosttest comes last, it provides the libopencm3 headers of the CAN model.
+ *
+ * paramimage validate <image>...|-     check CRCs, "-" reads file names from stdin
+ * paramimage dump <image>              print parameters and CAN maps
+ * paramimage diff <image a> <image b>  print differing parameters and CAN map items
+ * paramimage set <image>|- <out> name=value...
+ *                                      write a new image with changed parameters,
+ *                                      "-" starts from an erased image
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <string>
+#include "params.h"
+#include "paramimage.h"
+
+static const char* canMapStates[] = { "ok", "erased", "CRC error" };
+static std::set<std::string>* canItems;
+
+static double ToDouble(s32fp value)
+{
+   return (double)value / FRAC_FAC;
+}
+
+static void CollectCanItem(Param::PARAM_NUM param, int canId, int offset, int length, float gain, bool rx)
+{
+   const char* name = param != Param::PARAM_INVALID ? Param::GetAttrib(param)->name : "<unknown>";
+   char line[128];
+
+   snprintf(line, sizeof(line), "%s 0x%x %s %d %d %g", rx ? "rx" : "tx", canId, name, offset, length, gain);
+   canItems->insert(line);
+}
+
+static void GetCanItems(ParamImage& image, std::set<std::string>& items)
+{
+   for (int can = 0; can < 2; can++)
+   {
+      std::set<std::string> canMap;
+      canItems = &canMap;
+      image.IterateCanMap(can, CollectCanItem);
+
+      for (std::set<std::string>::iterator it = canMap.begin(); it != canMap.end(); ++it)
+         items.insert((can == 0 ? "can1 " : "can2 ") + *it);
+   }
+}
+
+static bool Validate(ParamImage& image, const char* file)
+{
+   if (!image.Read(file))
+   {
+      printf("%s: can not read\n", file);
+      return false;
+   }
+
+   bool params = image.LoadParams() == 0;
+   ParamImage::CanMapState can1 = image.GetCanMapState(0);
+   ParamImage::CanMapState can2 = image.GetCanMapState(1);
+
+   printf("%s: params %s, can1 %s, can2 %s\n", file, params ? "ok" : "CRC error",
+          canMapStates[can1], canMapStates[can2]);
+
+   return params && can1 != ParamImage::CANMAP_CRC_ERROR && can2 != ParamImage::CANMAP_CRC_ERROR;
+}
+
+static int ValidateAll(int argc, char** argv)
+{
+   ParamImage image;
+   int failed = 0;
+
+   for (int i = 0; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-") == 0)
+      {
+         char file[1024];
+
+         while (fgets(file, sizeof(file), stdin) != 0)
+         {
+            file[strcspn(file, "\r\n")] = 0;
+            if (file[0] != 0 && !Validate(image, file)) failed++;
+         }
+      }
+      else if (!Validate(image, argv[i]))
+      {
+         failed++;
+      }
+   }
+
+   return failed > 0;
+}
+
+static int Dump(const char* file)
+{
+   ParamImage image;
+   std::set<std::string> items;
+
+   if (!image.Read(file) || image.LoadParams() != 0)
+   {
+      fprintf(stderr, "%s: no valid parameters\n", file);
+      return 1;
+   }
+
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      if (Param::IsParam((Param::PARAM_NUM)idx))
+      {
+         printf("%s %g%s\n", Param::GetAttrib((Param::PARAM_NUM)idx)->name, ToDouble(Param::Get((Param::PARAM_NUM)idx)),
+                Param::GetFlag((Param::PARAM_NUM)idx) & Param::FLAG_HIDDEN ? " hidden" : "");
+      }
+   }
+
+   GetCanItems(image, items);
+
+   for (std::set<std::string>::iterator it = items.begin(); it != items.end(); ++it)
+      printf("%s\n", it->c_str());
+
+   return 0;
+}
+
+static int Diff(const char* fileA, const char* fileB)
+{
+   ParamImage a, b;
+   std::set<std::string> itemsA, itemsB;
+   s32fp values[Param::PARAM_LAST];
+   uint8_t flags[Param::PARAM_LAST];
+   int differences = 0;
+
+   if (!a.Read(fileA) || a.LoadParams() != 0 || !b.Read(fileB))
+   {
+      fprintf(stderr, "can not read valid parameters\n");
+      return 2;
+   }
+
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      values[idx] = Param::Get((Param::PARAM_NUM)idx);
+      flags[idx] = Param::GetFlag((Param::PARAM_NUM)idx);
+   }
+
+   if (b.LoadParams() != 0)
+   {
+      fprintf(stderr, "%s: no valid parameters\n", fileB);
+      return 2;
+   }
+
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+   {
+      Param::PARAM_NUM param = (Param::PARAM_NUM)idx;
+
+      if (Param::IsParam(param) && (values[idx] != Param::Get(param) || flags[idx] != Param::GetFlag(param)))
+      {
+         printf("%s %g%s -> %g%s\n", Param::GetAttrib(param)->name,
+                ToDouble(values[idx]), flags[idx] & Param::FLAG_HIDDEN ? " hidden" : "",
+                ToDouble(Param::Get(param)), Param::GetFlag(param) & Param::FLAG_HIDDEN ? " hidden" : "");
+         differences++;
+      }
+   }
+
+   GetCanItems(a, itemsA);
+   GetCanItems(b, itemsB);
+
+   for (std::set<std::string>::iterator it = itemsA.begin(); it != itemsA.end(); ++it)
+   {
+      if (itemsB.count(*it) == 0)
+      {
+         printf("- %s\n", it->c_str());
+         differences++;
+      }
+   }
+
+   for (std::set<std::string>::iterator it = itemsB.begin(); it != itemsB.end(); ++it)
+   {
+      if (itemsA.count(*it) == 0)
+      {
+         printf("+ %s\n", it->c_str());
+         differences++;
+      }
+   }
+
+   return differences > 0;
+}
+
+static int SetParams(const char* in, const char* out, int argc, char** argv)
+{
+   ParamImage image;
+
+   if (strcmp(in, "-") != 0 && (!image.Read(in) || image.LoadParams() != 0))
+   {
+      fprintf(stderr, "%s: no valid parameters\n", in);
+      return 1;
+   }
+   else if (strcmp(in, "-") == 0)
+   {
+      image.LoadParams(); //Only sets defaults
+   }
+
+   for (int i = 0; i < argc; i++)
+   {
+      char name[64];
+      const char* value = strchr(argv[i], '=');
+      Param::PARAM_NUM param = Param::PARAM_INVALID;
+
+      if (value != 0 && value - argv[i] < (int)sizeof(name))
+      {
+         memcpy(name, argv[i], value - argv[i]);
+         name[value - argv[i]] = 0;
+         param = Param::NumFromString(name);
+      }
+
+      if (param == Param::PARAM_INVALID || !Param::IsParam(param))
+      {
+         fprintf(stderr, "%s: unknown parameter\n", argv[i]);
+         return 1;
+      }
+      if (Param::Set(param, FP_FROMFLT(atof(value + 1))) != 0)
+      {
+         fprintf(stderr, "%s: value out of range\n", argv[i]);
+         return 1;
+      }
+   }
+
+   if (!image.SaveParams())
+   {
+      fprintf(stderr, "parameters do not fit the page\n");
+      return 1;
+   }
+
+   if (!image.Write(out))
+   {
+      fprintf(stderr, "%s: can not write\n", out);
+      return 1;
+   }
+
+   return 0;
+}
+
+int main(int argc, char** argv)
+{
+   if (argc >= 3 && strcmp(argv[1], "validate") == 0)
+      return ValidateAll(argc - 2, argv + 2);
+   if (argc == 3 && strcmp(argv[1], "dump") == 0)
+      return Dump(argv[2]);
+   if (argc == 4 && strcmp(argv[1], "diff") == 0)
+      return Diff(argv[2], argv[3]);
+   if (argc >= 4 && strcmp(argv[1], "set") == 0)
+      return SetParams(argv[2], argv[3], argc - 4, argv + 4);
+
+   fprintf(stderr, "usage: %s validate <image>...|-\n"
+                   "       %s dump <image>\n"
+                   "       %s diff <image a> <image b>\n"
+                   "       %s set <image>|- <out> name=value...\n", argv[0], argv[0], argv[0], argv[0]);
+   return 2;
+}
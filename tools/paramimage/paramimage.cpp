@@ -0,0 +1,162 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "hwdefs.h"
+#include "hostcan.h"
+#include "param_save.h"
+#include "stm32_can.h"
+#include "paramimage.h"
+
+#ifdef FLASH_CONF_BASE2
+#error An image holds one configuration sector, A/B saving is not supported
+#endif
+
+#define ERASED 0xFFFFFFFF
+
+/** Create an erased image of the configured sector size */
+ParamImage::ParamImage()
+   : data(parm_get_flash()->GetBankSize() / sizeof(uint32_t), ERASED)
+{
+}
+
+/** \brief Read an image file, a shorter file is padded with erased flash
+ * \return false if the file can not be read
+ */
+bool ParamImage::Read(const char* file)
+{
+   FILE* f = fopen(file, "rb");
+
+   if (f == 0) return false;
+
+   Erase();
+   size_t len = fread(&data[0], 1, GetBankSize(), f);
+   bool ok = !ferror(f);
+   fclose(f);
+
+   return ok && len > 0;
+}
+
+bool ParamImage::Write(const char* file)
+{
+   FILE* f = fopen(file, "wb");
+
+   if (f == 0) return false;
+
+   bool ok = fwrite(&data[0], 1, GetBankSize(), f) == GetBankSize();
+   return fclose(f) == 0 && ok;
+}
+
+void ParamImage::Erase()
+{
+   for (uint32_t i = 0; i < data.size(); i++)
+      data[i] = ERASED;
+}
+
+/** Flash semantics: bits can only be cleared until the next erase */
+void ParamImage::ProgramWord(int, uint32_t offset, uint32_t value)
+{
+   if (offset < data.size())
+      data[offset] &= value;
+}
+
+/** \brief Load parameters from the image into Param
+ * Parameters not stored in the image are at their default.
+ * \return result of parm_load()
+ */
+int ParamImage::LoadParams()
+{
+   IFlashBanks* old = parm_get_flash();
+
+   for (int idx = 0; idx < Param::PARAM_LAST; idx++)
+      Param::SetFlagsRaw((Param::PARAM_NUM)idx, 0);
+   Param::LoadDefaults();
+
+   parm_set_flash(this);
+   int result = parm_load();
+   parm_set_flash(old);
+
+   return result;
+}
+
+/** \brief Replace the parameter page by the current values in Param
+ * The CAN maps are kept and the save sequence continues from the image.
+ * \return false if the parameters do not fit the page, the image is unchanged then
+ */
+bool ParamImage::SaveParams()
+{
+   std::vector<uint32_t> canMaps(data);
+   IFlashBanks* old = parm_get_flash();
+
+   parm_set_flash(this);
+   parm_save_start();
+
+   //The image stays as it is if the page would overflow
+   if (parm_save_step(0) == PARAM_SAVE_ERR_FULL)
+   {
+      parm_set_flash(old);
+      return false;
+   }
+
+   Erase();
+   memcpy(&data[CAN1_BLKOFFSET / 4], &canMaps[CAN1_BLKOFFSET / 4], CAN_BLKSIZE);
+   memcpy(&data[CAN2_BLKOFFSET / 4], &canMaps[CAN2_BLKOFFSET / 4], CAN_BLKSIZE);
+
+   while (parm_save_step(data.size()) > 0);
+   bool saved = parm_save_step(0) == 0;
+   parm_set_flash(old);
+
+   return saved;
+}
+
+/** \param can 0 for CAN1, 1 for CAN2 */
+ParamImage::CanMapState ParamImage::GetCanMapState(int can)
+{
+   const uint32_t* map = &data[(can == 0 ? CAN1_BLKOFFSET : CAN2_BLKOFFSET) / sizeof(uint32_t)];
+   bool erased = true;
+
+   for (uint32_t i = 0; i < CAN_BLKSIZE / sizeof(uint32_t); i++)
+      erased &= map[i] == ERASED;
+
+   if (erased) return CANMAP_ERASED;
+
+   return LoadCan(can)->IsLoaded() ? CANMAP_VALID : CANMAP_CRC_ERROR;
+}
+
+/** \brief Call callback for every mapped item, same arguments as Can::IterateCanMap()
+ * Lists what the firmware loads, i.e. nothing for a corrupted map.
+ * \param can 0 for CAN1, 1 for CAN2
+ */
+void ParamImage::IterateCanMap(int can, void (*callback)(Param::PARAM_NUM, int, int, int, float, bool))
+{
+   LoadCan(can)->IterateCanMap(callback);
+}
+
+/** Construct the interface like on the target, which loads its map from the image */
+Can* ParamImage::LoadCan(int can)
+{
+   IFlashBanks* old = parm_get_flash();
+
+   HostCan::Reset();
+   parm_set_flash(this);
+   Can* result = HostCan::Create(can == 0 ? CAN1 : CAN2);
+   parm_set_flash(old);
+
+   return result;
+}
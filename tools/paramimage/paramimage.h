@@ -0,0 +1,61 @@
+/*
+ * This file is part of the libopeninv project.
+ *
+ * Copyright (C) 2026 Johannes Huebner <dev@johanneshuebner.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARAMIMAGE_H
+#define PARAMIMAGE_H
+
+#include <stdint.h>
+#include <vector>
+#include "params.h"
+#include "flashbanks.h"
+
+class Can;
+
+/** Image of one configuration flash sector, as read out of a unit or to be flashed
+ *
+ * Parameter pages are read and written by the target's own param_save.cpp,
+ * so an image built for a PARAM_LIST is exactly what the firmware saves.
+ * CAN maps are kept verbatim. They are validated and listed by loading them
+ * into the target's own stm32_can.cpp on the bxCAN model of tools/hosttest.
+ */
+class ParamImage: public IFlashBanks
+{
+public:
+   enum CanMapState { CANMAP_VALID, CANMAP_ERASED, CANMAP_CRC_ERROR };
+
+   ParamImage();
+   bool Read(const char* file);
+   bool Write(const char* file);
+   void Erase();
+   int LoadParams();
+   bool SaveParams();
+   CanMapState GetCanMapState(int can);
+   void IterateCanMap(int can, void (*callback)(Param::PARAM_NUM, int, int, int, float, bool));
+
+   uint32_t GetBankSize() { return data.size() * sizeof(uint32_t); }
+   const uint32_t* GetBank(int) { return &data[0]; }
+   void EraseBank(int) { Erase(); }
+   void ProgramWord(int bank, uint32_t offset, uint32_t value);
+
+private:
+   Can* LoadCan(int can);
+
+   std::vector<uint32_t> data;
+};
+
+#endif // PARAMIMAGE_H